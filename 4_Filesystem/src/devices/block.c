@@ -2,8 +2,13 @@
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
+#include "devices/blocktrace.h"
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 /* A block device. */
 struct block
@@ -17,9 +22,55 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    /* Statistics, updated with interrupts off because requests
+       complete in other threads than they start in. */
+    struct blockstat stats;             /* Counters and histogram. */
+    uint64_t registered;                /* TSC at registration. */
+    uint64_t busy_since;                /* TSC when in_flight left 0. */
+    block_sector_t next_sector;         /* Sector after the last request. */
+
+    /* Request queue, used once block_start_queue() is called. */
+    bool queued;                        /* Requests go through the queue? */
+    struct lock queue_lock;             /* Protects queue and head. */
+    struct condition queue_nonempty;    /* Signaled when a request arrives. */
+    struct list queue;                  /* Pending requests, oldest first. */
+    block_sector_t head;                /* Sector after the last dispatch. */
+    uint8_t *bounce;                    /* Staging area for merged batches. */
+  };
+
+/* An I/O scheduler picks the next request to dispatch from a
+   device's queue.  Adjacent requests are merged into the chosen
+   one afterward regardless of the scheduler. */
+struct io_scheduler
+  {
+    const char *name;
+    struct block_request *(*next) (struct block *);
+  };
+
+static struct block_request *noop_next (struct block *);
+static struct block_request *clook_next (struct block *);
+static struct block_request *deadline_next (struct block *);
+
+static const struct io_scheduler schedulers[] =
+  {
+    {"noop", noop_next},
+    {"clook", clook_next},
+    {"deadline", deadline_next},
   };
+#define SCHEDULER_CNT (sizeof schedulers / sizeof *schedulers)
+
+/* Scheduler used by queues started from now on. */
+static const struct io_scheduler *scheduler = &schedulers[2];
+
+/* Most sectors dispatched as one merged batch. */
+#define MERGE_MAX_SECTORS 64
+
+/* Ticks a queued read or write may wait under the deadline
+   scheduler before it is served ahead of the elevator order.
+   Reads get the shorter limit because a thread is usually
+   blocked on them. */
+#define READ_EXPIRE (TIMER_FREQ / 2)
+#define WRITE_EXPIRE (TIMER_FREQ * 5)
 
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
@@ -28,6 +79,11 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void transfer (struct block *, bool write, block_sector_t,
+                      block_sector_t cnt, void *);
+static uint64_t read_tsc (void);
+static void print_stats (struct block *);
+static void queue_worker (void *block_);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -99,17 +155,19 @@ block_get_by_name (const char *name)
   return NULL;
 }
 
-/* Verifies that SECTOR is a valid offset within BLOCK.
-   Panics if not. */
+/* Verifies that the CNT sectors starting at SECTOR all lie
+   within BLOCK.  Panics if not. */
 static void
-check_sector (struct block *block, block_sector_t sector)
+check_sectors (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
 {
-  if (sector >= block->size)
+  if (sector >= block->size || cnt > block->size - sector)
     {
       /* We do not use ASSERT because we want to panic here
          regardless of whether NDEBUG is defined. */
       PANIC ("Access past end of device %s (sector=%"PRDSNu", "
-             "size=%"PRDSNu")\n", block_name (block), sector, block->size);
+             "cnt=%"PRDSNu", size=%"PRDSNu")\n",
+             block_name (block), sector, cnt, block->size);
     }
 }
 
@@ -120,9 +178,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multi (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +189,200 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multi (block, sector, 1, buffer);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+   BLOCK into BUFFER, which must have room for CNT *
+   BLOCK_SECTOR_SIZE bytes.  Drivers that support it do so with
+   a single command.  CNT may be 0. */
+void
+block_read_multi (struct block *block, block_sector_t sector,
+                  block_sector_t cnt, void *buffer)
+{
+  struct block_request r;
+
+  if (cnt == 0)
+    return;
+  block_request_init (&r, false, sector, cnt, buffer, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR on BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.  CNT may be 0. */
+void
+block_write_multi (struct block *block, block_sector_t sector,
+                   block_sector_t cnt, const void *buffer)
+{
+  struct block_request r;
+
+  if (cnt == 0)
+    return;
+  block_request_init (&r, true, sector, cnt, (void *) buffer, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Initializes R as a request to transfer the CNT consecutive
+   sectors starting at SECTOR to or from BUFFER, which must be
+   CNT * BLOCK_SECTOR_SIZE bytes in kernel memory.  The data
+   goes to the device if WRITE is true and into BUFFER
+   otherwise.
+
+   If CALLBACK is non-null, it is called with R and AUX once the
+   transfer is over, usually in the device's I/O worker thread,
+   and R must not be passed to block_wait().  Otherwise the
+   submitter waits for R with block_wait(). */
+void
+block_request_init (struct block_request *r, bool write,
+                    block_sector_t sector, block_sector_t cnt, void *buffer,
+                    block_callback_func *callback, void *aux)
+{
+  ASSERT (cnt > 0);
+
+  r->write = write;
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->callback = callback;
+  r->aux = aux;
+  r->origin = NULL;
+  sema_init (&r->done, 0);
+}
+
+/* Starts request R on BLOCK and, if BLOCK has a request queue
+   or a driver that completes requests by itself, or lives on a
+   device that does, returns without waiting for it.  Any number
+   of requests may be pending on a device at once.  R belongs to
+   the block layer until it completes, which may rewrite its
+   sector when passing it on to another device. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  enum intr_level old_level;
+  bool first;
+
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  old_level = intr_disable ();
+  first = r->origin == NULL;
+  if (first)
+    {
+      r->origin = block;
+      r->start = read_tsc ();
+      blocktrace_io (block, r->sector, r->cnt, r->write);
+    }
+  if (r->write)
+    block->stats.write_cnt += r->cnt;
+  else
+    block->stats.read_cnt += r->cnt;
+  if (r->sector == block->next_sector)
+    block->stats.seq_cnt++;
+  block->next_sector = r->sector + r->cnt;
+
+  /* Latency and depth are tracked on the device the request was
+     first submitted to and on the one that carries it out. */
+  if (first || block->ops->remap == NULL)
+    {
+      if (block->stats.in_flight++ == 0)
+        block->busy_since = r->start;
+      if (block->stats.in_flight > block->stats.max_in_flight)
+        block->stats.max_in_flight = block->stats.in_flight;
+    }
+  intr_set_level (old_level);
+
+  if (block->ops->remap != NULL)
+    block_submit (block->ops->remap (block->aux, &r->sector), r);
+  else if (block->queued)
+    {
+      r->deadline = timer_ticks () + (r->write ? WRITE_EXPIRE : READ_EXPIRE);
+      lock_acquire (&block->queue_lock);
+      list_push_back (&block->queue, &r->elem);
+      cond_signal (&block->queue_nonempty, &block->queue_lock);
+      lock_release (&block->queue_lock);
+    }
+  else if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, r);
+  else
+    {
+      transfer (block, r->write, r->sector, r->cnt, r->buffer);
+      block_complete (block, r);
+    }
+}
+
+/* Waits for request R, which must have been submitted without a
+   callback, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->callback == NULL);
+  sema_down (&r->done);
+}
+
+/* Records in BLOCK's statistics that request R, which BLOCK
+   counted as in flight, is over at time NOW. */
+static void
+account_completion (struct block *block, struct block_request *r,
+                    uint64_t now)
+{
+  uint64_t latency = now - r->start;
+  int bucket;
+
+  for (bucket = 0; bucket < BLOCKSTAT_BUCKETS - 1; bucket++)
+    if (latency < (2ULL << bucket))
+      break;
+  block->stats.latency[bucket]++;
+  block->stats.request_cnt++;
+  if (--block->stats.in_flight == 0)
+    block->stats.busy_cycles += now - block->busy_since;
+}
+
+/* Reports that request R, just carried out by BLOCK, is over to
+   its submitter.  Called by the block layer, and by drivers with
+   a submit operation for each request they were given. */
+void
+block_complete (struct block *block, struct block_request *r)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = read_tsc ();
+
+  account_completion (block, r, now);
+  if (r->origin != block)
+    account_completion (r->origin, r, now);
+  intr_set_level (old_level);
+
+  if (r->callback != NULL)
+    r->callback (r, r->aux);
+  else
+    sema_up (&r->done);
+}
+
+/* Has BLOCK's driver transfer the CNT sectors starting at SECTOR
+   to or from BUFFER, in one operation if the driver has
+   multi-sector operations and one sector at a time otherwise. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          block_sector_t cnt, void *buffer)
+{
+  const struct block_operations *ops = block->ops;
+  uint8_t *p = buffer;
+
+  if (write && ops->write_multi != NULL)
+    ops->write_multi (block->aux, sector, cnt, buffer);
+  else if (!write && ops->read_multi != NULL)
+    ops->read_multi (block->aux, sector, cnt, buffer);
+  else
+    for (; cnt > 0; sector++, cnt--, p += BLOCK_SECTOR_SIZE)
+      {
+        if (write)
+          ops->write (block->aux, sector, p);
+        else
+          ops->read (block->aux, sector, p);
+      }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -170,14 +416,72 @@ block_print_stats (void)
     {
       struct block *block = block_by_role[i];
       if (block != NULL)
-        {
-          printf ("%s (%s): %llu reads, %llu writes\n",
-                  block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
-        }
+        print_stats (block);
     }
 }
 
+/* Prints BLOCK's statistics: sector counts, then request count,
+   share of sequential requests, depth and utilization, then the
+   non-empty latency buckets as "2^N:COUNT". */
+static void
+print_stats (struct block *block)
+{
+  struct blockstat st;
+  int i;
+
+  block_get_stats (block, &st);
+  printf ("%s (%s): %llu reads, %llu writes\n",
+          block->name, block_type_name (block->type),
+          st.read_cnt, st.write_cnt);
+  if (st.request_cnt == 0)
+    return;
+
+  printf ("%s: %llu requests, %llu%% sequential, "
+          "max %"PRIu32" in flight, %llu%% busy\n",
+          block->name, st.request_cnt, st.seq_cnt * 100 / st.request_cnt,
+          st.max_in_flight,
+          st.total_cycles > 0 ? st.busy_cycles * 100 / st.total_cycles : 0);
+  printf ("%s: latency (cycles)", block->name);
+  for (i = 0; i < BLOCKSTAT_BUCKETS; i++)
+    if (st.latency[i] > 0)
+      printf (" 2^%d:%"PRIu32, i, st.latency[i]);
+  printf ("\n");
+}
+
+/* Returns the number of sectors read from and written to BLOCK
+   so far.  A value that stays the same over an interval means
+   the device was idle. */
+unsigned long long
+block_io_cnt (struct block *block)
+{
+  return block->stats.read_cnt + block->stats.write_cnt;
+}
+
+/* Copies BLOCK's I/O statistics into *ST.  A busy period still
+   going on counts up to now. */
+void
+block_get_stats (struct block *block, struct blockstat *st)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = read_tsc ();
+
+  *st = block->stats;
+  st->total_cycles = now - block->registered;
+  if (st->in_flight > 0)
+    st->busy_cycles += now - block->busy_since;
+  intr_set_level (old_level);
+}
+
+/* Returns the CPU's time stamp counter. */
+static uint64_t
+read_tsc (void)
+{
+  uint64_t tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -198,8 +502,16 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+  block->registered = read_tsc ();
+  block->busy_since = 0;
+  block->next_sector = 0;
+  block->queued = false;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_nonempty);
+  list_init (&block->queue);
+  block->head = 0;
+  block->bounce = NULL;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -210,7 +522,238 @@ block_register (const char *name, enum block_type type,
 
   return block;
 }
+
+/* Makes BLOCK call OPS with AUX in place of its current
+   operations, which are stored in *OLD_OPS and *OLD_AUX for OPS
+   to pass calls on to.  For layers that add behavior to an
+   existing device, such as delays.  BLOCK must be idle and must
+   not forward to another device through a remap operation. */
+void
+block_interpose (struct block *block, const struct block_operations *ops,
+                 void *aux, const struct block_operations **old_ops,
+                 void **old_aux)
+{
+  ASSERT (block->ops->remap == NULL && ops->remap == NULL);
+  ASSERT (block->stats.in_flight == 0);
+
+  *old_ops = block->ops;
+  *old_aux = block->aux;
+  block->ops = ops;
+  block->aux = aux;
+}
 
+/* Request queue and I/O scheduling. */
+
+/* Selects the I/O scheduler named NAME ("noop", "clook" or
+   "deadline") for queues started afterward.  Returns false if
+   there is no such scheduler. */
+bool
+block_set_scheduler (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < SCHEDULER_CNT; i++)
+    if (!strcmp (name, schedulers[i].name))
+      {
+        scheduler = &schedulers[i];
+        return true;
+      }
+  return false;
+}
+
+/* Routes BLOCK's reads and writes through a request queue
+   drained by a worker thread of BLOCK's own, so that concurrent
+   requests are dispatched in scheduler order and adjacent ones
+   are merged.  Meant for drivers that talk to a real device;
+   devices that forward to another block device, like
+   partitions, should not call it. */
+void
+block_start_queue (struct block *block)
+{
+  char name[sizeof block->name + 3];
+
+  ASSERT (!block->queued);
+
+  block->bounce = malloc (MERGE_MAX_SECTORS * BLOCK_SECTOR_SIZE);
+  if (block->bounce == NULL)
+    PANIC ("%s: failed to allocate I/O queue buffer", block->name);
+  snprintf (name, sizeof name, "%s-io", block->name);
+  if (thread_create (name, PRI_DEFAULT, queue_worker, block) == TID_ERROR)
+    PANIC ("%s: failed to start I/O queue worker", block->name);
+  block->queued = true;
+}
+
+/* noop: first come, first served. */
+static struct block_request *
+noop_next (struct block *block)
+{
+  return list_entry (list_front (&block->queue), struct block_request, elem);
+}
+
+/* C-LOOK: serves requests in ascending sector order from the
+   current head position, then jumps back to the lowest pending
+   sector.  Of requests for the same sector the oldest wins. */
+static struct block_request *
+clook_next (struct block *block)
+{
+  struct block_request *ahead = NULL, *lowest = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->sector >= block->head
+          && (ahead == NULL || r->sector < ahead->sector))
+        ahead = r;
+      if (lowest == NULL || r->sector < lowest->sector)
+        lowest = r;
+    }
+  return ahead != NULL ? ahead : lowest;
+}
+
+/* deadline: C-LOOK, except that the request with the earliest
+   expired deadline, if any, is served first so that a busy
+   region of the disk cannot starve requests elsewhere. */
+static struct block_request *
+deadline_next (struct block *block)
+{
+  struct block_request *expired = NULL;
+  int64_t now = timer_ticks ();
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->deadline <= now
+          && (expired == NULL || r->deadline < expired->deadline))
+        expired = r;
+    }
+  return expired != NULL ? expired : clook_next (block);
+}
+
+/* Moves the request chosen by the scheduler from BLOCK's queue
+   into BATCH, followed by every queued request in the same
+   direction that extends it into a longer run of consecutive
+   sectors, up to MERGE_MAX_SECTORS.  BATCH ends up in ascending
+   sector order.  Returns the sector just past the batch. */
+static block_sector_t
+collect_batch (struct block *block, struct list *batch)
+{
+  struct block_request *first = scheduler->next (block);
+  block_sector_t start = first->sector;
+  block_sector_t end = first->sector + first->cnt;
+  bool merged;
+
+  list_remove (&first->elem);
+  list_push_back (batch, &first->elem);
+  do
+    {
+      struct list_elem *e;
+
+      merged = false;
+      for (e = list_begin (&block->queue); e != list_end (&block->queue);
+           e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request, elem);
+          if (r->write != first->write
+              || end - start + r->cnt > MERGE_MAX_SECTORS)
+            continue;
+          if (r->sector == end)
+            {
+              list_remove (&r->elem);
+              list_push_back (batch, &r->elem);
+              end += r->cnt;
+              merged = true;
+              break;
+            }
+          if (r->sector + r->cnt == start)
+            {
+              list_remove (&r->elem);
+              list_push_front (batch, &r->elem);
+              start = r->sector;
+              merged = true;
+              break;
+            }
+        }
+    }
+  while (merged);
+
+  return end;
+}
+
+/* Carries out the requests in BATCH, which cover a run of
+   consecutive sectors in ascending order, as one transfer and
+   completes them.  The requests' buffers are
+   gathered into or scattered from BLOCK's bounce buffer when
+   there is more than one. */
+static void
+dispatch (struct block *block, struct list *batch)
+{
+  struct block_request *first, *last;
+  struct list_elem *e;
+
+  first = list_entry (list_front (batch), struct block_request, elem);
+  last = list_entry (list_back (batch), struct block_request, elem);
+  if (first == last)
+    transfer (block, first->write, first->sector, first->cnt, first->buffer);
+  else
+    {
+      block_sector_t cnt = last->sector + last->cnt - first->sector;
+
+      ASSERT (cnt <= MERGE_MAX_SECTORS);
+      if (first->write)
+        for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+          {
+            struct block_request *r = list_entry (e, struct block_request,
+                                                  elem);
+            memcpy (block->bounce
+                    + (r->sector - first->sector) * BLOCK_SECTOR_SIZE,
+                    r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+          }
+      transfer (block, first->write, first->sector, cnt, block->bounce);
+      if (!first->write)
+        for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+          {
+            struct block_request *r = list_entry (e, struct block_request,
+                                                  elem);
+            memcpy (r->buffer,
+                    block->bounce
+                    + (r->sector - first->sector) * BLOCK_SECTOR_SIZE,
+                    r->cnt * BLOCK_SECTOR_SIZE);
+          }
+    }
+
+  /* A request may vanish as soon as it is completed. */
+  while (!list_empty (batch))
+    block_complete (block, list_entry (list_pop_front (batch),
+                                       struct block_request, elem));
+}
+
+/* Worker thread for BLOCK_, which must be a struct block whose
+   queue has been started.  Repeatedly takes the next batch of
+   requests off the queue and dispatches it. */
+static void
+queue_worker (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    {
+      struct list batch;
+
+      list_init (&batch);
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_nonempty, &block->queue_lock);
+      block->head = collect_batch (block, &batch);
+      lock_release (&block->queue_lock);
+
+      dispatch (block, &batch);
+    }
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
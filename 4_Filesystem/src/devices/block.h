@@ -1,8 +1,12 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <blockstat.h>
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,11 +57,54 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t, block_sector_t cnt,
+                       void *);
+void block_write_multi (struct block *, block_sector_t, block_sector_t cnt,
+                        const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests. */
+
+struct block_request;
+
+/* Completion callback.  Runs in the I/O worker thread of the
+   device that carried out REQUEST, so it must not wait for other
+   requests on that device. */
+typedef void block_callback_func (struct block_request *request, void *aux);
+
+/* A transfer of consecutive sectors, set up with
+   block_request_init() and started with block_submit(). */
+struct block_request
+  {
+    bool write;                         /* Write if true, read if false. */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_callback_func *callback;      /* Called on completion, or null. */
+    void *aux;                          /* Passed to CALLBACK. */
+
+    /* Owned by the block layer. */
+    struct list_elem elem;              /* Element in a device's queue. */
+    int64_t deadline;                   /* Tick by which to dispatch. */
+    struct semaphore done;              /* Up'd on completion. */
+    struct block *origin;               /* Device first submitted to. */
+    uint64_t start;                     /* TSC at first submission. */
+  };
+
+void block_request_init (struct block_request *, bool write,
+                         block_sector_t, block_sector_t cnt, void *buffer,
+                         block_callback_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
+unsigned long long block_io_cnt (struct block *);
+void block_get_stats (struct block *, struct blockstat *);
+
+/* I/O scheduling. */
+bool block_set_scheduler (const char *name);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,10 +112,36 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional: transfer CNT consecutive sectors at once.  May be
+       null, in which case read or write is called per sector. */
+    void (*read_multi) (void *aux, block_sector_t, block_sector_t cnt,
+                        void *buffer);
+    void (*write_multi) (void *aux, block_sector_t, block_sector_t cnt,
+                         const void *buffer);
+
+    /* Optional: start REQUEST without waiting for it, for drivers
+       that keep several requests in flight on their own.  The
+       driver calls block_complete() when REQUEST is over.  Such
+       drivers need not provide the operations above.  Without it,
+       block_submit() on a device with no request queue carries
+       out the request before returning. */
+    void (*submit) (void *aux, struct block_request *request);
+
+    /* Optional: for devices that are a range of another block
+       device, like partitions.  Translates *SECTOR into a sector
+       of the underlying device and returns that device, which
+       then takes every request submitted. */
+    struct block *(*remap) (void *aux, block_sector_t *sector);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_start_queue (struct block *);
+void block_interpose (struct block *, const struct block_operations *,
+                      void *aux, const struct block_operations **old_ops,
+                      void **old_aux);
+void block_complete (struct block *, struct block_request *);
 
 #endif /* devices/block.h */
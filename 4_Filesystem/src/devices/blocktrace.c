@@ -0,0 +1,154 @@
+#include "devices/blocktrace.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The code in this file keeps a trace of block device accesses in
+   a ring buffer and prints it at shutdown, for replay by
+   utils/pintos-cachesim against other cache policies and sizes.
+
+   Two kinds of accesses are recorded.  An "io" record is a
+   request submitted to a block device, logged by block_submit().
+   A "ref" record is a sector the buffer cache was asked for, hit
+   or miss, which is the stream a cache policy actually sees.
+   Each record also says which subsystem made the access, going by
+   the tag of the thread that made it.
+
+   Tracing is off unless blocktrace_init() is called.  When it is
+   on, recording an access costs a few stores with interrupts off.
+   Once the ring fills, new records overwrite the oldest. */
+
+/* A traced access. */
+struct record
+  {
+    uint32_t tick;              /* Timer tick. */
+    block_sector_t sector;      /* First sector. */
+    struct block *block;        /* Device, as first submitted to. */
+    uint16_t cnt;               /* Number of sectors. */
+    uint8_t flags;              /* REC_* bits. */
+    uint8_t source;             /* enum blocktrace_source. */
+  };
+
+#define REC_WRITE 0x01          /* Write, not read. */
+#define REC_REF 0x02            /* Cache reference, not device I/O. */
+
+static struct record *ring;     /* Ring buffer, or null if off. */
+static size_t ring_cnt;         /* Capacity of RING in records. */
+static size_t ring_pages;       /* Pages allocated for RING. */
+static uint64_t total;          /* Records ever added. */
+
+static const char *source_names[BLOCKTRACE_SOURCE_CNT] =
+  {"other", "cache", "evict", "flush", "readahead", "direct", "journal",
+   "swap"};
+
+/* Starts tracing into a ring of RECORD_CNT records.  Does
+   nothing if RECORD_CNT is 0. */
+void
+blocktrace_init (size_t record_cnt)
+{
+  if (record_cnt == 0)
+    return;
+
+  ring_pages = DIV_ROUND_UP (record_cnt * sizeof *ring, PGSIZE);
+  ring = palloc_get_multiple (0, ring_pages);
+  if (ring == NULL)
+    {
+      printf ("blocktrace: no memory for %zu records\n", record_cnt);
+      return;
+    }
+  ring_cnt = ring_pages * PGSIZE / sizeof *ring;
+  printf ("blocktrace: tracing up to %zu records\n", ring_cnt);
+}
+
+/* Tags the block accesses that the running thread makes from now
+   on with SOURCE.  Returns the previous tag, for the caller to
+   restore. */
+enum blocktrace_source
+blocktrace_set_source (enum blocktrace_source source)
+{
+  struct thread *t = thread_current ();
+  enum blocktrace_source old = t->io_source;
+
+  ASSERT (source < BLOCKTRACE_SOURCE_CNT);
+  t->io_source = source;
+  return old;
+}
+
+/* Adds a record to the ring. */
+static void
+add (struct block *block, block_sector_t sector, block_sector_t cnt,
+     uint8_t flags)
+{
+  enum intr_level old_level = intr_disable ();
+  struct record *r = &ring[total++ % ring_cnt];
+  enum blocktrace_source source = thread_current ()->io_source;
+
+  /* Untagged I/O to the swap device is VM's. */
+  if (source == BLOCKTRACE_OTHER && block == block_get_role (BLOCK_SWAP))
+    source = BLOCKTRACE_SWAP;
+
+  r->tick = timer_ticks ();
+  r->sector = sector;
+  r->block = block;
+  r->cnt = cnt < UINT16_MAX ? cnt : UINT16_MAX;
+  r->flags = flags;
+  r->source = source;
+  intr_set_level (old_level);
+}
+
+/* Records a request for CNT sectors starting at SECTOR submitted
+   to BLOCK. */
+void
+blocktrace_io (struct block *block, block_sector_t sector,
+               block_sector_t cnt, bool write)
+{
+  if (ring != NULL)
+    add (block, sector, cnt, write ? REC_WRITE : 0);
+}
+
+/* Records a buffer cache access to SECTOR of BLOCK. */
+void
+blocktrace_ref (struct block *block, block_sector_t sector, bool write)
+{
+  if (ring != NULL)
+    add (block, sector, 1, REC_REF | (write ? REC_WRITE : 0));
+}
+
+/* Prints the trace, oldest record first, one line per record:
+
+     bt TICK DEVICE SECTOR COUNT R|W io|ref SOURCE
+
+   preceded by a line with the number of records and the number
+   lost to overwriting. */
+void
+blocktrace_dump (void)
+{
+  struct record *records = ring;
+  uint64_t first, i;
+
+  if (records == NULL)
+    return;
+
+  /* Stop tracing, so that nothing overwrites records while they
+     are printed. */
+  ring = NULL;
+  barrier ();
+  first = total > ring_cnt ? total - ring_cnt : 0;
+  printf ("blocktrace: %"PRIu64" records, %"PRIu64" dropped\n",
+          total - first, first);
+  for (i = first; i < total; i++)
+    {
+      const struct record *r = &records[i % ring_cnt];
+      printf ("bt %"PRIu32" %s %"PRDSNu" %"PRIu16" %c %s %s\n",
+              r->tick, block_name (r->block), r->sector, r->cnt,
+              r->flags & REC_WRITE ? 'W' : 'R',
+              r->flags & REC_REF ? "ref" : "io", source_names[r->source]);
+    }
+  printf ("blocktrace: end\n");
+}
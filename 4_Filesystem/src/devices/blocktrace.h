@@ -0,0 +1,30 @@
+#ifndef DEVICES_BLOCKTRACE_H
+#define DEVICES_BLOCKTRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Subsystem on whose behalf a traced access is made.  Each thread
+   carries one, set with blocktrace_set_source(). */
+enum blocktrace_source
+  {
+    BLOCKTRACE_OTHER,           /* Not tagged: file system calls, etc. */
+    BLOCKTRACE_CACHE,           /* Buffer cache miss. */
+    BLOCKTRACE_EVICT,           /* Buffer cache victim write-back. */
+    BLOCKTRACE_FLUSH,           /* Buffer cache flush. */
+    BLOCKTRACE_READAHEAD,       /* Read-ahead thread. */
+    BLOCKTRACE_DIRECT,          /* Uncached (O_DIRECT) transfer. */
+    BLOCKTRACE_JOURNAL,         /* Journal. */
+    BLOCKTRACE_SWAP,            /* Virtual memory swap. */
+    BLOCKTRACE_SOURCE_CNT
+  };
+
+void blocktrace_init (size_t record_cnt);
+enum blocktrace_source blocktrace_set_source (enum blocktrace_source);
+void blocktrace_io (struct block *, block_sector_t, block_sector_t cnt,
+                    bool write);
+void blocktrace_ref (struct block *, block_sector_t, bool write);
+void blocktrace_dump (void);
+
+#endif /* devices/blocktrace.h */
@@ -0,0 +1,352 @@
+#include "devices/diskmodel.h"
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+
+/* The code in this file slows a block device down to the speed
+   of a real disk.  Emulated disks answer every request in about
+   the same short time, wherever it lands, so they reward neither
+   good caching nor good scheduling the way a real disk does.  A
+   disk model sits between the block layer and a device's driver
+   and, before passing each transfer on, waits for as long as the
+   modeled disk would take:
+
+     - A fixed per-request overhead (controller, command setup).
+
+     - For a request that does not start where the previous one
+       ended, a seek, whose time grows with the square root of
+       the distance from a tenth of the full-stroke time up to the
+       full-stroke time, and then the rotational delay until the
+       first sector passes under the head.
+
+     - The transfer itself at the media rate.
+
+   Waits are measured against a clock of the model's own that
+   keeps microseconds, so delays shorter than a timer tick add up
+   instead of getting lost, but sleeping is done in whole timer
+   ticks with timer_sleep().  One model serves one request at a
+   time, like a disk with one actuator. */
+
+/* Most devices that may be modeled. */
+#define MAX_MODELS 4
+
+/* Sectors per track, for placing sectors in the rotation. */
+#define TRACK_SECTORS 1000
+
+/* Microseconds per timer tick. */
+#define TICK_US (1000000 / TIMER_FREQ)
+
+/* Parameters of a modeled disk.  0 means "no such delay". */
+struct disk_params
+  {
+    unsigned overhead_us;       /* Per-request overhead. */
+    unsigned seek_us;           /* Full-stroke seek time. */
+    unsigned rpm;               /* Rotational speed. */
+    unsigned bw_kb;             /* Media rate in kB/s. */
+  };
+
+/* Named parameter sets. */
+struct preset
+  {
+    const char *name;
+    struct disk_params params;
+  };
+
+static const struct preset presets[] =
+  {
+    /* 7200 rpm desktop disk. */
+    {"hdd", {100, 16000, 7200, 120000}},
+
+    /* 5400 rpm laptop disk. */
+    {"laptop", {200, 24000, 5400, 60000}},
+
+    /* SATA flash disk: no moving parts, some latency per command. */
+    {"ssd", {60, 0, 0, 400000}},
+  };
+#define PRESET_CNT (sizeof presets / sizeof *presets)
+
+/* A modeled device. */
+struct diskmodel
+  {
+    const char *name;                   /* Device name. */
+    struct disk_params params;          /* Parameters. */
+
+    struct block *block;                /* Modeled device. */
+    const struct block_operations *ops; /* Its driver's operations. */
+    void *aux;                          /* Its driver's AUX. */
+
+    struct lock lock;                   /* Serializes requests. */
+    int64_t clock_us;                   /* When the disk is free next. */
+    block_sector_t head;                /* Sector after the last request. */
+  };
+
+static struct diskmodel models[MAX_MODELS];
+static size_t model_cnt;
+
+static struct block_operations model_operations;
+
+static bool parse_param (struct disk_params *, char *param);
+
+/* Adds the disk model in SPEC, which has the form DEV:PARAMS.
+   PARAMS is a comma-separated list of a preset name and of
+   KEY=VALUE settings that override it:
+
+     lat=US     per-request overhead in microseconds
+     seek=US    full-stroke seek time in microseconds
+     rpm=N      rotational speed
+     bw=KB      media rate in kB/s
+
+   The model takes effect when diskmodel_init() is called.
+   Panics if SPEC is malformed. */
+void
+diskmodel_configure (char *spec)
+{
+  struct diskmodel *m;
+  char *params, *param, *save_ptr;
+
+  if (model_cnt >= MAX_MODELS)
+    PANIC ("more than %d disk models", MAX_MODELS);
+  m = &models[model_cnt++];
+
+  m->name = strtok_r (spec, ":", &save_ptr);
+  params = strtok_r (NULL, "", &save_ptr);
+  if (m->name == NULL || params == NULL)
+    PANIC ("disk model must have the form DEV:PARAMS");
+  for (param = strtok_r (params, ",", &save_ptr); param != NULL;
+       param = strtok_r (NULL, ",", &save_ptr))
+    if (!parse_param (&m->params, param))
+      PANIC ("%s: bad disk model parameter `%s'", m->name, param);
+}
+
+/* Applies PARAM, a preset name or KEY=VALUE, to P.  Returns true
+   if successful, false if PARAM is not understood. */
+static bool
+parse_param (struct disk_params *p, char *param)
+{
+  char *key, *value, *save_ptr;
+  size_t i;
+
+  for (i = 0; i < PRESET_CNT; i++)
+    if (!strcmp (param, presets[i].name))
+      {
+        *p = presets[i].params;
+        return true;
+      }
+
+  key = strtok_r (param, "=", &save_ptr);
+  value = strtok_r (NULL, "", &save_ptr);
+  if (value == NULL)
+    return false;
+  if (!strcmp (key, "lat"))
+    p->overhead_us = atoi (value);
+  else if (!strcmp (key, "seek"))
+    p->seek_us = atoi (value);
+  else if (!strcmp (key, "rpm"))
+    p->rpm = atoi (value);
+  else if (!strcmp (key, "bw"))
+    p->bw_kb = atoi (value);
+  else
+    return false;
+  return true;
+}
+
+/* Puts each configured disk model in front of its device.  Must
+   be called after the devices are registered and before they
+   are used. */
+void
+diskmodel_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < model_cnt; i++)
+    {
+      struct diskmodel *m = &models[i];
+      const struct disk_params *p = &m->params;
+
+      m->block = block_get_by_name (m->name);
+      if (m->block == NULL)
+        PANIC ("No such block device \"%s\"", m->name);
+
+      /* Partitions only translate sectors; model their disk. */
+      if (block_type (m->block) != BLOCK_RAW)
+        PANIC ("%s: disk models apply to whole disks, not partitions",
+               m->name);
+
+      lock_init (&m->lock);
+      m->clock_us = 0;
+      m->head = 0;
+      block_interpose (m->block, &model_operations, m, &m->ops, &m->aux);
+
+      printf ("%s: modeled with %u us overhead, %u us seek, %u rpm, "
+              "%u kB/s\n", m->name, p->overhead_us, p->seek_us, p->rpm,
+              p->bw_kb);
+    }
+}
+
+/* Returns the integer square root of X, rounded down. */
+static uint32_t
+isqrt (uint64_t x)
+{
+  uint64_t r = x, y;
+
+  if (x < 2)
+    return x;
+  for (;;)
+    {
+      y = (r + x / r) / 2;
+      if (y >= r)
+        return r;
+      r = y;
+    }
+}
+
+/* Returns how long, in microseconds, M takes to transfer CNT
+   sectors starting at SECTOR if it starts at time NOW_US, and
+   moves M's head past them. */
+static int64_t
+service_time (struct diskmodel *m, block_sector_t sector,
+              block_sector_t cnt, int64_t now_us)
+{
+  const struct disk_params *p = &m->params;
+  int64_t t = p->overhead_us;
+
+  if (sector != m->head)
+    {
+      if (p->seek_us > 0)
+        {
+          uint64_t distance = sector > m->head ? sector - m->head
+                                               : m->head - sector;
+          uint32_t fraction;
+
+          /* FRACTION is sqrt (distance / size) scaled by 1024. */
+          fraction = isqrt ((distance << 20) / block_size (m->block));
+          t += (p->seek_us / 10
+                + (int64_t) p->seek_us * 9 / 10 * fraction / 1024);
+        }
+      if (p->rpm > 0)
+        {
+          int64_t rev_us = 60 * 1000000 / p->rpm;
+          int64_t here = (now_us + t) % rev_us;
+          int64_t there = sector % TRACK_SECTORS * rev_us / TRACK_SECTORS;
+          t += (there - here + rev_us) % rev_us;
+        }
+    }
+  if (p->bw_kb > 0)
+    t += (int64_t) cnt * BLOCK_SECTOR_SIZE * 1000000 / (p->bw_kb * 1024LL);
+
+  m->head = sector + cnt;
+  return t;
+}
+
+/* Waits for M to carry out a transfer of CNT sectors starting at
+   SECTOR.  M's lock must be held. */
+static void
+delay (struct diskmodel *m, block_sector_t sector, block_sector_t cnt)
+{
+  int64_t now_us = timer_ticks () * TICK_US;
+  int64_t wake;
+
+  ASSERT (lock_held_by_current_thread (&m->lock));
+
+  if (m->clock_us < now_us)
+    m->clock_us = now_us;
+  m->clock_us += service_time (m, sector, cnt, m->clock_us);
+
+  wake = m->clock_us / TICK_US;
+  if (wake > timer_ticks ())
+    timer_sleep (wake - timer_ticks ());
+}
+
+/* Reads CNT sectors starting at SECTOR into BUFFER through model
+   M_. */
+static void
+model_read_multi (void *m_, block_sector_t sector, block_sector_t cnt,
+                  void *buffer)
+{
+  struct diskmodel *m = m_;
+  block_sector_t i;
+
+  lock_acquire (&m->lock);
+  delay (m, sector, cnt);
+  if (m->ops->read_multi != NULL)
+    m->ops->read_multi (m->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      m->ops->read (m->aux, sector + i,
+                    (uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
+  lock_release (&m->lock);
+}
+
+/* Writes CNT sectors starting at SECTOR from BUFFER through model
+   M_. */
+static void
+model_write_multi (void *m_, block_sector_t sector, block_sector_t cnt,
+                   const void *buffer)
+{
+  struct diskmodel *m = m_;
+  block_sector_t i;
+
+  lock_acquire (&m->lock);
+  delay (m, sector, cnt);
+  if (m->ops->write_multi != NULL)
+    m->ops->write_multi (m->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      m->ops->write (m->aux, sector + i,
+                     (const uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
+  lock_release (&m->lock);
+}
+
+static void
+model_read (void *m, block_sector_t sector, void *buffer)
+{
+  model_read_multi (m, sector, 1, buffer);
+}
+
+static void
+model_write (void *m, block_sector_t sector, const void *buffer)
+{
+  model_write_multi (m, sector, 1, buffer);
+}
+
+/* Carries out request R after model M_'s delay.  A driver with
+   a submit operation gets R after the delay and then takes as
+   long as it takes on top of it; otherwise R is complete when
+   this returns. */
+static void
+model_submit (void *m_, struct block_request *r)
+{
+  struct diskmodel *m = m_;
+
+  if (m->ops->submit != NULL)
+    {
+      lock_acquire (&m->lock);
+      delay (m, r->sector, r->cnt);
+      lock_release (&m->lock);
+      m->ops->submit (m->aux, r);
+    }
+  else
+    {
+      if (r->write)
+        model_write_multi (m, r->sector, r->cnt, r->buffer);
+      else
+        model_read_multi (m, r->sector, r->cnt, r->buffer);
+      block_complete (m->block, r);
+    }
+}
+
+/* Devices with a request queue go through the read and write
+   operations; the block layer hands the rest to model_submit(). */
+static struct block_operations model_operations =
+  {
+    model_read,
+    model_write,
+    model_read_multi,
+    model_write_multi,
+    model_submit,
+    NULL
+  };
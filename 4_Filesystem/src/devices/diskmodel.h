@@ -0,0 +1,7 @@
+#ifndef DEVICES_DISKMODEL_H
+#define DEVICES_DISKMODEL_H
+
+void diskmodel_configure (char *spec);
+void diskmodel_init (void);
+
+#endif /* devices/diskmodel.h */
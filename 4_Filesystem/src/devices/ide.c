@@ -6,9 +6,12 @@
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
+#include "devices/pci.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -34,6 +37,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +53,46 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Bus master IDE registers, as offsets from a channel's
+   bm_base.  The controller is a PCI function whose BAR 4 holds
+   the registers of the primary channel, followed 8 ports later
+   by those of the secondary channel. */
+#define BM_COMMAND 0            /* Command. */
+#define BM_STATUS 2             /* Status. */
+#define BM_PRDT 4               /* PRD table physical address. */
+
+/* Bus master Command register bits. */
+#define BMC_START 0x01          /* Start transfer. */
+#define BMC_READ 0x08           /* Transfer from disk to memory. */
+
+/* Bus master Status register bits. */
+#define BMS_ERROR 0x02          /* Transfer failed (write 1 to clear). */
+#define BMS_INTR 0x04           /* Disk interrupted (write 1 to clear). */
+#define BMS_SIMPLEX 0x80        /* Only one channel may use DMA at once. */
+
+/* A physical region descriptor, one physically contiguous piece
+   of the memory a DMA transfer reads or writes. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address, word aligned. */
+    uint16_t size;              /* Byte count, 0 for 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last region. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* Most sectors one command may transfer.  The Sector Count
+   register holds 0 for 256. */
+#define MAX_SECTOR_CNT 256
+
+/* Most sectors per interrupt we ask for in multiple mode. */
+#define MAX_MULTIPLE 16
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +101,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ/WRITE
+                                   MULTIPLE, or 1 if not supported. */
+    bool dma;                   /* Transfer data with DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +119,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master registers, 0 if no DMA. */
+    struct prd *prdt;           /* PRD table, one page. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -85,7 +135,10 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, int max);
+
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -95,6 +148,18 @@ static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
+static void ide_read_multi (void *, block_sector_t, block_sector_t, void *);
+static void ide_write_multi (void *, block_sector_t, block_sector_t,
+                             const void *);
+static void pio_read (struct ata_disk *, block_sector_t, block_sector_t,
+                      uint8_t *);
+static void pio_write (struct ata_disk *, block_sector_t, block_sector_t,
+                       const uint8_t *);
+static bool dma_transfer (struct ata_disk *, bool write, block_sector_t,
+                          block_sector_t, void *);
+static bool build_prdt (struct channel *, const void *, size_t);
+static uint16_t find_bus_master (void);
+
 static void interrupt_handler (struct intr_frame *);
 
 /* Initialize the disk subsystem and detect disks. */
@@ -102,6 +167,7 @@ void
 ide_init (void) 
 {
   size_t chan_no;
+  uint16_t bm_base = find_bus_master ();
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
@@ -126,6 +192,18 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+
+      /* Set up bus-master DMA.  On a simplex controller only the
+         primary channel gets it. */
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0
+          && (chan_no == 0 || !(inb (bm_base + BM_STATUS) & BMS_SIMPLEX)))
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +214,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 1;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -155,6 +235,31 @@ ide_init (void)
     }
 }
 
+/* Looks for a PCI IDE controller that can act as bus master
+   for the legacy channels, such as the PIIX controllers QEMU and
+   Bochs emulate, and enables bus mastering on it.  Returns the
+   I/O port base of its bus master registers, or 0 if there is no
+   such controller. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_device *dev = pci_find_class (0x01, 0x01);
+  uint32_t bar;
+
+  if (dev == NULL)
+    return 0;
+
+  /* Bit 7 of the programming interface means bus master
+     capable.  Bits 0 and 2 mean a channel is in PCI native
+     mode, with ports other than those we drive. */
+  bar = pci_io_bar (dev, 4);
+  if (!(dev->prog_if & 0x80) || (dev->prog_if & 0x05) || bar == 0)
+    return 0;
+
+  pci_enable (dev, PCI_CMD_IO | PCI_CMD_MASTER);
+  return bar & 0xfffc;
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -303,12 +408,45 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Use READ/WRITE MULTIPLE if the disk supports it.  The low
+     byte of word 47 is the most sectors it can transfer per
+     interrupt, 0 if it has no multiple mode. */
+  set_multiple_mode (d, (uint8_t) id[47 * 2]);
+
+  /* Bit 8 of word 49 says the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  block_start_queue (block);
   partition_scan (block);
 }
 
+/* Enables multiple mode on disk D with as many sectors per
+   interrupt as possible, up to MAX and MAX_MULTIPLE.  Leaves
+   D->multiple at 1 if MAX is 0 or the disk rejects the command. */
+static void
+set_multiple_mode (struct ata_disk *d, int max)
+{
+  struct channel *c = d->channel;
+  int cnt;
+
+  /* The count must be a power of 2. */
+  for (cnt = MAX_MULTIPLE; cnt > max; cnt /= 2)
+    continue;
+  if (cnt < 2)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (!(inb (reg_status (c)) & STA_ERR))
+    d->multiple = cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -344,16 +482,7 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_read_multi (d_, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -363,37 +492,216 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    per-disk locking is unneeded. */
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multi (d_, sec_no, 1, buffer);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Uses DMA if possible and PIO otherwise, with up to
+   MAX_SECTOR_CNT sectors per command.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multi (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *p = buffer;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      block_sector_t n = cnt < MAX_SECTOR_CNT ? cnt : MAX_SECTOR_CNT;
+
+      if (!dma_transfer (d, false, sec_no, n, p))
+        pio_read (d, sec_no, n, p);
+      p += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving all of the
+   data.  Uses DMA if possible and PIO otherwise, with up to
+   MAX_SECTOR_CNT sectors per command.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multi (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                 const void *buffer)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  const uint8_t *p = buffer;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      block_sector_t n = cnt < MAX_SECTOR_CNT ? cnt : MAX_SECTOR_CNT;
+
+      if (!dma_transfer (d, true, sec_no, n, (void *) p))
+        pio_write (d, sec_no, n, p);
+      p += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
+  lock_release (&c->lock);
+}
+
+/* Reads CNT sectors, at most MAX_SECTOR_CNT, starting at SEC_NO
+   from disk D into BUFFER with programmed I/O.  With multiple
+   mode the disk interrupts once per D->multiple sectors instead
+   of once per sector.  D's channel must be locked. */
+static void
+pio_read (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+          uint8_t *buffer)
+{
+  struct channel *c = d->channel;
+  block_sector_t per_intr = cnt > 1 ? d->multiple : 1;
+  block_sector_t done, i;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, per_intr > 1 ? CMD_READ_MULTIPLE
+                                     : CMD_READ_SECTOR_RETRY);
+  for (done = 0; done < cnt; done += i)
+    {
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu,
+               d->name, sec_no + done);
+      for (i = 0; i < per_intr && done + i < cnt; i++)
+        input_sector (c, buffer + (done + i) * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Writes CNT sectors, at most MAX_SECTOR_CNT, starting at SEC_NO
+   to disk D from BUFFER with programmed I/O, as pio_read() reads
+   them.  D's channel must be locked. */
+static void
+pio_write (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+           const uint8_t *buffer)
+{
+  struct channel *c = d->channel;
+  block_sector_t per_intr = cnt > 1 ? d->multiple : 1;
+  block_sector_t done, i;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, per_intr > 1 ? CMD_WRITE_MULTIPLE
+                                     : CMD_WRITE_SECTOR_RETRY);
+  for (done = 0; done < cnt; done += i)
+    {
+      /* The disk interrupts after taking each block of data but
+         the last, asking for the next one. */
+      if (done > 0)
+        sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, sec_no + done);
+      for (i = 0; i < per_intr && done + i < cnt; i++)
+        output_sector (c, buffer + (done + i) * BLOCK_SECTOR_SIZE);
+    }
+  sema_down (&c->completion_wait);
+}
+
+/* Transfers CNT sectors, at most MAX_SECTOR_CNT, starting at
+   SEC_NO between disk D and BUFFER with bus-master DMA, while
+   the CPU runs other threads.  Returns false without touching
+   the disk if D or BUFFER cannot be used for DMA, in which case
+   the caller should fall back to PIO.  D's channel must be
+   locked. */
+static bool
+dma_transfer (struct ata_disk *d, bool write, block_sector_t sec_no,
+              block_sector_t cnt, void *buffer)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BMC_READ;
+  uint8_t status;
+
+  if (!d->dma || !build_prdt (c, buffer, cnt * BLOCK_SECTOR_SIZE))
+    return false;
+
+  outl (c->bm_base + BM_PRDT, vtop (c->prdt));
+  outb (c->bm_base + BM_COMMAND, direction);
+  outb (c->bm_base + BM_STATUS,
+        inb (c->bm_base + BM_STATUS) | BMS_ERROR | BMS_INTR);
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (c->bm_base + BM_COMMAND, direction | BMC_START);
+  sema_down (&c->completion_wait);
+  outb (c->bm_base + BM_COMMAND, direction);
+
+  /* Writing the error and interrupt bits back clears them. */
+  status = inb (c->bm_base + BM_STATUS);
+  outb (c->bm_base + BM_STATUS, status);
+  if ((status & BMS_ERROR) || (inb (reg_alt_status (c)) & STA_ERR))
+    PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+  return true;
+}
+
+/* Fills in channel C's PRD table to describe the SIZE bytes at
+   BUFFER.  Kernel virtual memory maps physical memory linearly,
+   so BUFFER is contiguous in physical memory too and only needs
+   to be split at 64 kB boundaries, which a region may not
+   cross.  Returns false if BUFFER is not a word-aligned kernel
+   address or needs too many regions. */
+static bool
+build_prdt (struct channel *c, const void *buffer, size_t size)
+{
+  uintptr_t phys;
+  size_t i;
+
+  if (!is_kernel_vaddr (buffer) || (uintptr_t) buffer % 2 != 0)
+    return false;
+
+  phys = vtop (buffer);
+  for (i = 0; size > 0; i++)
+    {
+      size_t chunk = 0x10000 - (phys & 0xffff);
+      if (chunk > size)
+        chunk = size;
+      if (i >= PRD_CNT)
+        return false;
+
+      c->prdt[i].addr = phys;
+      c->prdt[i].size = chunk & 0xffff;
+      c->prdt[i].flags = 0;
+      phys += chunk;
+      size -= chunk;
+    }
+  c->prdt[i - 1].flags = PRD_EOT;
+  return true;
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi,
+    NULL,
+    NULL
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_SECTOR_CNT);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTOR_CNT ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
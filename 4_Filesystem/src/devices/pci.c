@@ -0,0 +1,185 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+
+/* The code in this file accesses PCI configuration space with
+   configuration mechanism #1, which every PC chipset of the
+   last decades supports, including those QEMU and Bochs
+   emulate. */
+
+/* Configuration mechanism #1 ports. */
+#define CONFIG_ADDRESS 0xcf8    /* Selects a register (w/o). */
+#define CONFIG_DATA 0xcfc       /* Reads or writes it. */
+
+/* Bit in the header type byte set by multifunction devices. */
+#define HEADER_MULTIFUNCTION 0x80
+
+/* Every PCI function found, in bus, device, function order. */
+static struct list devices = LIST_INITIALIZER (devices);
+
+static void add_device (struct pci_address);
+
+/* Enumerates the functions on every PCI bus and prints one line
+   for each. */
+void
+pci_init (void)
+{
+  struct pci_address a;
+  int bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          a.bus = bus;
+          a.dev = dev;
+          a.func = func;
+          if ((pci_read_config (a, PCI_REG_ID) & 0xffff) == 0xffff)
+            {
+              /* No function 0 means no device at all. */
+              if (func == 0)
+                break;
+              continue;
+            }
+          add_device (a);
+
+          /* Only multifunction devices have functions 1...7. */
+          if (func == 0
+              && !((pci_read_config (a, PCI_REG_HEADER) >> 16)
+                   & HEADER_MULTIFUNCTION))
+            break;
+        }
+}
+
+/* Records the function at ADDR in the list of devices. */
+static void
+add_device (struct pci_address addr)
+{
+  struct pci_device *d = malloc (sizeof *d);
+  uint32_t id, class_reg;
+
+  if (d == NULL)
+    PANIC ("Failed to allocate memory for PCI device");
+
+  id = pci_read_config (addr, PCI_REG_ID);
+  class_reg = pci_read_config (addr, PCI_REG_CLASS);
+  d->addr = addr;
+  d->vendor = id & 0xffff;
+  d->device = id >> 16;
+  d->class = class_reg >> 24;
+  d->subclass = class_reg >> 16;
+  d->prog_if = class_reg >> 8;
+  d->irq = pci_read_config (addr, PCI_REG_INTR) & 0xff;
+  if (d->irq == 0 || d->irq >= 16)
+    d->irq = 0xff;
+  list_push_back (&devices, &d->elem);
+
+  printf ("pci %02x:%02x.%x: %04x:%04x, class %02x.%02x.%02x",
+          addr.bus, addr.dev, addr.func, d->vendor, d->device,
+          d->class, d->subclass, d->prog_if);
+  if (d->irq != 0xff)
+    printf (", irq %d", d->irq);
+  printf ("\n");
+}
+
+/* Returns the first function with the given CLASS and SUBCLASS
+   codes, or a null pointer if there is none. */
+struct pci_device *
+pci_find_class (uint8_t class, uint8_t subclass)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&devices); e != list_end (&devices);
+       e = list_next (e))
+    {
+      struct pci_device *d = list_entry (e, struct pci_device, elem);
+      if (d->class == class && d->subclass == subclass)
+        return d;
+    }
+  return NULL;
+}
+
+/* Returns the first function after PREV, or the first function
+   at all if PREV is null, with the given VENDOR and DEVICE IDs.
+   Returns a null pointer if there is none. */
+struct pci_device *
+pci_find_device (uint16_t vendor, uint16_t device, struct pci_device *prev)
+{
+  struct list_elem *e;
+
+  e = prev != NULL ? list_next (&prev->elem) : list_begin (&devices);
+  for (; e != list_end (&devices); e = list_next (e))
+    {
+      struct pci_device *d = list_entry (e, struct pci_device, elem);
+      if (d->vendor == vendor && d->device == device)
+        return d;
+    }
+  return NULL;
+}
+
+/* Selects register REG of the function at ADDR for the next
+   access to CONFIG_DATA. */
+static void
+select_register (struct pci_address addr, uint8_t reg)
+{
+  ASSERT (addr.dev < 32 && addr.func < 8);
+  ASSERT (reg % 4 == 0);
+
+  outl (CONFIG_ADDRESS, (0x80000000u | ((uint32_t) addr.bus << 16)
+                         | ((uint32_t) addr.dev << 11)
+                         | ((uint32_t) addr.func << 8) | reg));
+}
+
+/* Returns the 32-bit configuration register REG, which must be a
+   multiple of 4, of the function at ADDR.  Returns 0xffffffff
+   if there is no such function. */
+uint32_t
+pci_read_config (struct pci_address addr, uint8_t reg)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t value;
+
+  select_register (addr, reg);
+  value = inl (CONFIG_DATA);
+  intr_set_level (old_level);
+  return value;
+}
+
+/* Sets the 32-bit configuration register REG, which must be a
+   multiple of 4, of the function at ADDR to VALUE. */
+void
+pci_write_config (struct pci_address addr, uint8_t reg, uint32_t value)
+{
+  enum intr_level old_level = intr_disable ();
+
+  select_register (addr, reg);
+  outl (CONFIG_DATA, value);
+  intr_set_level (old_level);
+}
+
+/* Returns the I/O port base that base address register BAR
+   (0...5) of D maps, or 0 if it maps memory or nothing. */
+uint32_t
+pci_io_bar (struct pci_device *d, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+
+  value = pci_read_config (d->addr, PCI_REG_BAR0 + bar * 4);
+  return value & PCI_BAR_IO ? value & ~3u : 0;
+}
+
+/* Sets CMD_BITS, such as PCI_CMD_IO and PCI_CMD_MASTER, in D's
+   command register. */
+void
+pci_enable (struct pci_device *d, uint16_t cmd_bits)
+{
+  /* The upper half is the status register, whose bits are
+     cleared by writing 1s, so it is written as 0. */
+  uint32_t cmd = pci_read_config (d->addr, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (d->addr, PCI_REG_COMMAND, cmd | cmd_bits);
+}
@@ -0,0 +1,55 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function in configuration space. */
+struct pci_address
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* A PCI function found by pci_init(). */
+struct pci_device
+  {
+    struct list_elem elem;      /* Element in the list of devices. */
+    struct pci_address addr;    /* Location in configuration space. */
+    uint16_t vendor;            /* Vendor ID. */
+    uint16_t device;            /* Device ID. */
+    uint8_t class;              /* Class code. */
+    uint8_t subclass;           /* Subclass code. */
+    uint8_t prog_if;            /* Programming interface. */
+    uint8_t irq;                /* Legacy interrupt line, 0xff if none. */
+  };
+
+/* Standard configuration space registers. */
+#define PCI_REG_ID 0x00         /* Vendor ID (low), device ID (high). */
+#define PCI_REG_COMMAND 0x04    /* Command (low), status (high). */
+#define PCI_REG_CLASS 0x08      /* Revision, prog IF, subclass, class. */
+#define PCI_REG_HEADER 0x0c     /* Header type in bits 16...23. */
+#define PCI_REG_BAR0 0x10       /* First of six base address registers. */
+#define PCI_REG_INTR 0x3c       /* Interrupt line in bits 0...7. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MEMORY 0x0002   /* Respond to memory space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* May act as bus master. */
+
+/* Base address register bits. */
+#define PCI_BAR_IO 0x1          /* BAR maps I/O ports, not memory. */
+
+void pci_init (void);
+struct pci_device *pci_find_class (uint8_t class, uint8_t subclass);
+struct pci_device *pci_find_device (uint16_t vendor, uint16_t device,
+                                    struct pci_device *prev);
+
+uint32_t pci_read_config (struct pci_address, uint8_t reg);
+void pci_write_config (struct pci_address, uint8_t reg, uint32_t value);
+uint32_t pci_io_bar (struct pci_device *, int bar);
+void pci_enable (struct pci_device *, uint16_t cmd_bits);
+
+#endif /* devices/pci.h */
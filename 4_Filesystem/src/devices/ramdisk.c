@@ -0,0 +1,199 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a block device, "ram0", that keeps
+   its sectors in pages of kernel memory.  It is as fast as
+   memcpy() and loses its contents at power off, which makes it
+   a good home for benchmarks, temporary files and swap.  Like
+   any other block device it can be chosen for a role with
+   -filesys, -scratch or -swap. */
+
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The RAM disk's memory.  The pages need not be contiguous. */
+struct ramdisk
+  {
+    void **pages;               /* Pages, SECTORS_PER_PAGE sectors each. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static struct ramdisk ramdisk;
+
+static struct block_operations ramdisk_operations;
+
+static struct block *find_scratch (void);
+static void load (struct block *scratch, block_sector_t sector_cnt);
+
+/* Creates the RAM disk with SIZE_KB kB of memory, rounded down to
+   whole sectors.  If LOAD_SCRATCH is true, the RAM disk starts out as a
+   copy of the scratch disk, as much of it as fits; a SIZE_KB of 0
+   then makes it as large as the scratch disk.  Does nothing if
+   the size comes out as 0. */
+void
+ramdisk_init (size_t size_kb, bool load_scratch)
+{
+  struct block *scratch = NULL;
+  block_sector_t sector_cnt;
+  char extra_info[64];
+  size_t i;
+
+  if (load_scratch)
+    {
+      scratch = find_scratch ();
+      if (scratch == NULL)
+        printf ("ram0: no scratch disk to load from\n");
+    }
+
+  if (size_kb == 0 && scratch != NULL)
+    sector_cnt = block_size (scratch);
+  else
+    sector_cnt = size_kb * (1024 / BLOCK_SECTOR_SIZE);
+  if (sector_cnt == 0)
+    return;
+
+  ramdisk.page_cnt = DIV_ROUND_UP (sector_cnt, SECTORS_PER_PAGE);
+  ramdisk.pages = malloc (ramdisk.page_cnt * sizeof *ramdisk.pages);
+  if (ramdisk.pages == NULL)
+    {
+      printf ("ram0: out of memory\n");
+      return;
+    }
+  for (i = 0; i < ramdisk.page_cnt; i++)
+    {
+      ramdisk.pages[i] = palloc_get_page (PAL_ZERO);
+      if (ramdisk.pages[i] == NULL)
+        {
+          printf ("ram0: out of memory after %zu of %zu pages\n",
+                  i, ramdisk.page_cnt);
+          while (i-- > 0)
+            palloc_free_page (ramdisk.pages[i]);
+          free (ramdisk.pages);
+          return;
+        }
+    }
+
+  if (scratch != NULL)
+    snprintf (extra_info, sizeof extra_info, "loaded from %s",
+              block_name (scratch));
+  block_register ("ram0", BLOCK_RAW,
+                  scratch != NULL ? extra_info : NULL, sector_cnt,
+                  &ramdisk_operations, &ramdisk);
+  if (scratch != NULL)
+    load (scratch, sector_cnt);
+}
+
+/* Returns the first block device of scratch type, or a null
+   pointer if there is none. */
+static struct block *
+find_scratch (void)
+{
+  struct block *block;
+
+  for (block = block_first (); block != NULL; block = block_next (block))
+    if (block_type (block) == BLOCK_SCRATCH)
+      return block;
+  return NULL;
+}
+
+/* Copies the first SECTOR_CNT sectors of SCRATCH, or all of it
+   if it is smaller, into the RAM disk, a page at a time. */
+static void
+load (struct block *scratch, block_sector_t sector_cnt)
+{
+  block_sector_t sector;
+
+  if (sector_cnt > block_size (scratch))
+    sector_cnt = block_size (scratch);
+  for (sector = 0; sector < sector_cnt; sector += SECTORS_PER_PAGE)
+    {
+      block_sector_t cnt = sector_cnt - sector < SECTORS_PER_PAGE
+                           ? sector_cnt - sector : SECTORS_PER_PAGE;
+      block_read_multi (scratch, sector, cnt,
+                        ramdisk.pages[sector / SECTORS_PER_PAGE]);
+    }
+}
+
+/* Returns the address of SECTOR's data in RD. */
+static uint8_t *
+sector_data (struct ramdisk *rd, block_sector_t sector)
+{
+  return ((uint8_t *) rd->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads the CNT sectors starting at SECTOR from RAM disk RD_
+   into BUFFER. */
+static void
+ramdisk_read_multi (void *rd_, block_sector_t sector, block_sector_t cnt,
+                    void *buffer)
+{
+  struct ramdisk *rd = rd_;
+  uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      /* Copy up to the end of SECTOR's page. */
+      block_sector_t n = SECTORS_PER_PAGE - sector % SECTORS_PER_PAGE;
+      if (n > cnt)
+        n = cnt;
+      memcpy (p, sector_data (rd, sector), n * BLOCK_SECTOR_SIZE);
+      p += n * BLOCK_SECTOR_SIZE;
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Writes the CNT sectors starting at SECTOR to RAM disk RD_ from
+   BUFFER. */
+static void
+ramdisk_write_multi (void *rd_, block_sector_t sector, block_sector_t cnt,
+                     const void *buffer)
+{
+  struct ramdisk *rd = rd_;
+  const uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      block_sector_t n = SECTORS_PER_PAGE - sector % SECTORS_PER_PAGE;
+      if (n > cnt)
+        n = cnt;
+      memcpy (sector_data (rd, sector), p, n * BLOCK_SECTOR_SIZE);
+      p += n * BLOCK_SECTOR_SIZE;
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Reads sector SECTOR from RAM disk RD into BUFFER. */
+static void
+ramdisk_read (void *rd, block_sector_t sector, void *buffer)
+{
+  ramdisk_read_multi (rd, sector, 1, buffer);
+}
+
+/* Writes sector SECTOR to RAM disk RD from BUFFER. */
+static void
+ramdisk_write (void *rd, block_sector_t sector, const void *buffer)
+{
+  ramdisk_write_multi (rd, sector, 1, buffer);
+}
+
+/* The RAM disk has no request queue and no submit operation:
+   block_submit() copies the data and completes the request
+   before returning, which is as asynchronous as memcpy() gets. */
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multi,
+    ramdisk_write_multi,
+    NULL,
+    NULL
+  };
@@ -11,6 +11,7 @@
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/blocktrace.h"
 #include "filesys/filesys.h"
 #endif
 
@@ -122,6 +123,7 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  blocktrace_dump ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
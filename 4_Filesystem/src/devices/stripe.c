@@ -0,0 +1,208 @@
+#include "devices/stripe.h"
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+
+/* The code in this file is a block device, "md0", that stripes
+   its sectors across several other block devices in the manner
+   of RAID 0: chunk 0 lives on the first member, chunk 1 on the
+   second, and so on round-robin.  A large request is split into
+   one request per chunk, which are submitted to the members at
+   once, so members on different IDE channels (e.g. hda and hdc)
+   transfer concurrently.  There is no redundancy: losing any
+   member loses everything.
+
+   Like the RAM disk, md0 is a raw device.  Give -filesys=md0 or
+   -swap=md0 to use it. */
+
+/* Most member devices. */
+#define MAX_MEMBERS 8
+
+/* Chunk size, in sectors, if none is given. */
+#define DEFAULT_CHUNK 64
+
+/* The stripe set. */
+struct stripe
+  {
+    struct block *block;                /* md0 itself. */
+    struct block *members[MAX_MEMBERS]; /* Member devices. */
+    int member_cnt;                     /* Number of members. */
+    block_sector_t chunk;               /* Sectors per chunk. */
+  };
+
+static struct stripe stripe;
+
+/* A request to md0 in progress. */
+struct stripe_io
+  {
+    struct block_request *parent;       /* Request to md0. */
+    int pending;                        /* Pieces not yet complete. */
+    struct block_request pieces[];      /* Requests to members. */
+  };
+
+static struct block_operations stripe_operations;
+
+/* Creates md0 from SPEC, which has the form DEV,DEV[,...][:CHUNK]:
+   the names of the member block devices, then optionally the
+   chunk size in sectors.  Panics if SPEC is malformed. */
+void
+stripe_init (char *spec)
+{
+  char *names, *chunk, *name, *save_ptr;
+  block_sector_t member_size = (block_sector_t) -1;
+  char extra_info[64];
+  int i;
+
+  names = strtok_r (spec, ":", &save_ptr);
+  chunk = strtok_r (NULL, "", &save_ptr);
+  stripe.chunk = chunk != NULL ? atoi (chunk) : DEFAULT_CHUNK;
+  if (stripe.chunk == 0)
+    PANIC ("md0: bad chunk size `%s'", chunk);
+
+  for (name = strtok_r (names, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *member = block_get_by_name (name);
+
+      if (member == NULL)
+        PANIC ("md0: no such block device \"%s\"", name);
+      if (block_type (member) == BLOCK_FOREIGN)
+        PANIC ("md0: %s belongs to another operating system", name);
+      for (i = 0; i < stripe.member_cnt; i++)
+        if (stripe.members[i] == member)
+          PANIC ("md0: %s given twice", name);
+      if (stripe.member_cnt >= MAX_MEMBERS)
+        PANIC ("md0: more than %d devices", MAX_MEMBERS);
+
+      stripe.members[stripe.member_cnt++] = member;
+      if (block_size (member) < member_size)
+        member_size = block_size (member);
+    }
+  if (stripe.member_cnt < 2)
+    PANIC ("md0: need at least two devices");
+
+  /* Every member contributes as many whole chunks as the smallest
+     one holds. */
+  member_size -= member_size % stripe.chunk;
+  if (member_size == 0)
+    PANIC ("md0: devices smaller than one %"PRDSNu"-sector chunk",
+           stripe.chunk);
+
+  snprintf (extra_info, sizeof extra_info,
+            "%d-way stripe, %"PRDSNu"-sector chunks",
+            stripe.member_cnt, stripe.chunk);
+  stripe.block = block_register ("md0", BLOCK_RAW, extra_info,
+                                 member_size * stripe.member_cnt,
+                                 &stripe_operations, &stripe);
+}
+
+/* Returns the member of S that holds SECTOR and sets *MEMBER_SECTOR
+   to SECTOR's location within it.  Also returns, in *CNT, how
+   many sectors starting at SECTOR lie in the same chunk, at most
+   *CNT. */
+static struct block *
+map_sector (const struct stripe *s, block_sector_t sector,
+            block_sector_t *member_sector, block_sector_t *cnt)
+{
+  block_sector_t chunk = sector / s->chunk;
+  block_sector_t ofs = sector % s->chunk;
+
+  if (*cnt > s->chunk - ofs)
+    *cnt = s->chunk - ofs;
+  *member_sector = chunk / s->member_cnt * s->chunk + ofs;
+  return s->members[chunk % s->member_cnt];
+}
+
+/* Returns the number of chunks that request R touches in S. */
+static size_t
+piece_cnt (const struct stripe *s, const struct block_request *r)
+{
+  return ((r->sector + r->cnt - 1) / s->chunk - r->sector / s->chunk) + 1;
+}
+
+/* Called when a piece of stripe_io IO_ completes.  Completes the
+   request to md0 with the last piece. */
+static void
+piece_done (struct block_request *piece UNUSED, void *io_)
+{
+  struct stripe_io *io = io_;
+  enum intr_level old_level;
+  bool last;
+
+  /* Pieces complete in the worker threads of different
+     members. */
+  old_level = intr_disable ();
+  last = --io->pending == 0;
+  intr_set_level (old_level);
+
+  if (last)
+    {
+      block_complete (stripe.block, io->parent);
+      free (io);
+    }
+}
+
+/* Splits request R to stripe set S_ into one piece per chunk and
+   submits the pieces to the members. */
+static void
+stripe_submit (void *s_, struct block_request *r)
+{
+  struct stripe *s = s_;
+  size_t cnt = piece_cnt (s, r);
+  struct stripe_io *io;
+  block_sector_t sector = r->sector;
+  uint8_t *buffer = r->buffer;
+  size_t i;
+
+  io = malloc (sizeof *io + cnt * sizeof *io->pieces);
+  if (io == NULL)
+    {
+      /* Out of memory: do the pieces one at a time instead. */
+      for (i = 0; i < cnt; i++)
+        {
+          block_sector_t member_sector, n = r->sector + r->cnt - sector;
+          struct block *member = map_sector (s, sector, &member_sector, &n);
+
+          if (r->write)
+            block_write_multi (member, member_sector, n, buffer);
+          else
+            block_read_multi (member, member_sector, n, buffer);
+          sector += n;
+          buffer += n * BLOCK_SECTOR_SIZE;
+        }
+      block_complete (s->block, r);
+      return;
+    }
+
+  /* All pieces must be counted before the first is submitted,
+     because it may complete right away. */
+  io->parent = r;
+  io->pending = cnt;
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t member_sector, n = r->sector + r->cnt - sector;
+      struct block *member = map_sector (s, sector, &member_sector, &n);
+
+      block_request_init (&io->pieces[i], r->write, member_sector, n,
+                          buffer, piece_done, io);
+      block_submit (member, &io->pieces[i]);
+      sector += n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* md0 only splits requests, so it needs nothing but a submit
+   operation. */
+static struct block_operations stripe_operations =
+  {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    stripe_submit,
+    NULL
+  };
@@ -0,0 +1,455 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for virtio block devices,
+   which QEMU provides with "-drive if=virtio".  It speaks the
+   legacy ("transitional") virtio PCI interface of [VIRTIO-0.9.5],
+   which has all of its registers in one I/O port range and is
+   simpler than the capability-based interface of virtio 1.0.
+
+   Unlike an IDE disk, a virtio device accepts many requests at
+   once: we put each one on a ring shared with the device and
+   the device reports completion by putting it on a second ring,
+   in whatever order suits it.  Hence the driver provides only a
+   submit operation and the block layer does no queueing of its
+   own for these devices. */
+
+/* PCI IDs of a legacy virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio registers, as offsets from the I/O space
+   BAR 0.  Device-specific configuration follows the common
+   registers, starting at REG_CONFIG. */
+#define REG_DEVICE_FEATURES 0x00        /* Features device offers (r/o). */
+#define REG_GUEST_FEATURES 0x04         /* Features driver accepts. */
+#define REG_QUEUE_PFN 0x08              /* Physical page of queue. */
+#define REG_QUEUE_SIZE 0x0c             /* Entries in queue (r/o, 16 bits). */
+#define REG_QUEUE_SELECT 0x0e           /* Queue the above refer to. */
+#define REG_QUEUE_NOTIFY 0x10           /* Write queue number to kick. */
+#define REG_STATUS 0x12                 /* Device status (8 bits). */
+#define REG_ISR 0x13                    /* Interrupt status (r/o, 8 bits). */
+#define REG_CONFIG 0x14                 /* Device configuration. */
+
+/* Block device configuration: capacity in 512-byte sectors,
+   64 bits wide. */
+#define REG_CAPACITY (REG_CONFIG + 0)
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest noticed the device. */
+#define STATUS_DRIVER 0x02      /* Guest knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Driver gave up on the device. */
+
+/* ISR register bits. */
+#define ISR_QUEUE 0x01          /* A queue has new used buffers. */
+
+/* Legacy queues are aligned on this boundary. */
+#define VRING_ALIGN 4096
+
+/* A descriptor: one physically contiguous buffer. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_*. */
+    uint16_t next;              /* Next descriptor if VRING_DESC_F_NEXT. */
+  };
+#define VRING_DESC_F_NEXT 0x1   /* Chain continues with NEXT. */
+#define VRING_DESC_F_WRITE 0x2  /* Device writes the buffer. */
+
+/* Ring of descriptor chains the driver offers the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the driver puts the next entry. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* Ring of descriptor chains the device is done with. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes written to the chain. */
+  };
+
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the device puts the next entry. */
+    struct vring_used_elem ring[];
+  };
+
+/* Header at the start of every virtio block request. */
+struct virtio_blk_header
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t ioprio;            /* Ignored by QEMU. */
+    uint64_t sector;            /* First sector, 512 bytes each. */
+  };
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+
+/* Status byte the device writes at the end of every request. */
+#define VIRTIO_BLK_S_OK 0
+
+/* Each request is a chain of three descriptors: header, data and
+   status. */
+#define DESC_PER_REQUEST 3
+
+/* State for a request in flight.  There is one for each
+   descriptor, but only those of chain heads are used. */
+struct slot
+  {
+    struct virtio_blk_header header;    /* Read by the device. */
+    uint8_t status;                     /* Written by the device. */
+    struct block_request *request;      /* Request being carried out. */
+  };
+
+/* A virtio block device. */
+struct virtio_blk
+  {
+    struct list_elem elem;      /* Element in the devices list. */
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base of legacy registers. */
+    uint8_t irq;                /* Interrupt line. */
+    struct block *block;        /* Block device. */
+
+    /* The request queue.  The first three members all point into
+       one physically contiguous allocation of RING_PAGES pages. */
+    struct vring_desc *desc;    /* QUEUE_SIZE descriptors. */
+    struct vring_avail *avail;  /* Available ring. */
+    struct vring_used *used;    /* Used ring. */
+    size_t ring_pages;          /* Pages allocated for the above. */
+    uint16_t queue_size;        /* Number of descriptors. */
+    uint16_t free_head;         /* First free descriptor. */
+    uint16_t free_cnt;          /* Number of free descriptors. */
+    uint16_t last_used;         /* used->idx when last looked at. */
+    struct slot *slots;         /* QUEUE_SIZE slots. */
+
+    struct lock lock;           /* Protects the queue and PENDING. */
+    struct list pending;        /* Requests waiting for descriptors. */
+    struct semaphore interrupted;       /* Up'd by interrupt handler. */
+  };
+
+/* All virtio block devices, for the interrupt handler. */
+static struct list devices = LIST_INITIALIZER (devices);
+
+static struct block_operations virtio_blk_operations;
+
+static bool setup_queue (struct virtio_blk *);
+static void interrupt_handler (struct intr_frame *);
+static void completion_thread (void *dev_);
+
+/* Finds and initializes each virtio block device, registering
+   them as "vda", "vdb", and so on. */
+void
+virtio_blk_init (void)
+{
+  struct pci_device *p = NULL;
+  char letter = 'a';
+
+  while ((p = pci_find_device (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, p)) != NULL)
+    {
+      struct virtio_blk *d;
+      struct list_elem *e;
+      bool shared_irq = false;
+      char extra_info[32];
+      uint32_t cap_lo, cap_hi;
+      block_sector_t capacity;
+
+      if (letter > 'z')
+        break;
+      d = malloc (sizeof *d);
+      if (d == NULL)
+        PANIC ("Failed to allocate memory for virtio device");
+      snprintf (d->name, sizeof d->name, "vd%c", letter);
+      d->io_base = pci_io_bar (p, 0);
+      d->irq = p->irq;
+      if (d->io_base == 0 || d->irq == 0xff)
+        {
+          printf ("%s: no I/O ports or interrupt, ignoring\n", d->name);
+          free (d);
+          continue;
+        }
+      pci_enable (p, PCI_CMD_IO | PCI_CMD_MASTER);
+
+      /* Reset the device and tell it we know what it is.  We use
+         none of the optional features. */
+      outb (d->io_base + REG_STATUS, 0);
+      outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+      outl (d->io_base + REG_GUEST_FEATURES, 0);
+
+      if (!setup_queue (d))
+        {
+          outb (d->io_base + REG_STATUS, STATUS_FAILED);
+          free (d);
+          continue;
+        }
+      lock_init (&d->lock);
+      list_init (&d->pending);
+      sema_init (&d->interrupted, 0);
+
+      /* Several devices may share one interrupt line, so we
+         register one handler per line and let it check every
+         device. */
+      for (e = list_begin (&devices); e != list_end (&devices);
+           e = list_next (e))
+        if (list_entry (e, struct virtio_blk, elem)->irq == d->irq)
+          shared_irq = true;
+      list_push_back (&devices, &d->elem);
+      if (!shared_irq)
+        intr_register_ext (0x20 + d->irq, interrupt_handler, "virtio-blk");
+
+      if (thread_create (d->name, PRI_DEFAULT, completion_thread, d)
+          == TID_ERROR)
+        PANIC ("%s: failed to start completion thread", d->name);
+      outb (d->io_base + REG_STATUS,
+            STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+      /* Capacities that do not fit in a block_sector_t are
+         truncated. */
+      cap_lo = inl (d->io_base + REG_CAPACITY);
+      cap_hi = inl (d->io_base + REG_CAPACITY + 4);
+      capacity = cap_hi != 0 ? (block_sector_t) -1 : cap_lo;
+
+      snprintf (extra_info, sizeof extra_info, "virtio, %"PRIu16"-entry queue",
+                d->queue_size);
+      d->block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                                 &virtio_blk_operations, d);
+      partition_scan (d->block);
+      letter++;
+    }
+}
+
+/* Allocates queue 0 of device D and tells the device where it
+   is.  Returns true if successful, false on failure. */
+static bool
+setup_queue (struct virtio_blk *d)
+{
+  size_t avail_end, used_ofs, used_end;
+  uint8_t *ring;
+  uint16_t i;
+
+  outw (d->io_base + REG_QUEUE_SELECT, 0);
+  d->queue_size = inw (d->io_base + REG_QUEUE_SIZE);
+  if (d->queue_size < DESC_PER_REQUEST)
+    {
+      printf ("%s: no usable queue\n", d->name);
+      return false;
+    }
+
+  /* Legacy layout: descriptors, then the available ring, then
+     the used ring on the next VRING_ALIGN boundary. */
+  avail_end = (sizeof *d->desc * d->queue_size + sizeof *d->avail
+               + sizeof d->avail->ring[0] * (d->queue_size + 1));
+  used_ofs = ROUND_UP (avail_end, VRING_ALIGN);
+  used_end = (used_ofs + sizeof *d->used
+              + sizeof d->used->ring[0] * d->queue_size + sizeof (uint16_t));
+  d->ring_pages = DIV_ROUND_UP (used_end, PGSIZE);
+  ring = palloc_get_multiple (PAL_ZERO, d->ring_pages);
+  d->slots = malloc (sizeof *d->slots * d->queue_size);
+  if (ring == NULL || d->slots == NULL)
+    {
+      printf ("%s: out of memory for %"PRIu16"-entry queue\n",
+              d->name, d->queue_size);
+      if (ring != NULL)
+        palloc_free_multiple (ring, d->ring_pages);
+      free (d->slots);
+      return false;
+    }
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + sizeof *d->desc * d->queue_size);
+  d->used = (struct vring_used *) (ring + used_ofs);
+
+  /* Chain every descriptor into the free list. */
+  for (i = 0; i < d->queue_size; i++)
+    d->desc[i].next = i + 1;
+  d->free_head = 0;
+  d->free_cnt = d->queue_size;
+  d->last_used = 0;
+
+  outl (d->io_base + REG_QUEUE_PFN, vtop (ring) >> PGBITS);
+  return true;
+}
+
+/* Takes a descriptor off D's free list and returns its index. */
+static uint16_t
+alloc_desc (struct virtio_blk *d)
+{
+  uint16_t i = d->free_head;
+
+  ASSERT (d->free_cnt > 0);
+  d->free_head = d->desc[i].next;
+  d->free_cnt--;
+  return i;
+}
+
+/* Puts the descriptor chain that starts at HEAD back on D's free
+   list. */
+static void
+free_chain (struct virtio_blk *d, uint16_t head)
+{
+  uint16_t i = head;
+
+  for (;;)
+    {
+      bool more = d->desc[i].flags & VRING_DESC_F_NEXT;
+      uint16_t next = d->desc[i].next;
+
+      d->desc[i].next = d->free_head;
+      d->free_head = i;
+      d->free_cnt++;
+      if (!more)
+        break;
+      i = next;
+    }
+}
+
+/* Fills descriptor I of D and returns I. */
+static uint16_t
+fill_desc (struct virtio_blk *d, uint16_t i, const void *buffer,
+           uint32_t len, uint16_t flags)
+{
+  d->desc[i].addr = vtop (buffer);
+  d->desc[i].len = len;
+  d->desc[i].flags = flags;
+  return i;
+}
+
+/* Offers request R to device D.  D's lock must be held and
+   DESC_PER_REQUEST descriptors must be free. */
+static void
+start_request (struct virtio_blk *d, struct block_request *r)
+{
+  uint16_t head = alloc_desc (d);
+  uint16_t data = alloc_desc (d);
+  uint16_t status = alloc_desc (d);
+  struct slot *s = &d->slots[head];
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  ASSERT (is_kernel_vaddr (r->buffer));
+
+  s->header.type = r->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  s->header.ioprio = 0;
+  s->header.sector = r->sector;
+  s->status = 0xff;
+  s->request = r;
+
+  fill_desc (d, head, &s->header, sizeof s->header, VRING_DESC_F_NEXT);
+  d->desc[head].next = data;
+  fill_desc (d, data, r->buffer, r->cnt * BLOCK_SECTOR_SIZE,
+             VRING_DESC_F_NEXT | (r->write ? 0 : VRING_DESC_F_WRITE));
+  d->desc[data].next = status;
+  fill_desc (d, status, &s->status, 1, VRING_DESC_F_WRITE);
+
+  /* The device may look at the ring as soon as the index
+     changes, so the entry must be in place first. */
+  d->avail->ring[d->avail->idx % d->queue_size] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->io_base + REG_QUEUE_NOTIFY, 0);
+}
+
+/* Starts request R on the device with the given AUX data, or
+   queues it until descriptors free up. */
+static void
+virtio_blk_submit (void *d_, struct block_request *r)
+{
+  struct virtio_blk *d = d_;
+
+  ASSERT (r->cnt > 0);
+
+  lock_acquire (&d->lock);
+  if (d->free_cnt >= DESC_PER_REQUEST && list_empty (&d->pending))
+    start_request (d, r);
+  else
+    list_push_back (&d->pending, &r->elem);
+  lock_release (&d->lock);
+}
+
+static struct block_operations virtio_blk_operations =
+  {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    virtio_blk_submit,
+    NULL
+  };
+
+/* Completes the requests the device D has finished with.  Runs
+   in its own thread, woken by interrupt_handler(). */
+static void
+completion_thread (void *d_)
+{
+  struct virtio_blk *d = d_;
+
+  for (;;)
+    {
+      struct list done;
+
+      sema_down (&d->interrupted);
+
+      list_init (&done);
+      lock_acquire (&d->lock);
+      while (d->last_used != d->used->idx)
+        {
+          struct vring_used_elem *u;
+          struct slot *s;
+
+          barrier ();
+          u = &d->used->ring[d->last_used % d->queue_size];
+          s = &d->slots[u->id];
+          if (s->status != VIRTIO_BLK_S_OK)
+            PANIC ("%s: %s of sector %"PRDSNu" failed", d->name,
+                   s->request->write ? "write" : "read",
+                   s->request->sector);
+          list_push_back (&done, &s->request->elem);
+          free_chain (d, u->id);
+          d->last_used++;
+        }
+      while (d->free_cnt >= DESC_PER_REQUEST && !list_empty (&d->pending))
+        start_request (d, list_entry (list_pop_front (&d->pending),
+                                      struct block_request, elem));
+      lock_release (&d->lock);
+
+      /* Callbacks may submit more requests, so they must run
+         without the lock. */
+      while (!list_empty (&done))
+        block_complete (d->block, list_entry (list_pop_front (&done),
+                                              struct block_request, elem));
+    }
+}
+
+/* Virtio interrupt handler.  Reading a device's ISR register
+   acknowledges its interrupt. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&devices); e != list_end (&devices);
+       e = list_next (e))
+    {
+      struct virtio_blk *d = list_entry (e, struct virtio_blk, elem);
+      if (f->vec_no == 0x20u + d->irq
+          && (inb (d->io_base + REG_ISR) & ISR_QUEUE))
+        sema_up (&d->interrupted);
+    }
+}
@@ -1,8 +1,12 @@
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "filesys/buffer_cache.h"
+#include "filesys/journal.h"
+#include "devices/blocktrace.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
 
+#include <list.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -12,6 +16,51 @@
 void *p_buffer_cache; //buffer cache 메모리영역을 가리킴
 struct buffer_head buffer_head[BUFFER_CACHE_ENTRY_NB]; //bufferhead array
 static int clock_hand; //victim entry 선정시clock 알고리즘을위한변수
+static struct lock bc_lock; //cache miss 처리(victim 선정, sector 등록)를 보호
+
+/* Sectors queued by bc_prefetch_async() for the read-ahead thread,
+   which takes them from ra_head.  Requests that find the queue
+   full are dropped; they are only hints. */
+#define RA_QUEUE_SIZE 64
+static block_sector_t ra_queue[RA_QUEUE_SIZE];
+static unsigned ra_head, ra_tail;
+static struct lock ra_lock;             /* Protects ra_queue. */
+static struct condition ra_cond;        /* Signaled when it grows. */
+
+/* Held by the read-ahead thread while it loads a sector.
+   bc_term() takes it for good. */
+static struct lock ra_busy;
+
+/* Most queued consecutive sectors the read-ahead thread loads
+   with one disk read, and the buffer it reads them into. */
+#define RA_RUN_MAX 16
+static uint8_t ra_buffer[RA_RUN_MAX * BLOCK_SECTOR_SIZE];
+
+/* A run of sectors being written by bc_write_direct().  Until the
+   write is done, a miss on one of them waits on direct_done
+   instead of loading the old contents from disk. */
+struct direct_write
+{
+    struct list_elem elem;
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+};
+static struct list direct_writes;       /* Protected by bc_lock. */
+static struct condition direct_done;    /* Signaled when one ends. */
+
+static void read_ahead_thread (void *aux);
+static void prefetch_run (block_sector_t sector, size_t cnt);
+static bool direct_in_flight (block_sector_t sector, size_t cnt);
+static bool drop_entry (block_sector_t sector, const void *data);
+
+static struct buffer_head *bc_get_entry (block_sector_t sector);
+static struct buffer_head *claim_entry (block_sector_t sector);
+static bool write_entry (block_sector_t sector_idx, void *buffer,
+                         off_t bytes_written, int chunk_size,
+                         int sector_ofs, bool pin);
+static bool copy_entry (block_sector_t dst_idx, int dst_ofs,
+                        block_sector_t src_idx, int src_ofs,
+                        int chunk_size, bool pin);
 
 
 
@@ -20,34 +69,24 @@ bool bc_read (block_sector_t sector_idx, void *buffer, off_t bytes_read,
     
     struct buffer_head *bf_head;
   
-    /* sector_idx를buffer_head에서검색(bc_lookup함수이용)*/
-    /* 검색결과가없을경우, 디스크블록을캐싱할buffer entry의
-       buffer_head를구함(bc_select_victim함수이용)*/
-    if (!(bf_head = bc_lookup(sector_idx))) {
-        if (!(bf_head = bc_select_victim()))
+    /* sector_idx를buffer_head에서검색하고, 없으면 victim entry로
+       디스크블록을 읽어옴 (bc_get_entry함수이용) */
+    for (;;) {
+        if (!(bf_head = bc_get_entry (sector_idx)))
             return false;
-       
-        //lock
-        lock_acquire(&bf_head->lock);
-
-        /* block_read함수를이용해, 디스크블록데이터를buffer cache
-           로read */ 
-        block_read(fs_device, sector_idx, bf_head->data);
-
-        //Alloc buffer head
-        bf_head->dirty = false;
-        bf_head->valid = true;
-        bf_head->sector = sector_idx;
-
-        //unlock
-        lock_release(&bf_head->lock);
+        //lock before setting
+        lock_acquire (&bf_head->lock);
+        /* lock을 기다리는 동안 다른 sector로 교체되었을 수 있음 */
+        if (bf_head->sector == sector_idx)
+            break;
+        lock_release (&bf_head->lock);
     }
-    //lock before setting
-    lock_acquire (&bf_head->lock);
+    blocktrace_ref (fs_device, sector_idx, false);
     /* memcpy함수를통해, buffer에디스크블록데이터를복사*/
     memcpy (buffer + bytes_read, bf_head->data + sector_ofs, chunk_size);
     /* buffer_head의clock bit을setting */
     bf_head->clock_bit = true;
+    bf_head->hits++;
     //unlock
     lock_release(&bf_head->lock);
     
@@ -56,29 +95,216 @@ bool bc_read (block_sector_t sector_idx, void *buffer, off_t bytes_read,
 
 bool bc_write (block_sector_t sector_idx, void *buffer, off_t
         bytes_written, int chunk_size, int sector_ofs) {
+    return write_entry (sector_idx, buffer, bytes_written, chunk_size,
+                        sector_ofs, false);
+}
+
+/* Like bc_write(), for a metadata sector.  The sector joins the
+   running journal transaction and its buffer stays pinned in the
+   cache until the transaction commits, so the change cannot reach
+   its home location before it is in the log. */
+bool bc_write_meta (block_sector_t sector_idx, void *buffer,
+                    off_t bytes_written, int chunk_size, int sector_ofs) {
+
+    bool success;
+
+    journal_begin (1);
+    success = write_entry (sector_idx, buffer, bytes_written, chunk_size,
+                           sector_ofs, journal_add (sector_idx));
+    journal_end ();
+    return success;
+}
+
+static bool write_entry (block_sector_t sector_idx, void *buffer,
+                         off_t bytes_written, int chunk_size,
+                         int sector_ofs, bool pin) {
 
     struct buffer_head *bf_head;
     
     /* sector_idx를buffer_head에서검색하여buffer에복사(구현)*/
-    if (!(bf_head = bc_lookup (sector_idx))) {
-        if (!(bf_head = bc_select_victim()))
+    for (;;) {
+        if (!(bf_head = bc_get_entry (sector_idx)))
             return false;
-        block_read (fs_device, sector_idx, bf_head->data);
+        lock_acquire(&bf_head->lock);
+        if (bf_head->sector == sector_idx)
+            break;
+        lock_release(&bf_head->lock);
     }
-
-    lock_acquire(&bf_head->lock);
+    blocktrace_ref (fs_device, sector_idx, true);
     memcpy(bf_head->data + sector_ofs, buffer + bytes_written, chunk_size);
 
     /* update buffer head */
     bf_head->dirty = true;
-    bf_head->valid = true;
-    bf_head->sector = sector_idx;
     bf_head->clock_bit = true;
+    bf_head->hits++;
+    if (pin)
+        bf_head->pinned = true;
     lock_release(&bf_head->lock);
 
     return true;;
 }
 
+/* Copies CHUNK_SIZE bytes from offset SRC_OFS of sector SRC_IDX to
+   offset DST_OFS of sector DST_IDX without leaving the buffer
+   cache, so file-to-file copies never bounce through a caller's
+   buffer.  A destination sector that is overwritten completely is
+   not read from disk first. */
+bool bc_copy (block_sector_t dst_idx, int dst_ofs, block_sector_t src_idx,
+              int src_ofs, int chunk_size) {
+    return copy_entry (dst_idx, dst_ofs, src_idx, src_ofs, chunk_size,
+                       false);
+}
+
+/* Like bc_copy(), for a metadata destination sector; see
+   bc_write_meta(). */
+bool bc_copy_meta (block_sector_t dst_idx, int dst_ofs,
+                   block_sector_t src_idx, int src_ofs, int chunk_size) {
+
+    bool success;
+
+    journal_begin (1);
+    success = copy_entry (dst_idx, dst_ofs, src_idx, src_ofs, chunk_size,
+                          journal_add (dst_idx));
+    journal_end ();
+    return success;
+}
+
+static bool copy_entry (block_sector_t dst_idx, int dst_ofs,
+                        block_sector_t src_idx, int src_ofs,
+                        int chunk_size, bool pin) {
+
+    struct buffer_head *src, *dst, *first, *second;
+    bool whole = dst_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE;
+
+    for (;;) {
+        if (!(src = bc_get_entry (src_idx)))
+            return false;
+
+        /* 통째로 덮어쓸 dst가 cache에 없으면 디스크에서 읽지 않고
+           entry만 잡음. 내용을 채울 때까지 lock을 놓지 않아야
+           다른 thread가 예전 내용을 보지 않음 */
+        if (whole && src_idx != dst_idx) {
+            lock_acquire (&src->lock);
+            if (src->sector != src_idx) {
+                lock_release (&src->lock);
+                continue;
+            }
+            if ((dst = claim_entry (dst_idx))) {
+                first = src;
+                second = dst;
+                break;
+            }
+            lock_release (&src->lock);
+        }
+
+        if (!(dst = bc_get_entry (dst_idx)))
+            return false;
+
+        /* 교착상태를 피하기 위해 주소 순서대로 lock 획득 */
+        first = src < dst ? src : dst;
+        second = src < dst ? dst : src;
+        lock_acquire (&first->lock);
+        if (second != first)
+            lock_acquire (&second->lock);
+
+        /* dst를 채우는 동안 src가 victim으로 선택되었을 수 있음 */
+        if (src->sector == src_idx && dst->sector == dst_idx)
+            break;
+
+        if (second != first)
+            lock_release (&second->lock);
+        lock_release (&first->lock);
+    }
+
+    blocktrace_ref (fs_device, src_idx, false);
+    blocktrace_ref (fs_device, dst_idx, true);
+    memmove (dst->data + dst_ofs, src->data + src_ofs, chunk_size);
+    dst->dirty = true;
+    dst->clock_bit = true;
+    src->clock_bit = true;
+    dst->hits++;
+    src->hits++;
+    if (pin)
+        dst->pinned = true;
+
+    if (second != first)
+        lock_release (&second->lock);
+    lock_release (&first->lock);
+    return true;
+}
+
+/* Returns the buffer cache entry holding SECTOR, loading it into a
+   victim entry if it is not cached.
+
+   Misses are handled under bc_lock, and a new entry is given its
+   sector before the disk read starts, with its lock held until the
+   read is done.  A second thread missing on the same sector, such
+   as the read-ahead thread, thus finds the entry and waits on its
+   lock instead of loading a second copy.  The caller must still
+   lock the entry and check that it holds SECTOR, since it may be
+   evicted again in between.
+
+   If every entry is pinned by the journal, the running
+   transaction is committed to unpin them, or, inside a journal
+   operation, which would keep the commit waiting, other threads
+   are let run until it is. */
+static struct buffer_head *bc_get_entry (block_sector_t sector) {
+
+    struct buffer_head *bf_head;
+    enum blocktrace_source old;
+
+    lock_acquire (&bc_lock);
+    for (;;) {
+        if ((bf_head = bc_lookup (sector))) {
+            lock_release (&bc_lock);
+            return bf_head;
+        }
+        if (direct_in_flight (sector, 1)) {
+            cond_wait (&direct_done, &bc_lock);
+            continue;
+        }
+        if ((bf_head = bc_select_victim ()))
+            break;
+        lock_release (&bc_lock);
+        if (thread_current ()->journal_depth == 0)
+            journal_commit ();
+        else
+            thread_yield ();
+        lock_acquire (&bc_lock);
+    }
+
+    bf_head->dirty = false;
+    bf_head->valid = true;
+    bf_head->sector = sector;
+    lock_release (&bc_lock);
+
+    old = blocktrace_set_source (BLOCKTRACE_CACHE);
+    block_read (fs_device, sector, bf_head->data);
+    blocktrace_set_source (old);
+    lock_release (&bf_head->lock);
+    return bf_head;
+}
+
+/* Gives SECTOR, which the caller is about to overwrite whole, a
+   cache entry without reading it from disk, and returns the entry
+   still locked, so that no one sees it before it is written.  The
+   caller may hold another entry's lock, since the victim scan
+   never waits for one.  Returns a null pointer if SECTOR is
+   cached already or no entry can be freed. */
+static struct buffer_head *claim_entry (block_sector_t sector) {
+
+    struct buffer_head *bf_head = NULL;
+
+    lock_acquire (&bc_lock);
+    if (!bc_lookup (sector) && !direct_in_flight (sector, 1)
+        && (bf_head = bc_select_victim ())) {
+        bf_head->dirty = false;
+        bf_head->valid = true;
+        bf_head->sector = sector;
+    }
+    lock_release (&bc_lock);
+    return bf_head;
+}
 
 void bc_init (void) {
 
@@ -95,19 +321,33 @@ void bc_init (void) {
     else{
         p_data = p_buffer_cache;
     }
+    lock_init (&bc_lock);
+    lock_init (&ra_lock);
+    cond_init (&ra_cond);
+    lock_init (&ra_busy);
+    ra_head = ra_tail = 0;
+    list_init (&direct_writes);
+    cond_init (&direct_done);
     /* 전역변수buffer_head자료구조초기화*/
     for(i=0; i<BUFFER_CACHE_ENTRY_NB; i++){
         buffer_head[i].dirty = false;
         buffer_head[i].valid = false;
         buffer_head[i].sector = -1;
         buffer_head[i].clock_bit = 0;
+        buffer_head[i].hits = 0;
+        buffer_head[i].pinned = false;
         lock_init(&buffer_head[i].lock);
         buffer_head[i].data = p_data;
         p_data = p_data + BLOCK_SECTOR_SIZE;
     }
+    if (thread_create ("read_ahead", PRI_DEFAULT, read_ahead_thread, NULL)
+        == TID_ERROR)
+        PANIC ("could not start read-ahead thread");
 }
 
 void bc_term(void) {
+    /* read-ahead thread가 sector를 읽는 중이면 끝날 때까지 기다림 */
+    lock_acquire (&ra_busy);
     /* bc_flush_all_entries함수를 호출하여 모든 
        buffer cache entry를 디스크로 flush */
     bc_flush_all_entries();
@@ -115,12 +355,29 @@ void bc_term(void) {
     free(p_buffer_cache);
 }
 
+/* Picks the entry to reuse for a new sector with the clock
+   algorithm, writes it back if it is dirty, and returns it empty
+   and locked.  Must be called with bc_lock held.  Entries pinned
+   by the journal are never chosen; returns a null pointer if no
+   other entry can be found.  BC_PIN_MAX keeps that from
+   happening while the journal is the only user of pins.
+
+   The scan never waits for an entry lock: clock bits are only
+   hints and are cleared without it, and an entry some other
+   thread holds, such as one bc_flush_all_entries() is writing
+   back, is passed over.  Waiting there with bc_lock held could
+   deadlock with a thread that holds the entry lock and needs
+   bc_lock. */
 struct buffer_head *bc_select_victim (void) {
     
     int idx;
+    int scanned;
 
     /* clock 알고리즘을사용하여victim entry를선택*/
-    while(1){
+    for (scanned = 0; ; scanned++) {
+        /* 세 바퀴를 돌아도 못 찾으면 포기 */
+        if (scanned == 3 * BUFFER_CACHE_ENTRY_NB)
+            return NULL;
         idx = clock_hand;
 
         /* buffer_head전역변수를순회하며clock_bit변수를검사*/
@@ -130,30 +387,42 @@ struct buffer_head *bc_select_victim (void) {
         if(++clock_hand == BUFFER_CACHE_ENTRY_NB)
             clock_hand = 0;
 
+        /* journal에 기록되지 않은 metadata는 내보내지 않음 */
+        if (buffer_head[idx].pinned)
+            continue;
+
+        /* prefetch_run()이 채우려고 잡아 둔 entry는 건너뜀 */
+        if (lock_held_by_current_thread (&buffer_head[idx].lock))
+            continue;
+
         if(buffer_head[idx].clock_bit){
-            lock_acquire(&buffer_head[idx].lock);
             buffer_head[idx].clock_bit = 0;
-            lock_release(&buffer_head[idx].lock);
+            continue;
         }
-        else{
-            lock_acquire(&buffer_head[idx].lock);
-            buffer_head[idx].clock_bit = 1;
-            lock_release(&buffer_head[idx].lock);
-            break;
+        /* 다른 thread가 사용 중인 entry는 기다리지 않고 건너뜀 */
+        if (!lock_try_acquire (&buffer_head[idx].lock))
+            continue;
+        /* lock을 얻기 전에 pin되었을 수 있음 */
+        if (buffer_head[idx].pinned) {
+            lock_release (&buffer_head[idx].lock);
+            continue;
         }
+        break;
     }
 
     /* 선택된 victim entry가 dirty일 경우, 디스크로flush */
     if(buffer_head[idx].dirty == true){
-        bc_flush_entry(&buffer_head[idx]);
+        enum blocktrace_source old = blocktrace_set_source (BLOCKTRACE_EVICT);
+        block_write (fs_device, buffer_head[idx].sector, buffer_head[idx].data);
+        blocktrace_set_source (old);
     }
 
     /* victim entry에해당하는buffer_head값update */
-    lock_acquire(&buffer_head[idx].lock);
     buffer_head[idx].dirty = false;
     buffer_head[idx].valid = false;
+    buffer_head[idx].pinned = false;
+    buffer_head[idx].hits = 0;
     buffer_head[idx].sector = -1;
-    lock_release(&buffer_head[idx].lock);
     /* victim entry를return */
     return &buffer_head[idx];
 }
@@ -175,8 +444,15 @@ struct buffer_head* bc_lookup (block_sector_t sector) {
     return NULL;
 }
 
+/* Writes P_FLUSH_ENTRY back to disk if it is dirty and not
+   pinned by the journal.  Both are checked under the entry's
+   lock, since bc_write_meta() may pin it while we wait. */
 void bc_flush_entry (struct buffer_head *p_flush_entry) {
     lock_acquire(&p_flush_entry->lock);
+    if (!p_flush_entry->dirty || p_flush_entry->pinned) {
+        lock_release(&p_flush_entry->lock);
+        return;
+    }
     /* block_write을 호출하여, 인자로 전달받은
        buffer cache entry의 데이터를 디스크로 flush */
     block_write(fs_device, p_flush_entry->sector, p_flush_entry->data);
@@ -185,21 +461,347 @@ void bc_flush_entry (struct buffer_head *p_flush_entry) {
     lock_release(&p_flush_entry->lock);
 }
 
+/* Writes every dirty, unpinned entry back to disk.  The writes
+   are all submitted before waiting for any of them, so the disk's
+   request queue can merge neighboring sectors and order the whole
+   set by position.  Each entry stays locked until its write is
+   done. */
 void bc_flush_all_entries( void) {
-    int idx;
+    struct block_request *reqs;
+    struct buffer_head *flushed[BUFFER_CACHE_ENTRY_NB];
+    int idx, cnt = 0, i;
+    enum blocktrace_source old = blocktrace_set_source (BLOCKTRACE_FLUSH);
 
+    reqs = malloc (BUFFER_CACHE_ENTRY_NB * sizeof *reqs);
     /* 전역변수 buffer_head를 순회하며, 
        dirty인 entry는 block_write 함수를 호출하여 디스크로 flush */
     for (idx = 0; idx < BUFFER_CACHE_ENTRY_NB; idx++) {
 
-        if (buffer_head[idx].dirty == true) {
-            /* 디스크로flush한후, buffer_head의dirty 값update */
+        /* pin된 entry는 journal commit 후에 기록 */
+        if (buffer_head[idx].dirty == true && !buffer_head[idx].pinned) {
+            /* 메모리가 없으면 하나씩 동기적으로 flush */
+            if (reqs == NULL) {
+                bc_flush_entry (&buffer_head[idx]);
+                continue;
+            }
+            lock_acquire (&buffer_head[idx].lock);
+            /* lock을 기다리는 동안 이미 flush되었거나, journal이
+               pin했을 수 있음 */
+            if (!buffer_head[idx].dirty || buffer_head[idx].pinned) {
+                lock_release (&buffer_head[idx].lock);
+                continue;
+            }
+            block_request_init (&reqs[cnt], true, buffer_head[idx].sector, 1,
+                                buffer_head[idx].data, NULL, NULL);
+            block_submit (fs_device, &reqs[cnt]);
+            flushed[cnt++] = &buffer_head[idx];
+        }
+    }
+
+    /* 디스크로flush한후, buffer_head의dirty 값update */
+    for (i = 0; i < cnt; i++) {
+        block_wait (&reqs[i]);
+        flushed[i]->dirty = false;
+        lock_release (&flushed[i]->lock);
+    }
+    free (reqs);
+    blocktrace_set_source (old);
+}
+
+/* Lets SECTOR's buffer be written back again, once the journal
+   transaction that pinned it has committed. */
+void bc_unpin (block_sector_t sector) {
+
+    struct buffer_head *bf_head = bc_lookup (sector);
+
+    if (bf_head == NULL)
+        return;
+    lock_acquire (&bf_head->lock);
+    if (bf_head->sector == sector)
+        bf_head->pinned = false;
+    lock_release (&bf_head->lock);
+}
+
+/* Loads SECTOR into the buffer cache ahead of its first use, if it
+   is not cached already.  The entry starts out with no hits, so a
+   sector that is prefetched but never used drops out of the next
+   bc_hottest() list. */
+void bc_prefetch (block_sector_t sector) {
+
+    bc_get_entry (sector);
+}
+
+/* Stores into SECTORS the cached sectors that were accessed at
+   least once, most accessed first, and returns how many were
+   stored, at most MAX. */
+size_t bc_hottest (block_sector_t *sectors, size_t max) {
 
-            bc_flush_entry (&buffer_head[idx]);
-            /*lock_acquire (&buffer_head[idx].lock);
-            block_write (fs_device, buffer_head[idx].sector, buffer_head[idx].data);
-            buffer_head[idx].dirty = false;
-            lock_release (&buffer_head[idx].lock);*/
+    bool taken[BUFFER_CACHE_ENTRY_NB];
+    size_t cnt;
+    int idx;
+
+    memset (taken, 0, sizeof taken);
+    for (cnt = 0; cnt < max; cnt++) {
+        int best = -1;
+
+        /* 아직 고르지 않은 entry 중 hits가 가장 큰 것을 선택 */
+        for (idx = 0; idx < BUFFER_CACHE_ENTRY_NB; idx++) {
+            if (taken[idx] || !buffer_head[idx].valid
+                || buffer_head[idx].hits == 0)
+                continue;
+            if (best < 0 || buffer_head[idx].hits > buffer_head[best].hits)
+                best = idx;
+        }
+        if (best < 0)
+            break;
+        taken[best] = true;
+        sectors[cnt] = buffer_head[best].sector;
+    }
+    return cnt;
+}
+
+/* Queues SECTOR to be loaded into the buffer cache by the
+   read-ahead thread and returns at once.  Returns false if the
+   queue is full and the request was dropped. */
+bool bc_prefetch_async (block_sector_t sector) {
+
+    bool queued = false;
+
+    lock_acquire (&ra_lock);
+    if (ra_tail - ra_head < RA_QUEUE_SIZE) {
+        ra_queue[ra_tail++ % RA_QUEUE_SIZE] = sector;
+        cond_signal (&ra_cond, &ra_lock);
+        queued = true;
+    }
+    lock_release (&ra_lock);
+    return queued;
+}
+
+/* Makes SECTOR's buffer, if it is cached, the first candidate for
+   eviction, for data the caller does not expect to use again. */
+void bc_cool (block_sector_t sector) {
+
+    struct buffer_head *bf_head = bc_lookup (sector);
+
+    if (bf_head == NULL)
+        return;
+    lock_acquire (&bf_head->lock);
+    if (bf_head->sector == sector) {
+        bf_head->clock_bit = false;
+        bf_head->hits = 0;
+    }
+    lock_release (&bf_head->lock);
+}
+
+/* Loads the sectors queued by bc_prefetch_async(), oldest first.
+   Sectors queued one after another that are also consecutive on
+   disk, as sequential read-ahead queues them, are loaded
+   together. */
+static void read_ahead_thread (void *aux UNUSED) {
+
+    block_sector_t sector;
+    size_t cnt;
+
+    blocktrace_set_source (BLOCKTRACE_READAHEAD);
+    for (;;) {
+        lock_acquire (&ra_lock);
+        while (ra_head == ra_tail)
+            cond_wait (&ra_cond, &ra_lock);
+        sector = ra_queue[ra_head++ % RA_QUEUE_SIZE];
+        for (cnt = 1; cnt < RA_RUN_MAX && ra_head != ra_tail
+                      && ra_queue[ra_head % RA_QUEUE_SIZE] == sector + cnt;
+             cnt++)
+            ra_head++;
+        lock_release (&ra_lock);
+
+        lock_acquire (&ra_busy);
+        prefetch_run (sector, cnt);
+        lock_release (&ra_busy);
+    }
+}
+
+/* Loads the CNT consecutive sectors starting at SECTOR into the
+   buffer cache, skipping those already cached.  Each stretch of
+   uncached sectors gets its entries the way bc_get_entry() gives
+   one sector its entry, locked and registered under bc_lock, and
+   is then filled by a single block_read_multi(). */
+static void prefetch_run (block_sector_t sector, size_t cnt) {
+
+    struct buffer_head *run[RA_RUN_MAX];
+    size_t i = 0, n, j;
+
+    ASSERT (cnt <= RA_RUN_MAX);
+    while (i < cnt) {
+        lock_acquire (&bc_lock);
+        /* bc_write_direct()가 쓰고 있는 sector는 힌트이므로 건너뜀 */
+        while (i < cnt && (bc_lookup (sector + i)
+                           || direct_in_flight (sector + i, 1)))
+            i++;
+        for (n = 0; i + n < cnt && !bc_lookup (sector + i + n)
+                    && !direct_in_flight (sector + i + n, 1); n++) {
+            struct buffer_head *bf_head = bc_select_victim ();
+            if (bf_head == NULL)
+                break;
+            bf_head->dirty = false;
+            bf_head->valid = true;
+            bf_head->sector = sector + i + n;
+            run[n] = bf_head;
+        }
+        lock_release (&bc_lock);
+        if (n == 0)
+            break;
+
+        block_read_multi (fs_device, sector + i, n, ra_buffer);
+        for (j = 0; j < n; j++) {
+            memcpy (run[j]->data, ra_buffer + j * BLOCK_SECTOR_SIZE,
+                    BLOCK_SECTOR_SIZE);
+            lock_release (&run[j]->lock);
+        }
+        i += n;
+    }
+}
+
+/* Returns true if bc_write_direct() is writing any of the CNT
+   sectors starting at SECTOR.  Must be called with bc_lock
+   held. */
+static bool direct_in_flight (block_sector_t sector, size_t cnt) {
+
+    struct list_elem *e;
+
+    for (e = list_begin (&direct_writes); e != list_end (&direct_writes);
+         e = list_next (e)) {
+        struct direct_write *dw = list_entry (e, struct direct_write, elem);
+        if (sector < dw->sector + dw->cnt && dw->sector < sector + cnt)
+            return true;
+    }
+    return false;
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR into
+   BUFFER, a kernel buffer, without caching them.  Sectors that
+   are cached anyway are copied from the cache, which has the
+   latest contents; each stretch of the others is read from disk
+   with one block_read_multi(), without bc_lock, so it holds up no
+   one else's cache misses.  Direct writes to the run in progress
+   are waited for. */
+void bc_read_direct (block_sector_t sector, size_t cnt, void *buffer) {
+
+    enum blocktrace_source old;
+    size_t i = 0, n;
+
+    lock_acquire (&bc_lock);
+    while (direct_in_flight (sector, cnt))
+        cond_wait (&direct_done, &bc_lock);
+    lock_release (&bc_lock);
+
+    old = blocktrace_set_source (BLOCKTRACE_DIRECT);
+    while (i < cnt) {
+        struct buffer_head *bf_head;
+
+        /* cache에 있는 sector는 그 내용을 복사 */
+        lock_acquire (&bc_lock);
+        bf_head = bc_lookup (sector + i);
+        lock_release (&bc_lock);
+        if (bf_head != NULL) {
+            lock_acquire (&bf_head->lock);
+            /* lock을 기다리는 동안 다른 sector로 교체되었을 수 있음 */
+            if (bf_head->sector == sector + i) {
+                memcpy ((uint8_t *) buffer + i * BLOCK_SECTOR_SIZE,
+                        bf_head->data, BLOCK_SECTOR_SIZE);
+                lock_release (&bf_head->lock);
+                i++;
+                continue;
+            }
+            lock_release (&bf_head->lock);
+        }
+
+        /* cache에 없는 sector들은 한 번에 읽음 */
+        lock_acquire (&bc_lock);
+        for (n = 1; i + n < cnt && !bc_lookup (sector + i + n); n++)
+            continue;
+        lock_release (&bc_lock);
+        block_read_multi (fs_device, sector + i, n,
+                          (uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
+        i += n;
+    }
+    blocktrace_set_source (old);
+}
+
+/* Writes BUFFER, a kernel buffer, to the CNT consecutive sectors
+   starting at SECTOR without caching them, with as few
+   block_write_multi() calls as possible.  Cached copies would now
+   be stale, so they are dropped without being written back.
+   Rather than hold bc_lock across the write, the run is marked in
+   flight, so that a cache miss on it waits for the write instead
+   of loading the old contents. */
+void bc_write_direct (block_sector_t sector, size_t cnt,
+                      const void *buffer) {
+
+    struct direct_write dw;
+    enum blocktrace_source old;
+    size_t start = 0, i;
+
+    /* 겹치는 direct write는 차례로 */
+    lock_acquire (&bc_lock);
+    while (direct_in_flight (sector, cnt))
+        cond_wait (&direct_done, &bc_lock);
+    dw.sector = sector;
+    dw.cnt = cnt;
+    list_push_back (&direct_writes, &dw.elem);
+    lock_release (&bc_lock);
+
+    /* in flight인 동안에는 다시 cache에 올라오지 않음.
+       cache에 남겨야 하는 sector에서 run을 끊음 */
+    old = blocktrace_set_source (BLOCKTRACE_DIRECT);
+    for (i = 0; i < cnt; i++)
+        if (!drop_entry (sector + i,
+                         (const uint8_t *) buffer + i * BLOCK_SECTOR_SIZE)) {
+            block_write_multi (fs_device, sector + start, i - start,
+                               (const uint8_t *) buffer
+                               + start * BLOCK_SECTOR_SIZE);
+            start = i + 1;
+        }
+    block_write_multi (fs_device, sector + start, cnt - start,
+                       (const uint8_t *) buffer + start * BLOCK_SECTOR_SIZE);
+    blocktrace_set_source (old);
+
+    lock_acquire (&bc_lock);
+    list_remove (&dw.elem);
+    cond_broadcast (&direct_done, &bc_lock);
+    lock_release (&bc_lock);
+}
+
+/* Drops the cached copy of SECTOR, which a direct write of DATA
+   makes stale.  Returns false if it cannot be dropped because the
+   journal has it pinned; it is then given DATA and left for the
+   commit to write. */
+static bool drop_entry (block_sector_t sector, const void *data) {
+
+    struct buffer_head *bf_head;
+    bool dropped = true;
+
+    lock_acquire (&bc_lock);
+    bf_head = bc_lookup (sector);
+    lock_release (&bc_lock);
+    if (bf_head == NULL)
+        return true;
+
+    lock_acquire (&bf_head->lock);
+    if (bf_head->sector == sector) {
+        /* journal commit을 기다리는 entry는 버릴 수 없으므로 갱신 */
+        if (bf_head->pinned) {
+            memcpy (bf_head->data, data, BLOCK_SECTOR_SIZE);
+            bf_head->dirty = true;
+            dropped = false;
+        }
+        else {
+            bf_head->dirty = false;
+            bf_head->valid = false;
+            bf_head->sector = -1;
+            bf_head->clock_bit = false;
+            bf_head->hits = 0;
         }
     }
+    lock_release (&bf_head->lock);
+    return dropped;
 }
@@ -1,11 +1,18 @@
 #ifndef FILESYS_BUFFER_CACHE_H
 #define FILESYS_BUFFER_CACHE_H
 
+#include <stddef.h>
+#include "devices/block.h"
 #include "threads/synch.h"
+#include "filesys/off_t.h"
 
 
 #define BUFFER_CACHE_ENTRY_NB 64
 
+/* Most buffers the journal keeps pinned at once, so that enough
+   are left for everything else. */
+#define BC_PIN_MAX (BUFFER_CACHE_ENTRY_NB / 2)
+
 
 
 /* buffer cache entry */
@@ -15,7 +22,9 @@ struct buffer_head
     bool valid;  //해당entry의사용여부를나타내는flag        
     block_sector_t sector;  //해당 entry의 disk sector 주소 
     bool clock_bit;     //clock algorithm을위한clock bit
+    unsigned hits;      //cache에 올라온 뒤 접근 횟수 (warm-up 목록용)
     struct lock lock;   //lock 변수(structlock)
+    bool pinned;        //journal commit 전까지 디스크에 쓰면 안 됨
     void *data;         //buffer cache entry를 가리키기 위한 데이터 포인터
 };
 
@@ -23,6 +32,20 @@ bool bc_read (block_sector_t sector_idx, void *buffer,
               off_t buffer_ofs, int chunk_size, int sector_ofs);
 bool bc_write (block_sector_t sector_idx, void *buffer, 
                off_t buffer_ofs, int chunk_size, int sector_ofs);
+bool bc_copy (block_sector_t dst_idx, int dst_ofs, block_sector_t src_idx,
+              int src_ofs, int chunk_size);
+bool bc_write_meta (block_sector_t sector_idx, void *buffer,
+                    off_t buffer_ofs, int chunk_size, int sector_ofs);
+bool bc_copy_meta (block_sector_t dst_idx, int dst_ofs,
+                   block_sector_t src_idx, int src_ofs, int chunk_size);
+void bc_unpin (block_sector_t sector);
+void bc_prefetch (block_sector_t sector);
+bool bc_prefetch_async (block_sector_t sector);
+void bc_cool (block_sector_t sector);
+void bc_read_direct (block_sector_t sector, size_t cnt, void *buffer);
+void bc_write_direct (block_sector_t sector, size_t cnt,
+                      const void *buffer);
+size_t bc_hottest (block_sector_t *sectors, size_t max);
 void bc_init (void);
 void bc_term (void);
 struct buffer_head *bc_lookup (block_sector_t sector);
@@ -0,0 +1,161 @@
+#include "filesys/defrag.h"
+#include <debug.h>
+#include <list.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Online defragmenter.
+
+   Files grown by many small appends end up with their sectors
+   scattered over the disk.  A kernel thread at the lowest
+   priority walks the directory tree every DEFRAG_TICKS and, for
+   each regular file whose data is split into several runs,
+   waits until the disk has been idle for DEFRAG_IDLE_TICKS and
+   then lets inode_defrag() move the file into one run.
+
+   inode_defrag() coordinates with readers and writers of the
+   file through the inode's lock: it only starts on a file with
+   no access in progress, and accesses that start meanwhile wait
+   until the new map entries are in place. */
+
+/* Interval between passes over the tree. */
+#define DEFRAG_TICKS (10 * TIMER_FREQ)
+
+/* How long the disk must see no I/O before a file is moved. */
+#define DEFRAG_IDLE_TICKS (TIMER_FREQ / 2)
+
+/* Held by the defrag thread while it is awake.  defrag_done()
+   takes it for good. */
+static struct lock defrag_lock;
+
+/* A directory still to be visited by the current pass. */
+struct pending_dir
+  {
+    struct list_elem elem;
+    block_sector_t sector;
+  };
+
+static void defrag_thread (void *aux);
+static void defrag_tree (void);
+static bool read_entry (struct dir *, struct inode **);
+static void wait_for_idle (void);
+
+/* Starts the defrag thread. */
+void
+defrag_init (void)
+{
+  lock_init (&defrag_lock);
+  if (thread_create ("defrag", PRI_MIN, defrag_thread, NULL) == TID_ERROR)
+    PANIC ("could not start defrag thread");
+}
+
+/* Stops the defrag thread before the file system goes away.
+   Waits for a file being moved to be finished. */
+void
+defrag_done (void)
+{
+  lock_acquire (&defrag_lock);
+}
+
+/* Defrag thread. */
+static void
+defrag_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (DEFRAG_TICKS);
+      lock_acquire (&defrag_lock);
+      defrag_tree ();
+      lock_release (&defrag_lock);
+    }
+}
+
+/* Visits every regular file in the tree once and moves the
+   fragmented ones.  Uses an explicit work list, like the inode
+   count at mount, instead of recursion. */
+static void
+defrag_tree (void)
+{
+  struct list pending;
+  struct dir *dir = dir_open_root ();
+
+  list_init (&pending);
+  while (dir != NULL)
+    {
+      struct inode *inode;
+
+      while (read_entry (dir, &inode))
+        {
+          if (inode == NULL)
+            continue;
+          if (inode_is_dir (inode))
+            {
+              struct pending_dir *p = malloc (sizeof *p);
+              if (p != NULL)
+                {
+                  p->sector = inode_get_inumber (inode);
+                  list_push_back (&pending, &p->elem);
+                }
+            }
+          else if (inode_extent_cnt (inode) > 1)
+            {
+              wait_for_idle ();
+              inode_defrag (inode);
+            }
+          inode_close (inode);
+        }
+      dir_close (dir);
+
+      dir = NULL;
+      if (!list_empty (&pending))
+        {
+          struct pending_dir *p = list_entry (list_pop_front (&pending),
+                                              struct pending_dir, elem);
+          dir = dir_open (inode_open (p->sector));
+          free (p);
+        }
+    }
+}
+
+/* Reads the next entry of DIR and opens it into *INODE, or sets
+   *INODE to null for "." and "..".  Returns false at the end of
+   DIR.  Takes the same lock as filesys_open(), so that the entry
+   is not replaced while it is looked up. */
+static bool
+read_entry (struct dir *dir, struct inode **inode)
+{
+  char name[NAME_MAX + 1];
+  bool found;
+
+  *inode = NULL;
+  lock_acquire (&file_sys_lock);
+  found = dir_readdir (dir, name);
+  if (found && strcmp (name, ".") && strcmp (name, ".."))
+    dir_lookup (dir, name, inode);
+  lock_release (&file_sys_lock);
+  return found;
+}
+
+/* Sleeps until the file system device has done no I/O for
+   DEFRAG_IDLE_TICKS.  Lets defrag_done() in while asleep. */
+static void
+wait_for_idle (void)
+{
+  unsigned long long io_cnt;
+
+  do
+    {
+      io_cnt = block_io_cnt (fs_device);
+      lock_release (&defrag_lock);
+      timer_sleep (DEFRAG_IDLE_TICKS);
+      lock_acquire (&defrag_lock);
+    }
+  while (block_io_cnt (fs_device) != io_cnt);
+}
@@ -4,6 +4,7 @@
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/superblock.h"
 #include "threads/malloc.h"
 #include "filesys/buffer_cache.h"
 
@@ -55,7 +56,7 @@ dir_open (struct inode *inode)
 struct dir *
 dir_open_root (void)
 {
-  return dir_open (inode_open (ROOT_DIR_SECTOR));
+  return dir_open (inode_open (superblock_get ()->root_dir_sector));
 }
 
 /* Opens and returns a new directory for the same inode as DIR.
@@ -11,6 +11,15 @@
    retained, but much longer full path names must be allowed. */
 #define NAME_MAX 14
 
+/* Journal credits, see journal_begin(), that dir_add() or
+   dir_remove() can use: the two sectors an entry may straddle,
+   plus growing the directory by a sector. */
+#define DIR_ENTRY_CREDITS 8
+
+/* Journal credits that dir_create() can use for a directory of
+   at most one sector: the sector and the inode. */
+#define DIR_CREATE_CREDITS 2
+
 struct inode;
 
 /* Opening and closing directories. */
@@ -10,8 +10,13 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    bool direct;                /* Whole sectors bypass the cache? */
   };
 
+static off_t read_at (struct file *, void *, off_t size, off_t file_ofs);
+static off_t write_at (struct file *, const void *, off_t size,
+                       off_t file_ofs);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -24,6 +29,7 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->direct = false;
       return file;
     }
   else
@@ -39,7 +45,11 @@ file_open (struct inode *inode)
 struct file *
 file_reopen (struct file *file) 
 {
-  return file_open (inode_reopen (file->inode));
+  struct file *new_file = file_open (inode_reopen (file->inode));
+
+  if (new_file != NULL)
+    new_file->direct = file->direct;
+  return new_file;
 }
 
 /* Closes FILE. */
@@ -70,7 +80,7 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read = read_at (file, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -83,7 +93,7 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  return read_at (file, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -96,7 +106,7 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written = write_at (file, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -112,7 +122,64 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
-  return inode_write_at (file->inode, buffer, size, file_ofs);
+  return write_at (file, buffer, size, file_ofs);
+}
+
+/* Reads into the IOVCNT segments of IOV from FILE, starting at
+   the file's current position, filling each segment in turn.
+   Returns the number of bytes actually read, which may be less
+   than the total length of IOV if end of file is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, int iovcnt)
+{
+  off_t bytes_read = inode_readv_at (file->inode, iov, iovcnt, file->pos,
+                                    file->direct);
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Writes the IOVCNT segments of IOV into FILE back to back,
+   starting at the file's current position.
+   Returns the number of bytes actually written.
+   Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, int iovcnt)
+{
+  off_t bytes_written = inode_writev_at (file->inode, iov, iovcnt,
+                                         file->pos, file->direct);
+  file->pos += bytes_written;
+  return bytes_written;
+}
+
+/* Copies SIZE bytes from SRC, starting at SRC's current position,
+   into DST at DST's current position, without a round trip
+   through a user buffer.
+   Returns the number of bytes actually copied, which may be less
+   than SIZE if end of SRC is reached, or -1 if SRC and DST are
+   the same file and the ranges overlap.
+   Advances both positions by the number of bytes copied. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  off_t bytes_copied = inode_copy_range (src->inode, src->pos,
+                                         dst->inode, dst->pos, size);
+  if (bytes_copied > 0)
+    {
+      src->pos += bytes_copied;
+      dst->pos += bytes_copied;
+    }
+  return bytes_copied;
+}
+
+/* Makes whole-sector reads and writes through FILE bypass the
+   buffer cache if DIRECT is true, or go through it again if
+   false.  Partial sectors always use the cache. */
+void
+file_set_direct (struct file *file, bool direct) 
+{
+  ASSERT (file != NULL);
+  file->direct = direct;
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -169,3 +236,28 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Reads SIZE bytes at FILE_OFS from FILE's inode, around the
+   cache if FILE is direct. */
+static off_t
+read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
+{
+  struct iovec iov;
+
+  iov.iov_base = buffer;
+  iov.iov_len = size;
+  return inode_readv_at (file->inode, &iov, 1, file_ofs, file->direct);
+}
+
+/* Writes SIZE bytes at FILE_OFS to FILE's inode, around the cache
+   if FILE is direct. */
+static off_t
+write_at (struct file *file, const void *buffer, off_t size,
+          off_t file_ofs) 
+{
+  struct iovec iov;
+
+  iov.iov_base = (void *) buffer;
+  iov.iov_len = size;
+  return inode_writev_at (file->inode, &iov, 1, file_ofs, file->direct);
+}
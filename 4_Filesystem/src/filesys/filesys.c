@@ -1,5 +1,6 @@
 #include "filesys/filesys.h"
 #include <debug.h>
+#include <list.h>
 #include <stdio.h>
 #include <string.h>
 #include "filesys/file.h"
@@ -7,6 +8,12 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/buffer_cache.h"
+#include "filesys/refcount.h"
+#include "filesys/superblock.h"
+#include "filesys/journal.h"
+#include "filesys/defrag.h"
+#include "filesys/orphan.h"
+#include "filesys/warmup.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
 
@@ -15,7 +22,11 @@ struct block *fs_device;
 
 struct lock file_sys_lock;
 
+/* Serializes filesys_clone(), see orphan_hold(). */
+static struct lock clone_lock;
+
 static void do_format (void);
+static uint32_t count_inodes (struct dir *);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -29,15 +40,34 @@ filesys_init (bool format)
   bc_init();
   inode_init ();
   lock_init(&file_sys_lock);
+  lock_init (&clone_lock);
+  superblock_init ();
   free_map_init ();
 
 
   if (format) 
     do_format ();
 
+  /* 깨끗하게 unmount되었다면 superblock의 카운터를 그대로 사용 */
+  bool clean = superblock_mount ();
+  /* unclean이면 journal의 commit된 transaction을 먼저 반영 */
+  journal_open (clean);
   free_map_open ();
+  refcount_open ();
+  orphan_open ();
+  /* 지난 unmount 때 자주 쓰던 sector를 미리 cache로 읽어 둠 */
+  warmup_open ();
+  if (!clean) 
+    {
+      struct dir *root = dir_open_root ();
+      printf ("File system was not cleanly unmounted, recounting...");
+      superblock_set_counts (free_map_count_free (), count_inodes (root));
+      dir_close (root);
+      printf ("done.\n");
+    }
   /* struct thread에서 추가한 필드를 root 디렉터리로 설정 */
   thread_current() -> cur_dir = dir_open_root();
+  defrag_init ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -45,7 +75,16 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  /* 파일을 옮기는 중이면 끝날 때까지 기다림 */
+  defrag_done ();
+  orphan_close ();
+  journal_close ();
+  refcount_close ();
   free_map_close ();
+  warmup_close ();
+  /* 모든 데이터가 디스크에 기록된 후에 clean 표시 */
+  bc_term ();
+  superblock_unmount ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -77,21 +116,39 @@ filesys_create (const char *name, off_t initial_size)
       return NULL;
   }
 
+  journal_begin (2 * FREE_MAP_CREDITS (1) + 1 + DIR_ENTRY_CREDITS);
   lock_acquire (&file_sys_lock);
 
   /* inode의is_dir값설정*/
   /* 추가되는디렉터리엔트리의이름을file_name으로수정*/
   bool success = (dir != NULL
           && free_map_allocate (1, &inode_sector)
-          && inode_create (inode_sector, initial_size, 0)
+          && inode_create (inode_sector, 0, 0)
           && dir_add (dir, file_name, inode_sector));
 
+  if (success)
+      superblock_add_inodes (1);
   if (!success && inode_sector != 0) 
       free_map_release (inode_sector, 1);
 
-  dir_close (dir);
-
   lock_release(&file_sys_lock);
+  journal_end ();
+
+  /* initial_size만큼의 할당은 한 transaction에 담기지 않을 수 있으므로
+     파일을 만든 뒤 따로 확장하고, 실패하면 파일을 지움 */
+  if (success && initial_size > 0) {
+      struct inode *inode = inode_open (inode_sector);
+      if (inode == NULL || !inode_extend (inode, initial_size)) {
+          journal_begin (DIR_ENTRY_CREDITS + ORPHAN_CREDITS);
+          lock_acquire (&file_sys_lock);
+          dir_remove (dir, file_name);
+          lock_release (&file_sys_lock);
+          journal_end ();
+          success = false;
+      }
+      inode_close (inode);
+  }
+  dir_close (dir);
   return success;
 }
 
@@ -171,6 +228,8 @@ filesys_remove (const char *name)
         dir_lookup(dir, file_name, &inode);
 
     bool success = false;
+    /* 엔트리 삭제와 블록 해제를 한 transaction으로 */
+    journal_begin (DIR_ENTRY_CREDITS + ORPHAN_CREDITS);
 
   if (inode!= NULL && inode_is_dir(inode)) {
       /* 디렉터리가삭제가능한지판단*/
@@ -197,11 +256,69 @@ filesys_remove (const char *name)
       success = dir != NULL && dir_remove(dir, file_name);
   }
   inode_close (inode);
+  dir_close (dir);
+  journal_end ();
+  return success;
+}
+
+
+/* Creates a file named NAME that is a copy-on-write clone of the
+   open file SRC, sharing all of SRC's data sectors.  Writes to
+   SRC wait until the clone is done.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists, if SRC is a
+   directory, or if internal memory or disk allocation fails. */
+bool
+filesys_clone (struct file *src, const char *name)
+{
+  block_sector_t inode_sector = 0;
+
+  if (inode_is_dir (file_get_inode (src)))
+      return false;
+
+  int name_len = strlen(name) + 1;
+  char *cp_name = malloc(name_len);
+  if (!cp_name)
+      return false;
+  strlcpy (cp_name, name, name_len);
+
+  struct dir *dir;
+  char file_name[NAME_MAX + 1];
+  dir = parse_path (cp_name, file_name);
+  free (cp_name);
+
+  if (!dir)
+      return false;
+  if (inode_is_removed(dir_get_inode(dir))) {
+      dir_close (dir);
+      return false;
+  }
+
+  /* 복제는 여러 transaction에 걸쳐 진행되므로 handle 밖에서 하고,
+     한 번에 하나씩만 함 */
+  lock_acquire (&clone_lock);
+  bool success = inode_clone (file_get_inode (src), &inode_sector);
+
+  if (success) {
+      journal_begin (DIR_ENTRY_CREDITS + ORPHAN_CREDITS);
+      lock_acquire (&file_sys_lock);
+
+      /* 디렉터리에 넣지 못하면 reclaim thread가 복제본을 지우면서
+         공유한 블록의 참조를 되돌림 */
+      success = dir_add (dir, file_name, inode_sector);
+      if (success)
+          superblock_add_inodes (1);
+      orphan_unhold (inode_sector, !success);
+
+      lock_release (&file_sys_lock);
+      journal_end ();
+  }
+  lock_release (&clone_lock);
+
   dir_close (dir);
   return success;
 }
 
-  
 /* Formats the file system. */
 static void
 do_format (void)
@@ -211,17 +328,80 @@ do_format (void)
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
 
-  struct dir *root_dir = dir_open_root();
+  /* 아직 superblock이 없으므로 dir_open_root() 대신 직접 open */
+  struct dir *root_dir = dir_open (inode_open (ROOT_DIR_SECTOR));
   if(!dir_add(root_dir, ".", ROOT_DIR_SECTOR))
       PANIC ("root directory init of '.' failed");
   if(!dir_add(root_dir, "..", ROOT_DIR_SECTOR))
       PANIC ("root directory init of '..' failed");
   dir_close(root_dir);
 
+  refcount_create ();
+  orphan_create ();
+  warmup_create ();
+  block_sector_t journal_sector;
+  uint32_t journal_cnt;
+  journal_create (&journal_sector, &journal_cnt);
+  superblock_format (free_map_count_free (), journal_sector, journal_cnt);
   free_map_close ();
   printf ("done.\n");
 }
 
+/* A directory still to be visited by count_inodes(). */
+struct pending_dir
+  {
+    struct list_elem elem;
+    block_sector_t sector;
+  };
+
+/* Returns the number of files and directories in the tree rooted
+   at ROOT, including ROOT itself.  Used to rebuild the
+   superblock's inode count after an unclean shutdown.  Walks the
+   tree with an explicit work list, since directories can nest
+   deeper than the kernel stack allows recursion. */
+static uint32_t
+count_inodes (struct dir *root)
+{
+  struct list pending;
+  struct dir *dir = dir_reopen (root);
+  char name[NAME_MAX + 1];
+  uint32_t cnt = 1;
+
+  list_init (&pending);
+  while (dir != NULL)
+    {
+      struct inode *inode;
+
+      while (dir_readdir (dir, name))
+        {
+          if (!strcmp (name, ".") || !strcmp (name, "..")
+              || !dir_lookup (dir, name, &inode))
+            continue;
+          cnt++;
+          if (inode_is_dir (inode))
+            {
+              struct pending_dir *p = malloc (sizeof *p);
+              if (p == NULL)
+                PANIC ("out of memory counting inodes");
+              p->sector = inode_get_inumber (inode);
+              list_push_back (&pending, &p->elem);
+            }
+          inode_close (inode);
+        }
+      dir_close (dir);
+
+      dir = NULL;
+      if (!list_empty (&pending))
+        {
+          struct pending_dir *p = list_entry (list_pop_front (&pending),
+                                              struct pending_dir, elem);
+          dir = dir_open (inode_open (p->sector));
+          free (p);
+        }
+    }
+  return cnt;
+}
+
 
 
 //Root디렉터리에 파일생성을 name경로에 파일 생성하도록 변경
@@ -247,6 +427,8 @@ bool filesys_create_dir(const char *name) {
         return NULL;
 
     struct dir *newDir = NULL;
+    journal_begin (2 * FREE_MAP_CREDITS (1) + DIR_CREATE_CREDITS
+                   + DIR_ENTRY_CREDITS + 1);
  
     /* bitmap에서 inode sector 번호 할당 */
     /* 할당받은 sector에 file_name의 디렉터리 생성 */
@@ -259,10 +441,13 @@ bool filesys_create_dir(const char *name) {
             && (newDir = dir_open (inode_open (inode_sector)))
             && dir_add (newDir, ".", inode_sector)
             && dir_add (newDir, "..", inode_get_inumber (dir_get_inode (dir))));
+   if (success)
+        superblock_add_inodes (1);
    if (!success && inode_sector != 0)
         free_map_release (inode_sector, 1);
     dir_close (dir);
     dir_close (newDir);
+    journal_end ();
 
     return success;
 }
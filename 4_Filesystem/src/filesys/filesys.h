@@ -3,19 +3,28 @@
 
 #include <stdbool.h>
 #include "filesys/off_t.h"
+#include "threads/synch.h"
 
-/* Sectors of system file inodes. */
-#define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
-#define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+/* Sectors of system file inodes, as laid out by a format.
+   A mounted file system finds them through the superblock. */
+#define FREE_MAP_SECTOR 1       /* Free map file inode sector. */
+#define ROOT_DIR_SECTOR 2       /* Root directory file inode sector. */
+#define REFCOUNT_SECTOR 3       /* Sector refcount file inode sector. */
+#define ORPHAN_SECTOR 4         /* Orphan list head sector. */
+#define WARMUP_SECTOR 5         /* Buffer cache warm-up list. */
 
 /* Block device that contains the file system. */
 struct block *fs_device;
 
+/* Serializes directory updates and lookups. */
+extern struct lock file_sys_lock;
+
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_clone (struct file *src, const char *name);
 
 bool filesys_create_dir(const char *name);
 struct dir* parse_path (char *path_name, char *file_name);
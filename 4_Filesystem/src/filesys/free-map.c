@@ -1,62 +1,234 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <list.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/superblock.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
+/* A sector can be in use in memory but free on disk for two
+   reasons: it is reserved by free_map_reserve() and not yet
+   confirmed, or it was freed while its journal revocation could
+   not be recorded and must not be reused until the log is
+   emptied.  Only DISK_MAP is ever written to the file. */
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *disk_map;      /* Free map as on disk. */
+static struct list held;             /* Freed sectors held back. */
+static struct lock free_map_lock;    /* Protects the fields above. */
+
+/* A run of sectors freed on disk but held back from reuse. */
+struct held_run
+  {
+    struct list_elem elem;
+    block_sector_t start;               /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    uint32_t checkpoints;               /* journal_checkpoints() then. */
+  };
+
+static void hold (block_sector_t);
+static void unhold (void);
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  disk_map = bitmap_create (block_size (fs_device));
+  if (free_map == NULL || disk_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
+  list_init (&held);
+  bitmap_mark (free_map, SUPERBLOCK_SECTOR);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, REFCOUNT_SECTOR);
+  bitmap_mark (free_map, ORPHAN_SECTOR);
+  bitmap_mark (free_map, WARMUP_SECTOR);
+  bitmap_mark (disk_map, SUPERBLOCK_SECTOR);
+  bitmap_mark (disk_map, FREE_MAP_SECTOR);
+  bitmap_mark (disk_map, ROOT_DIR_SECTOR);
+  bitmap_mark (disk_map, REFCOUNT_SECTOR);
+  bitmap_mark (disk_map, ORPHAN_SECTOR);
+  bitmap_mark (disk_map, WARMUP_SECTOR);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
-   written. */
+   written.  Only the part of the file holding the changed bits
+   is written back, so that a transaction does not log the whole
+   bitmap. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  /* 시스템 thread(defrag 등)도 할당하므로 syscall lock에 의존하지 않음 */
+  lock_acquire (&free_map_lock);
+  unhold ();
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (disk_map, sector, cnt, true);
+      if (free_map_file != NULL
+          && !bitmap_write_range (disk_map, free_map_file, sector, cnt))
+        {
+          bitmap_set_multiple (free_map, sector, cnt, false); 
+          bitmap_set_multiple (disk_map, sector, cnt, false); 
+          sector = BITMAP_ERROR;
+        }
+    }
+  if (sector != BITMAP_ERROR) 
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      *sectorp = sector;
+      superblock_add_free (-(int) cnt);
     }
+  lock_release (&free_map_lock);
+  return sector != BITMAP_ERROR;
+}
+
+/* Like free_map_allocate(), but only marks the sectors in use in
+   memory, so that an allocation too large for one journal
+   transaction can be written out piece by piece with
+   free_map_confirm().  Whatever is not confirmed must be given
+   back with free_map_cancel(); after a crash it is simply free. */
+bool
+free_map_reserve (size_t cnt, block_sector_t *sectorp)
+{
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  unhold ();
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      *sectorp = sector;
+      superblock_add_free (-(int) cnt);
+    }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Writes CNT sectors starting at SECTOR, reserved with
+   free_map_reserve(), to the free map file as allocated. */
+void
+free_map_confirm (block_sector_t sector, size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (bitmap_all (free_map, sector, cnt));
+  ASSERT (bitmap_none (disk_map, sector, cnt));
+  bitmap_set_multiple (disk_map, sector, cnt, true);
+  bitmap_write_range (disk_map, free_map_file, sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Gives back CNT sectors starting at SECTOR, reserved with
+   free_map_reserve() and never confirmed. */
+void
+free_map_cancel (block_sector_t sector, size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (bitmap_all (free_map, sector, cnt));
+  ASSERT (bitmap_none (disk_map, sector, cnt));
+  bitmap_set_multiple (free_map, sector, cnt, false);
+  superblock_add_free (cnt);
+  lock_release (&free_map_lock);
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  size_t i;
+
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  ASSERT (bitmap_all (disk_map, sector, cnt));
+  /* 로그에 남은 예전 metadata가 재사용된 섹터를 덮어쓰지 않도록.
+     revoke를 기록할 수 없으면 로그가 비워질 때까지 재사용하지 않음 */
+  for (i = 0; i < cnt; i++)
+    if (journal_revoke (sector + i))
+      bitmap_reset (free_map, sector + i);
+    else
+      hold (sector + i);
+  bitmap_set_multiple (disk_map, sector, cnt, false);
+  bitmap_write_range (disk_map, free_map_file, sector, cnt);
+  superblock_add_free (cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Keeps SECTOR, freed on disk, from being reused until the log
+   is next emptied. */
+static void
+hold (block_sector_t sector)
+{
+  uint32_t checkpoints = journal_checkpoints ();
+  struct held_run *run;
+
+  if (!list_empty (&held))
+    {
+      run = list_entry (list_back (&held), struct held_run, elem);
+      if (run->start + run->cnt == sector && run->checkpoints == checkpoints)
+        {
+          run->cnt++;
+          return;
+        }
+    }
+  run = malloc (sizeof *run);
+  if (run == NULL)
+    return;                     /* Leaked until the next mount. */
+  run->start = sector;
+  run->cnt = 1;
+  run->checkpoints = checkpoints;
+  list_push_back (&held, &run->elem);
+}
+
+/* Makes the sectors held back by hold() available again once the
+   log has been emptied since. */
+static void
+unhold (void)
+{
+  uint32_t checkpoints = journal_checkpoints ();
+
+  while (!list_empty (&held))
+    {
+      struct held_run *run = list_entry (list_front (&held),
+                                         struct held_run, elem);
+      if (run->checkpoints == checkpoints)
+        break;
+      bitmap_set_multiple (free_map, run->start, run->cnt, false);
+      list_remove (&run->elem);
+      free (run);
+    }
+}
+
+/* Returns the number of free sectors, counted from the bitmap. */
+size_t
+free_map_count_free (void) 
+{
+  size_t cnt;
+
+  lock_acquire (&free_map_lock);
+  cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+  lock_release (&free_map_lock);
+  return cnt;
 }
 
 /* Opens the free map file and reads it from disk. */
 void
 free_map_open (void) 
 {
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+  free_map_file = file_open (inode_open (superblock_get ()->free_map_sector));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  if (!bitmap_read (free_map, free_map_file)
+      || !bitmap_read (disk_map, free_map_file))
     PANIC ("can't read free map");
 }
 
@@ -80,6 +252,6 @@ free_map_create (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (disk_map, free_map_file))
     PANIC ("can't write free map");
 }
@@ -3,8 +3,15 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <round.h>
 #include "devices/block.h"
 
+/* Journal credits, see journal_begin(), that allocating or
+   freeing a run of CNT sectors can use: the sectors of the free
+   map file that hold their bits. */
+#define FREE_MAP_CREDITS(CNT) \
+        (DIV_ROUND_UP ((CNT) - 1, BLOCK_SECTOR_SIZE * 8) + 1)
+
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
@@ -13,5 +20,9 @@ void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+bool free_map_reserve (size_t, block_sector_t *);
+void free_map_confirm (block_sector_t, size_t);
+void free_map_cancel (block_sector_t, size_t);
+size_t free_map_count_free (void);
 
 #endif /* filesys/free-map.h */
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,8 +8,11 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* List files in the root directory. */
@@ -67,42 +71,95 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Archive extraction is a pipeline.  A reader thread streams the
+   scratch device into a ring of EXTRACT_BUFFERS chunks of
+   EXTRACT_CHUNK_SECTORS consecutive sectors each, while
+   fsutil_extract() takes headers and file data out of the chunks
+   already filled and writes them to the file system, so reading
+   the archive overlaps with writing the files. */
+#define EXTRACT_CHUNK_PAGES 8
+#define EXTRACT_CHUNK_SECTORS (EXTRACT_CHUNK_PAGES * PGSIZE \
+                               / BLOCK_SECTOR_SIZE)
+#define EXTRACT_BUFFERS 4
+
+/* A chunk of the archive. */
+struct extract_chunk
+  {
+    uint8_t *data;              /* EXTRACT_CHUNK_SECTORS sectors. */
+    size_t cnt;                 /* Sectors filled, 0 at end of device. */
+  };
+
+/* The ring between the reader thread and fsutil_extract(). */
+struct extract_stream
+  {
+    struct block *src;                  /* Scratch device. */
+    struct extract_chunk chunks[EXTRACT_BUFFERS];
+    unsigned head;                      /* Next chunk to consume. */
+    unsigned tail;                      /* Next chunk to fill. */
+    size_t pos;                         /* Sectors consumed from head. */
+    struct lock lock;                   /* Protects head, tail, stop. */
+    struct condition filled;            /* Signaled when tail advances. */
+    struct condition emptied;           /* Signaled when head advances. */
+    bool stop;                          /* Tells the reader to quit. */
+    struct semaphore reader_done;       /* Upped when the reader quits. */
+  };
+
+static void extract_reader (void *stream_);
+static const uint8_t *extract_next (struct extract_stream *, size_t want,
+                                    size_t *cnt);
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.  Each file is preallocated
+   at the size in its header and written a chunk at a time,
+   around the buffer cache. */
 void
 fsutil_extract (char **argv UNUSED) 
 {
-  static block_sector_t sector = 0;
-
-  struct block *src;
-  void *header, *data;
+  struct extract_stream stream;
+  void *header;
+  int i;
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
+  if (header == NULL)
     PANIC ("couldn't allocate buffers");
+  for (i = 0; i < EXTRACT_BUFFERS; i++)
+    stream.chunks[i].data = palloc_get_multiple (PAL_ASSERT,
+                                                 EXTRACT_CHUNK_PAGES);
 
   /* Open source block device. */
-  src = block_get_role (BLOCK_SCRATCH);
-  if (src == NULL)
+  stream.src = block_get_role (BLOCK_SCRATCH);
+  if (stream.src == NULL)
     PANIC ("couldn't open scratch device");
 
   printf ("Extracting ustar archive from scratch device "
           "into file system...\n");
 
+  /* Start reading ahead. */
+  stream.head = stream.tail = 0;
+  stream.pos = 0;
+  lock_init (&stream.lock);
+  cond_init (&stream.filled);
+  cond_init (&stream.emptied);
+  stream.stop = false;
+  sema_init (&stream.reader_done, 0);
+  if (thread_create ("extract_reader", PRI_DEFAULT, extract_reader, &stream)
+      == TID_ERROR)
+    PANIC ("couldn't start reader thread");
+
   for (;;)
     {
       const char *file_name;
       const char *error;
       enum ustar_type type;
       int size;
+      size_t cnt;
 
       /* Read and parse ustar header. */
-      block_read (src, sector++, header);
+      memcpy (header, extract_next (&stream, 1, &cnt), BLOCK_SECTOR_SIZE);
       error = ustar_parse_header (header, &file_name, &type, &size);
       if (error != NULL)
-        PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector - 1, error);
+        PANIC ("bad ustar header (%s)", error);
 
       if (type == USTAR_EOF)
         {
@@ -117,20 +174,30 @@ fsutil_extract (char **argv UNUSED)
 
           printf ("Putting '%s' into the file system...\n", file_name);
 
-          /* Create destination file. */
-          if (!filesys_create (file_name, size))
+          /* Create destination file.  Reserving its sectors up
+             front puts them in one run without zeroing them;
+             if that fails, the writes extend the file instead. */
+          if (!filesys_create (file_name, 0))
             PANIC ("%s: create failed", file_name);
           dst = filesys_open (file_name);
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
+          if (size > 0)
+            inode_fallocate (file_get_inode (dst), 0, size);
+          file_set_direct (dst, true);
 
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
+              const uint8_t *data;
+              int chunk_size;
+
+              data = extract_next (&stream, DIV_ROUND_UP (size,
+                                                          BLOCK_SECTOR_SIZE),
+                                   &cnt);
+              chunk_size = cnt * BLOCK_SECTOR_SIZE;
+              if (chunk_size > size)
+                chunk_size = size;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -142,19 +209,98 @@ fsutil_extract (char **argv UNUSED)
         }
     }
 
+  /* Stop the reader, which may be waiting for a free chunk. */
+  lock_acquire (&stream.lock);
+  stream.stop = true;
+  cond_signal (&stream.emptied, &stream.lock);
+  lock_release (&stream.lock);
+  sema_down (&stream.reader_done);
+
   /* Erase the ustar header from the start of the block device,
      so that the extraction operation is idempotent.  We erase
      two blocks because two blocks of zeros are the ustar
      end-of-archive marker. */
   printf ("Erasing ustar archive...\n");
   memset (header, 0, BLOCK_SECTOR_SIZE);
-  block_write (src, 0, header);
-  block_write (src, 1, header);
+  block_write (stream.src, 0, header);
+  block_write (stream.src, 1, header);
 
-  free (data);
+  for (i = 0; i < EXTRACT_BUFFERS; i++)
+    palloc_free_multiple (stream.chunks[i].data, EXTRACT_CHUNK_PAGES);
   free (header);
 }
 
+/* Reader thread for fsutil_extract().  Fills the chunks of
+   STREAM_ with consecutive sectors of the scratch device, from
+   its start, until told to stop or the device ends. */
+static void
+extract_reader (void *stream_) 
+{
+  struct extract_stream *stream = stream_;
+  block_sector_t sector = 0;
+  block_sector_t size = block_size (stream->src);
+
+  for (;;)
+    {
+      struct extract_chunk *chunk;
+
+      lock_acquire (&stream->lock);
+      while (stream->tail - stream->head == EXTRACT_BUFFERS && !stream->stop)
+        cond_wait (&stream->emptied, &stream->lock);
+      if (stream->stop)
+        {
+          lock_release (&stream->lock);
+          break;
+        }
+      chunk = &stream->chunks[stream->tail % EXTRACT_BUFFERS];
+      lock_release (&stream->lock);
+
+      /* Only the reader touches the chunk at the tail. */
+      chunk->cnt = size - sector < EXTRACT_CHUNK_SECTORS
+                   ? size - sector : EXTRACT_CHUNK_SECTORS;
+      block_read_multi (stream->src, sector, chunk->cnt, chunk->data);
+      sector += chunk->cnt;
+
+      lock_acquire (&stream->lock);
+      stream->tail++;
+      cond_signal (&stream->filled, &stream->lock);
+      lock_release (&stream->lock);
+
+      if (chunk->cnt == 0)
+        break;
+    }
+  sema_up (&stream->reader_done);
+}
+
+/* Consumes between 1 and WANT sectors of the archive, which must
+   all lie in one chunk, stores how many in *CNT, and returns a
+   pointer to them.  The pointer stays valid until the next call. */
+static const uint8_t *
+extract_next (struct extract_stream *stream, size_t want, size_t *cnt)
+{
+  struct extract_chunk *chunk;
+
+  lock_acquire (&stream->lock);
+  /* Hand the previous chunk back to the reader once used up. */
+  if (stream->head != stream->tail
+      && stream->pos == stream->chunks[stream->head % EXTRACT_BUFFERS].cnt)
+    {
+      stream->head++;
+      stream->pos = 0;
+      cond_signal (&stream->emptied, &stream->lock);
+    }
+  while (stream->head == stream->tail)
+    cond_wait (&stream->filled, &stream->lock);
+  chunk = &stream->chunks[stream->head % EXTRACT_BUFFERS];
+  lock_release (&stream->lock);
+
+  if (chunk->cnt == 0)
+    PANIC ("unexpected end of archive on scratch device");
+  *cnt = chunk->cnt - stream->pos < want ? chunk->cnt - stream->pos : want;
+  stream->pos += *cnt;
+  return chunk->data + (stream->pos - *cnt) * BLOCK_SECTOR_SIZE;
+}
+
 /* Copies file FILE_NAME from the file system to the scratch
    device, in ustar format.
 
@@ -1,19 +1,81 @@
 #include "filesys/inode.h"
 #include <list.h>
 #include <debug.h>
+#include <fadvise.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
 #include "filesys/buffer_cache.h"
+#include "filesys/refcount.h"
+#include "filesys/superblock.h"
+#include "filesys/journal.h"
+#include "filesys/lz.h"
+#include "filesys/orphan.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
 #define INDIRECT_BLOCK_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
-#define DIRECT_BLOCK_ENTRIES 123
+#define DIRECT_BLOCK_ENTRIES 121
+
+/* inode_disk flags. */
+#define INODE_SHARED 0x1        /* Data sectors may be shared with a clone. */
+#define INODE_COMPRESSED 0x2    /* Data is stored in compressed clusters. */
+#define INODE_PREALLOC 0x4      /* Map entries may be MAP_UNWRITTEN. */
+
+/* A compressed file is split into clusters of CLUSTER_SECTORS
+   logical sectors, each with all of its sectors allocated.  A
+   cluster that compresses well is stored as a 2-byte length and
+   the compressed stream in its first sectors only, and the map
+   entry of its first sector carries MAP_COMPRESSED; reading it
+   then takes fewer transfers. */
+#define CLUSTER_SECTORS 8
+#define CLUSTER_SIZE (CLUSTER_SECTORS * BLOCK_SECTOR_SIZE)
+#define MAP_COMPRESSED 0x80000000
+
+/* A map entry with MAP_UNWRITTEN set points at a sector reserved
+   by fallocate() that has never been written; it reads as zeros
+   and the flag is cleared by the first write. */
+#define MAP_UNWRITTEN 0x40000000
+#define MAP_SECTOR(ENTRY) ((ENTRY) & ~(MAP_COMPRESSED | MAP_UNWRITTEN))
+
+/* Sectors read ahead of a sequential reader, by default and for a
+   file advised FADV_SEQUENTIAL. */
+#define RA_MIN_SECTORS 4
+#define RA_MAX_SECTORS 16
+
+/* Direct I/O bounces through a kernel page, and moves up to this
+   many sectors that are consecutive on disk with one request. */
+#define DIRECT_RUN_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Journal credits, see journal_begin(), that changing one map
+   entry can use: up to two new index blocks, each allocated and
+   written. */
+#define MAP_CREDITS (2 * (FREE_MAP_CREDITS (1) + 1))
+
+/* Journal credits that one data sector can use when it is added
+   to a file or given a copy of its own: allocating it, its map
+   entry, a refcount, the inode of the file it is shared with,
+   and the file's own inode. */
+#define SECTOR_CREDITS \
+        (FREE_MAP_CREDITS (1) + MAP_CREDITS + REFCOUNT_CREDITS + 2)
+
+/* Journal credits that fallocate() uses per sector: its map
+   entry and the inode, besides the free map bits. */
+#define FALLOC_CREDITS (MAP_CREDITS + 1)
+
+/* Journal credits that inode_clone() uses per run of up to
+   INDIRECT_BLOCK_ENTRIES sectors: their refcounts, the map
+   entries, which span at most two index blocks, and the clone's
+   inode, plus enough to hand the clone to the reclaim thread. */
+#define CLONE_RUN_CREDITS \
+        (REFCOUNT_CREDITS + 2 * MAP_CREDITS + 1 + ORPHAN_CREDITS)
 
 //inode가 디스크 블록의 번호를 가리키는 방식들을 열거
 enum direct_t {
@@ -43,6 +105,8 @@ struct inode_disk
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
     uint32_t is_dir;
+    uint32_t flags;                     /* INODE_* flags. */
+    block_sector_t next_orphan;         /* Next on the orphan list. */
     //Extensible file
     block_sector_t direct_map_table[DIRECT_BLOCK_ENTRIES];
     block_sector_t indirect_block_sec;
@@ -66,6 +130,12 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct lock extend_lock;
+    int io_cnt;                         /* Data accesses in progress. */
+    bool migrating;                     /* Data being moved by defrag. */
+    struct condition migrate_done;      /* Signaled when it is done. */
+    int advice;                         /* FADV_* access pattern. */
+    off_t ra_next;                      /* Where a sequential read starts. */
+    off_t ra_end;                       /* End of data read ahead. */
   };
 
 static bool get_disk_inode (const struct inode *inode, 
@@ -77,8 +147,58 @@ static bool register_sector (struct inode_disk *inode_disk,
                              struct sector_location sec_loc);
 static block_sector_t byte_to_sector (const struct inode_disk *inode_disk, 
                                       off_t pos);
+static block_sector_t byte_to_entry (const struct inode_disk *, off_t pos);
 bool inode_update_file_length (struct inode_disk *, off_t, off_t);
-static void free_inode_sectors (struct inode_disk *inode_disk);
+static void release_index_blocks (struct inode_disk *, size_t sector_idx);
+static off_t read_segment (const struct inode_disk *, uint8_t *,
+                           off_t size, off_t offset, uint8_t *bounce);
+static off_t write_segment (struct inode *, struct inode_disk *,
+                            const uint8_t *, off_t size, off_t offset,
+                            bool meta, uint8_t *bounce);
+static off_t write_sectors (struct inode *, struct inode_disk *,
+                            const uint8_t *, off_t size, off_t offset,
+                            bool meta, uint8_t *bounce);
+static size_t direct_run (const struct inode_disk *, off_t offset,
+                          off_t size, block_sector_t first);
+static off_t read_compressed (const struct inode_disk *, uint8_t *,
+                              off_t size, off_t offset);
+static off_t write_compressed (struct inode *, struct inode_disk *,
+                               const uint8_t *, off_t size, off_t offset);
+static bool load_cluster (const struct inode_disk *, off_t start,
+                          uint8_t *cluster, uint8_t *packed);
+static bool store_cluster (struct inode *, struct inode_disk *, off_t start,
+                           const uint8_t *cluster, uint8_t *packed,
+                           bool compress);
+static off_t copy_range_bounce (struct inode *src, off_t src_ofs,
+                                struct inode *dst, off_t dst_ofs,
+                                off_t size);
+static uint32_t get_flags (const struct inode *);
+static bool fill_unwritten (struct inode_disk *, off_t pos,
+                            block_sector_t *sector, bool whole);
+static bool is_metadata (const struct inode *, const struct inode_disk *);
+static void put_disk_inode (const struct inode *,
+                            const struct inode_disk *);
+static bool grow_inode (struct inode *, struct inode_disk *, off_t length);
+static void txn_step (const struct inode *, const struct inode_disk *);
+static size_t index_block_cnt (size_t sector_cnt);
+static block_sector_t unshare_sector (struct inode_disk *, off_t pos,
+                                      block_sector_t sector, bool whole);
+static bool share_sector (struct inode_disk *, off_t pos,
+                          block_sector_t old_sector,
+                          block_sector_t new_sector);
+static void mark_shared (struct inode *);
+static void release_data_sector (const struct inode_disk *, block_sector_t);
+static void io_begin (struct inode *);
+static void io_end (struct inode *);
+static bool walk_map (struct inode_disk *, block_sector_t *sectors,
+                      size_t cnt, bool store);
+static size_t count_extents (const block_sector_t *sectors, size_t cnt);
+static size_t defrag_credits (const block_sector_t *sectors, size_t cnt);
+static void read_ahead (struct inode *, const struct inode_disk *,
+                        off_t start, off_t end);
+static off_t prefetch_range (const struct inode_disk *, off_t start,
+                             off_t end);
+static void cool_range (const struct inode_disk *, off_t start, off_t end);
 
 /* Returns the block device sector that contains byte offset POS
    within INODE.
@@ -90,11 +210,17 @@ static void free_inode_sectors (struct inode_disk *inode_disk);
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Protects open_inodes and every inode's open_cnt.  The defrag,
+   reclaim and warmup threads open and close inodes without the
+   system call lock, so it cannot be relied on. */
+static struct lock open_inodes_lock;
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -130,7 +256,7 @@ inode_create (block_sector_t sector, off_t length, uint32_t is_dir)
           if(!inode_update_file_length(disk_inode, 0, length-1))
               return false;
       /* on—disk inode를bc_write()를통해buffer cache에기록*/
-      bc_write(sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
+      bc_write_meta(sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
       /* 할당받은disk_inode변수해제*/
       free (disk_inode);
       /* success 변수update */
@@ -151,13 +277,15 @@ inode_open (block_sector_t sector)
   /* open_inodes리스트에inode가존재하는지검사*/
 
   /* Check whether this inode is already open. */
+  lock_acquire (&open_inodes_lock);
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
     {
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
@@ -165,9 +293,13 @@ inode_open (block_sector_t sector)
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
+  /* Initialize.  Done before the inode is released to other
+     openers with the lock. */
   list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
@@ -175,6 +307,13 @@ inode_open (block_sector_t sector)
   inode->removed = false;
   //block_read (fs_device, inode->sector, &inode->data);
   lock_init (&inode->extend_lock);
+  inode->io_cnt = 0;
+  inode->migrating = false;
+  cond_init (&inode->migrate_done);
+  inode->advice = FADV_NORMAL;
+  inode->ra_next = 0;
+  inode->ra_end = 0;
+  lock_release (&open_inodes_lock);
 
   return inode;
 }
@@ -184,7 +323,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -206,22 +349,23 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  bool last = --inode->open_cnt == 0;
+  /* Remove from inode list and release lock. */
+  if (last)
+    list_remove (&inode->elem);
+  lock_release (&open_inodes_lock);
+
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-        list_remove (&inode->elem);
-
         /* Deallocate blocks if removed. */
         if (inode->removed) 
         {
-            struct inode_disk *disk_inode = malloc (sizeof (struct inode_disk));
-            if (disk_inode == NULL)
-                PANIC ("Failed to close inode. Could not allocate disk_inode.\n");
-            get_disk_inode (inode, disk_inode);
-            free_inode_sectors (disk_inode);
-            free_map_release (inode->sector, 1);
-            free (disk_inode);
-
+            /* 블록 해제는 reclaim thread가 background에서 수행 */
+            journal_begin (ORPHAN_CREDITS);
+            orphan_add (inode->sector);
+            journal_end ();
+            superblock_add_inodes (-1);
        }
 
       free (inode); 
@@ -243,17 +387,81 @@ inode_remove (struct inode *inode)
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
-  uint8_t *buffer = buffer_;
+  struct iovec iov;
+
+  iov.iov_base = buffer_;
+  iov.iov_len = size;
+  return inode_readv_at (inode, &iov, 1, offset, false);
+}
+
+/* Reads from INODE, starting at position OFFSET, into the IOVCNT
+   segments of IOV, filling each segment before moving on to the
+   next.  The on-disk inode is fetched only once for the whole
+   transfer.  If DIRECT is true, whole sectors are read around
+   the buffer cache, see read_segment().
+   Returns the number of bytes actually read, which may be less
+   than the total length of IOV if end of file is reached. */
+off_t
+inode_readv_at (struct inode *inode, const struct iovec *iov, int iovcnt,
+                off_t offset, bool direct)
+{
   off_t bytes_read = 0;
+  off_t start = offset;
   uint8_t *bounce = NULL;
+  int i;
 
   /* inode_disk자료형의disk_inode변수를동적할당*/
   struct inode_disk *disk_inode = malloc(sizeof(struct inode_disk));
   if(disk_inode == NULL)
       return 0;
+  if (direct && !(bounce = palloc_get_page (0))) {
+      free (disk_inode);
+      return 0;
+  }
+  io_begin (inode);
   /* on-disk inode를buffer cache에서읽어옴 */
   get_disk_inode(inode, disk_inode);
 
+  for (i = 0; i < iovcnt; i++)
+    {
+      off_t seg_read = read_segment (disk_inode, iov[i].iov_base,
+                                     iov[i].iov_len, offset, bounce);
+      offset += seg_read;
+      bytes_read += seg_read;
+
+      /* Short segment means end of file. */
+      if (seg_read < (off_t) iov[i].iov_len)
+        break;
+    }
+  /* direct read는 cache를 채우지 않음 */
+  if (!direct)
+    read_ahead (inode, disk_inode, start, offset);
+  if (!direct && inode->advice == FADV_NOREUSE)
+    cool_range (disk_inode, start, offset);
+  io_end (inode);
+  if (bounce != NULL)
+    palloc_free_page (bounce);
+  free (disk_inode);
+
+  return bytes_read;
+}
+
+/* Copies SIZE bytes of the file described by DISK_INODE, starting
+   at OFFSET, into BUFFER through the buffer cache.  If BOUNCE, a
+   page-sized kernel buffer, is not null, whole sectors are
+   instead read from disk into BOUNCE, each run of them that is
+   consecutive on disk with one request, and copied from there, so
+   they do not take the place of other data in the cache.
+   Returns the number of bytes copied. */
+static off_t
+read_segment (const struct inode_disk *disk_inode, uint8_t *buffer,
+              off_t size, off_t offset, uint8_t *bounce)
+{
+  off_t bytes_read = 0;
+
+  if (disk_inode->flags & INODE_COMPRESSED)
+    return read_compressed (disk_inode, buffer, size, offset);
+
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -269,45 +477,51 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      block_sector_t sector_idx = byte_to_sector (disk_inode, offset);
-      if (sector_idx == 0)
+      block_sector_t entry = byte_to_entry (disk_inode, offset);
+      if (entry == 0)
           break;
 
- /*     if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          //block_read (fs_device, sector_idx, buffer + bytes_read);
-          //Read from buffer cache
-/*        }
-      else 
-      {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-/*          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-*/
-          //bc_read (sector_idx, buffer, bytes_read, chunk_size, bounce + sector_ofs);
-/*          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
-    
-*/
-      bc_read (sector_idx, buffer, bytes_read, chunk_size, sector_ofs);
+      /* 한 번도 쓰지 않은 preallocated 섹터는 0으로 읽힘 */
+      if (entry & MAP_UNWRITTEN)
+          memset (buffer + bytes_read, 0, chunk_size);
+      else if (bounce != NULL && chunk_size == BLOCK_SECTOR_SIZE) {
+          size_t n = direct_run (disk_inode, offset, size, entry);
+          bc_read_direct (entry, n, bounce);
+          chunk_size = n * BLOCK_SECTOR_SIZE;
+          memcpy (buffer + bytes_read, bounce, chunk_size);
+      }
+      else
+          bc_read (MAP_SECTOR (entry), buffer, bytes_read, chunk_size,
+                   sector_ofs);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (disk_inode);
-
   return bytes_read;
 }
 
+/* Returns how many whole sectors of DISK_INODE, starting with the
+   one at sector-aligned byte OFFSET, whose map entry is FIRST,
+   follow FIRST on disk with no map flags set, counting at most
+   SIZE bytes and DIRECT_RUN_SECTORS sectors.  Always at least
+   1. */
+static size_t
+direct_run (const struct inode_disk *disk_inode, off_t offset, off_t size,
+            block_sector_t first)
+{
+  size_t n = 1;
+
+  while (n < DIRECT_RUN_SECTORS
+         && (off_t) (n + 1) * BLOCK_SECTOR_SIZE <= size
+         && offset + (off_t) (n + 1) * BLOCK_SECTOR_SIZE <= disk_inode->length
+         && byte_to_entry (disk_inode, offset + n * BLOCK_SECTOR_SIZE)
+            == first + n)
+    n++;
+  return n;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -317,43 +531,211 @@ off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
-  const uint8_t *buffer = buffer_;
+  struct iovec iov;
+
+  iov.iov_base = (void *) buffer_;
+  iov.iov_len = size;
+  return inode_writev_at (inode, &iov, 1, offset, false);
+}
+
+/* Writes the IOVCNT segments of IOV into INODE back to back,
+   starting at OFFSET.  The file is extended once for the whole
+   transfer and the on-disk inode is written back only once, and
+   only if it changed, unless the transfer is too large for one
+   journal transaction.  If DIRECT is true, whole sectors of data
+   are written around the buffer cache, see write_segment().
+   Returns the number of bytes actually written. */
+off_t
+inode_writev_at (struct inode *inode, const struct iovec *iov, int iovcnt,
+                 off_t offset, bool direct) 
+{
+  off_t size = 0;
   off_t bytes_written = 0;
-//  uint8_t *bounce = NULL;
+  uint8_t *bounce = NULL;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    size += iov[i].iov_len;
 
   struct inode_disk *disk_inode = malloc(sizeof(struct inode_disk));
   if(!disk_inode)
       return 0;
+  io_begin (inode);
   get_disk_inode(inode, disk_inode);
 
 
   if (inode->deny_write_cnt) {
+      io_end (inode);
       free(disk_inode);
       return 0;
   }
 
+  /* 확장, copy-on-write, 디렉터리 엔트리 변경이 transaction에 포함.
+     덮어쓰기만 하는 일반 파일은 metadata를 바꾸지 않음 */
+  bool meta = is_metadata (inode, disk_inode);
+  bool grows = offset + size > disk_inode->length;
+  journal_begin (meta || grows
+                 || (disk_inode->flags & (INODE_SHARED | INODE_PREALLOC
+                                          | INODE_COMPRESSED))
+                 ? SECTOR_CREDITS : 0);
+
   /* inode의lock 획득*/
   lock_acquire(&inode->extend_lock);
-  int old_length = disk_inode->length;
-  int write_end = offset +  size - 1;
-  if (write_end > old_length -1 ) {
+  if (offset + size > disk_inode->length) {
       /*파일길이가증가하였을경우, on-disk inode업데이트*/
-      disk_inode->length = write_end + 1;
-      if(!inode_update_file_length(disk_inode, old_length, write_end)){
+      if (!grow_inode (inode, disk_inode, offset + size)) {
+          put_disk_inode (inode, disk_inode);
+          lock_release(&inode->extend_lock);
+          journal_end ();
+          io_end (inode);
           free(disk_inode);
           return 0;
       }
   }
   /* inode의lock 해제*/
   lock_release(&inode->extend_lock);
-  
+
+  /* metadata는 journal을 거쳐야 하므로 항상 cache를 사용.
+     bounce를 할당하지 못하면 cache를 통해 씀 */
+  if (direct && !meta)
+      bounce = palloc_get_page (0);
+  for (i = 0; i < iovcnt; i++)
+    {
+      off_t seg_written = write_segment (inode, disk_inode,
+                                         iov[i].iov_base, iov[i].iov_len,
+                                         offset, meta, bounce);
+      offset += seg_written;
+      bytes_written += seg_written;
+      if (seg_written < (off_t) iov[i].iov_len)
+        break;
+    }
+
+  put_disk_inode (inode, disk_inode);
+  journal_end ();
+  io_end (inode);
+  if (bounce != NULL)
+      palloc_free_page (bounce);
+  free(disk_inode);
+
+  return bytes_written;
+}
+
+/* Returns true if the data of INODE, described by DISK_INODE, is
+   itself file system metadata: directory entries, the free map
+   and the refcount file.  Writes to it are journaled. */
+static bool
+is_metadata (const struct inode *inode, const struct inode_disk *disk_inode)
+{
+  const struct superblock *sb = superblock_get ();
+
+  return (disk_inode->is_dir
+          || inode->sector == sb->free_map_sector
+          || inode->sector == sb->refcount_sector);
+}
+
+/* Writes DISK_INODE to INODE's sector, unless it is what is there
+   already, so that an operation that did not change it does not
+   add the sector to the journal transaction. */
+static void
+put_disk_inode (const struct inode *inode, const struct inode_disk *disk_inode)
+{
+  struct inode_disk *old = malloc (sizeof *old);
+
+  if (old == NULL || !get_disk_inode (inode, old)
+      || memcmp (old, disk_inode, sizeof *old))
+    bc_write_meta (inode->sector, (void *) disk_inode, 0,
+                   BLOCK_SECTOR_SIZE, 0);
+  free (old);
+}
+
+/* Extends INODE, described by DISK_INODE, to LENGTH bytes one
+   sector at a time, within a journal operation and with
+   extend_lock held.  When the transaction has no room for the
+   next sector, the inode is written back as far as it got and
+   the rest goes into the next transaction; extend_lock is
+   dropped meanwhile so that the commit is not held up, and
+   DISK_INODE is read again.  Returns false if the disk is full. */
+static bool
+grow_inode (struct inode *inode, struct inode_disk *disk_inode, off_t length)
+{
+  while (disk_inode->length < length)
+    {
+      off_t old_length = disk_inode->length;
+      off_t new_length = ROUND_DOWN (old_length, BLOCK_SECTOR_SIZE)
+                         + BLOCK_SECTOR_SIZE;
+
+      if (!journal_extend (SECTOR_CREDITS))
+        {
+          put_disk_inode (inode, disk_inode);
+          lock_release (&inode->extend_lock);
+          journal_restart (SECTOR_CREDITS);
+          lock_acquire (&inode->extend_lock);
+          get_disk_inode (inode, disk_inode);
+          continue;
+        }
+      if (new_length > length)
+        new_length = length;
+      disk_inode->length = new_length;
+      if (!inode_update_file_length (disk_inode, old_length, new_length - 1))
+        {
+          disk_inode->length = old_length;
+          return false;
+        }
+    }
+  return true;
+}
+
+/* Makes room in the journal operation in progress for one more
+   data sector of INODE, described by DISK_INODE, writing the
+   inode back and going on in the next transaction if the
+   running one is full.  The caller must not hold extend_lock. */
+static void
+txn_step (const struct inode *inode, const struct inode_disk *disk_inode)
+{
+  if (!journal_extend (SECTOR_CREDITS))
+    {
+      put_disk_inode (inode, disk_inode);
+      journal_restart (SECTOR_CREDITS);
+    }
+}
+
+/* Copies SIZE bytes from BUFFER into the already allocated
+   sectors of the file described by DISK_INODE, starting at
+   OFFSET.  META says the file holds metadata, see is_metadata().
+   If BOUNCE, a page-sized kernel buffer, is not null, whole
+   sectors are copied into it and written straight to disk
+   instead of through the buffer cache, each run of them that is
+   consecutive on disk with one request.  INODE is the file, for
+   splitting the journal operation, see txn_step().
+   Returns the number of bytes copied. */
+static off_t
+write_segment (struct inode *inode, struct inode_disk *disk_inode,
+               const uint8_t *buffer, off_t size, off_t offset, bool meta,
+               uint8_t *bounce)
+{
+  if (disk_inode->flags & INODE_COMPRESSED)
+    return write_compressed (inode, disk_inode, buffer, size, offset);
+  return write_sectors (inode, disk_inode, buffer, size, offset, meta,
+                        bounce);
+}
+
+/* Does the work of write_segment() sector by sector, for a file
+   or a cluster stored as is. */
+static off_t
+write_sectors (struct inode *inode, struct inode_disk *disk_inode,
+               const uint8_t *buffer, off_t size, off_t offset, bool meta,
+               uint8_t *bounce)
+{
+  off_t bytes_written = 0;
+  block_sector_t run_start = 0;
+  size_t run_cnt = 0;
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      //off_t inode_left = inode_length (inode) - offset;
       off_t inode_left = disk_inode->length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
@@ -363,12 +745,45 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
     
-      block_sector_t sector_idx = byte_to_sector (disk_inode, offset);
+      /* 섹터마다 metadata가 바뀔 수 있으면 transaction 공간 확보.
+         새 map이 commit되기 전에 모아둔 데이터를 먼저 씀 */
+      if (meta || (disk_inode->flags & (INODE_SHARED | INODE_PREALLOC))) {
+          if (run_cnt > 0)
+              bc_write_direct (run_start, run_cnt, bounce);
+          run_cnt = 0;
+          txn_step (inode, disk_inode);
+      }
+      block_sector_t entry = byte_to_entry (disk_inode, offset);
+      block_sector_t sector_idx = MAP_SECTOR (entry);
+      if (entry & MAP_UNWRITTEN) {
+          if (!fill_unwritten (disk_inode, offset, &sector_idx,
+                               chunk_size == BLOCK_SECTOR_SIZE))
+              break;
+      }
+      else if (sector_idx != 0)
+          sector_idx = unshare_sector (disk_inode, offset, sector_idx,
+                                       chunk_size == BLOCK_SECTOR_SIZE);
       if (sector_idx == 0)
           break;
 
-      bc_write(sector_idx, (void*)buffer, bytes_written, 
-               chunk_size, sector_ofs);
+      if (meta)
+          bc_write_meta(sector_idx, (void*)buffer, bytes_written,
+                        chunk_size, sector_ofs);
+      else if (bounce != NULL && chunk_size == BLOCK_SECTOR_SIZE) {
+          /* 디스크에서 이어지는 섹터는 모아서 한 번에 씀 */
+          if (run_cnt > 0 && (sector_idx != run_start + run_cnt
+                              || run_cnt == DIRECT_RUN_SECTORS)) {
+              bc_write_direct (run_start, run_cnt, bounce);
+              run_cnt = 0;
+          }
+          if (run_cnt == 0)
+              run_start = sector_idx;
+          memcpy (bounce + run_cnt++ * BLOCK_SECTOR_SIZE,
+                  buffer + bytes_written, BLOCK_SECTOR_SIZE);
+      }
+      else
+          bc_write(sector_idx, (void*)buffer, bytes_written, 
+                   chunk_size, sector_ofs);
 
 
       /* Advance. */
@@ -376,13 +791,403 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
+  if (run_cnt > 0)
+    bc_write_direct (run_start, run_cnt, bounce);
+  return bytes_written;
+}
 
-  bc_write(inode->sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
-  free(disk_inode);
+/* Prepares *SECTOR, the MAP_UNWRITTEN sector holding byte POS
+   of DISK_INODE, for its first write: makes it private to this
+   file, zeroes it unless WHOLE says the caller overwrites all of
+   it, and clears the flag.  Nothing is allocated unless a clone
+   shares the sector.  Returns false if that allocation fails. */
+static bool
+fill_unwritten (struct inode_disk *disk_inode, off_t pos,
+                block_sector_t *sector, bool whole)
+{
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+  struct sector_location sec_loc;
 
+  /* 이전 내용은 의미가 없으므로 복사하지 않음 */
+  *sector = unshare_sector (disk_inode, pos, *sector, true);
+  if (*sector == 0)
+    return false;
+  if (!whole)
+    bc_write (*sector, (void *) zeros, 0, BLOCK_SECTOR_SIZE, 0);
+
+  if (byte_to_entry (disk_inode, pos) & MAP_UNWRITTEN)
+    {
+      locate_byte (pos, &sec_loc);
+      if (!register_sector (disk_inode, *sector, sec_loc))
+        return false;
+    }
+  return true;
+}
+
+/* Like read_segment(), for a file with INODE_COMPRESSED set:
+   every cluster touched is fetched and decompressed whole. */
+static off_t
+read_compressed (const struct inode_disk *disk_inode, uint8_t *buffer,
+                 off_t size, off_t offset)
+{
+  uint8_t *cluster = malloc (CLUSTER_SIZE);
+  uint8_t *packed = malloc (CLUSTER_SIZE);
+  off_t bytes_read = 0;
+
+  while (cluster != NULL && packed != NULL && size > 0)
+    {
+      /* Cluster to read, starting byte offset within cluster. */
+      off_t start = offset / CLUSTER_SIZE * CLUSTER_SIZE;
+      int cluster_ofs = offset - start;
+
+      /* Bytes left in inode, bytes left in cluster, lesser of the two. */
+      off_t inode_left = disk_inode->length - offset;
+      int cluster_left = CLUSTER_SIZE - cluster_ofs;
+      int min_left = inode_left < cluster_left ? inode_left : cluster_left;
+
+      /* Number of bytes to actually copy out of this cluster. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0
+          || !load_cluster (disk_inode, start, cluster, packed))
+        break;
+      memcpy (buffer + bytes_read, cluster + cluster_ofs, chunk_size);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+  free (cluster);
+  free (packed);
+  return bytes_read;
+}
+
+/* Like write_segment(), for a file with INODE_COMPRESSED set.
+   A cluster is only compressed by the write that reaches its
+   end, so that a file written in small pieces compresses each
+   cluster once.  Until then a cluster is kept as is and written
+   in place; one that is compressed already is read, modified and
+   stored as is. */
+static off_t
+write_compressed (struct inode *inode, struct inode_disk *disk_inode,
+                  const uint8_t *buffer, off_t size, off_t offset)
+{
+  uint8_t *cluster = malloc (CLUSTER_SIZE);
+  uint8_t *packed = malloc (CLUSTER_SIZE);
+  off_t bytes_written = 0;
+
+  while (cluster != NULL && packed != NULL && size > 0)
+    {
+      /* Cluster to write, starting byte offset within cluster. */
+      off_t start = offset / CLUSTER_SIZE * CLUSTER_SIZE;
+      int cluster_ofs = offset - start;
+
+      /* Bytes left in inode, bytes left in cluster, lesser of the two. */
+      off_t inode_left = disk_inode->length - offset;
+      int cluster_left = CLUSTER_SIZE - cluster_ofs;
+      int min_left = inode_left < cluster_left ? inode_left : cluster_left;
+
+      /* Number of bytes to actually write into this cluster. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      /* 클러스터 끝까지 채우는 쓰기에서만 압축 */
+      bool fills = cluster_ofs + chunk_size == CLUSTER_SIZE;
+      if (!fills && !(byte_to_entry (disk_inode, start) & MAP_COMPRESSED))
+        {
+          if (write_sectors (inode, disk_inode, buffer + bytes_written,
+                             chunk_size, offset, false, NULL) != chunk_size)
+            break;
+        }
+      else
+        {
+          if (cluster_ofs == 0 && chunk_size == min_left)
+            memset (cluster, 0, CLUSTER_SIZE);
+          else if (!load_cluster (disk_inode, start, cluster, packed))
+            break;
+          memcpy (cluster + cluster_ofs, buffer + bytes_written, chunk_size);
+          if (!store_cluster (inode, disk_inode, start, cluster, packed,
+                              fills))
+            break;
+        }
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+    }
+  free (cluster);
+  free (packed);
   return bytes_written;
 }
 
+/* Returns the number of sectors of the cluster at byte START of
+   DISK_INODE that lie within the file. */
+static size_t
+cluster_sectors (const struct inode_disk *disk_inode, off_t start)
+{
+  off_t left = disk_inode->length - start;
+  return bytes_to_sectors (left < CLUSTER_SIZE ? left : CLUSTER_SIZE);
+}
+
+/* Reads the cluster at byte START of DISK_INODE into CLUSTER,
+   decompressing it if needed, with PACKED as scratch space.
+   Bytes past the data are zeroed.  Returns false if the cluster
+   is missing or corrupt. */
+static bool
+load_cluster (const struct inode_disk *disk_inode, off_t start,
+              uint8_t *cluster, uint8_t *packed)
+{
+  size_t sector_cnt = cluster_sectors (disk_inode, start);
+  block_sector_t entry = byte_to_entry (disk_inode, start);
+  size_t i, data_len;
+
+  if (entry == 0)
+    return false;
+
+  if (entry & MAP_COMPRESSED)
+    {
+      uint16_t packed_len;
+      size_t packed_sectors;
+      int n;
+
+      bc_read (MAP_SECTOR (entry), packed, 0, BLOCK_SECTOR_SIZE, 0);
+      memcpy (&packed_len, packed, sizeof packed_len);
+      packed_sectors = DIV_ROUND_UP (sizeof packed_len + packed_len,
+                                     BLOCK_SECTOR_SIZE);
+      if (packed_sectors >= sector_cnt)
+        return false;
+      /* 압축된 만큼의 섹터만 읽음 */
+      for (i = 1; i < packed_sectors; i++)
+        bc_read (byte_to_sector (disk_inode, start + i * BLOCK_SECTOR_SIZE),
+                 packed, i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE, 0);
+      n = lz_decompress (packed + sizeof packed_len, packed_len,
+                         cluster, CLUSTER_SIZE);
+      if (n < 0)
+        return false;
+      data_len = n;
+    }
+  else
+    {
+      for (i = 0; i < sector_cnt; i++)
+        bc_read (byte_to_sector (disk_inode, start + i * BLOCK_SECTOR_SIZE),
+                 cluster, i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE, 0);
+      data_len = sector_cnt * BLOCK_SECTOR_SIZE;
+    }
+  memset (cluster + data_len, 0, CLUSTER_SIZE - data_len);
+  return true;
+}
+
+/* Writes CLUSTER as the cluster at byte START of DISK_INODE, if
+   COMPRESS, compressed into PACKED if that saves at least one
+   sector, and as is otherwise, and updates the MAP_COMPRESSED
+   flag of its first map entry.  Returns false if a shared sector
+   cannot be copied. */
+static bool
+store_cluster (struct inode *inode, struct inode_disk *disk_inode,
+               off_t start, const uint8_t *cluster, uint8_t *packed,
+               bool compress)
+{
+  size_t sector_cnt = cluster_sectors (disk_inode, start);
+  off_t data_len = disk_inode->length - start;
+  uint16_t packed_len = 0;
+  size_t write_cnt = sector_cnt, i;
+  const uint8_t *src = cluster;
+  block_sector_t first = 0, entry;
+
+  if (data_len > CLUSTER_SIZE)
+    data_len = CLUSTER_SIZE;
+  if (compress && sector_cnt > 1)
+    packed_len = lz_compress (cluster, data_len, packed + sizeof packed_len,
+                              (sector_cnt - 1) * BLOCK_SECTOR_SIZE
+                              - sizeof packed_len);
+  if (packed_len > 0)
+    {
+      size_t total = sizeof packed_len + packed_len;
+
+      memcpy (packed, &packed_len, sizeof packed_len);
+      write_cnt = DIV_ROUND_UP (total, BLOCK_SECTOR_SIZE);
+      memset (packed + total, 0, write_cnt * BLOCK_SECTOR_SIZE - total);
+      src = packed;
+    }
+
+  for (i = 0; i < write_cnt; i++)
+    {
+      off_t pos = start + i * BLOCK_SECTOR_SIZE;
+      if (disk_inode->flags & INODE_SHARED)
+          txn_step (inode, disk_inode);
+      block_sector_t sector = unshare_sector (disk_inode, pos,
+                                              byte_to_sector (disk_inode, pos),
+                                              true);
+      if (sector == 0)
+        return false;
+      if (i == 0)
+        first = sector;
+      bc_write (sector, (void *) src, i * BLOCK_SECTOR_SIZE,
+                BLOCK_SECTOR_SIZE, 0);
+    }
+
+  /* 첫 map entry에 압축 여부를 기록 */
+  entry = first | (packed_len > 0 ? MAP_COMPRESSED : 0);
+  if (byte_to_entry (disk_inode, start) != entry)
+    {
+      struct sector_location sec_loc;
+      locate_byte (start, &sec_loc);
+      if (!register_sector (disk_inode, entry, sec_loc))
+        return false;
+    }
+  return true;
+}
+
+/* Copies SIZE bytes from SRC, starting at SRC_OFS, into DST,
+   starting at DST_OFS, extending DST if needed.  Data moves
+   sector by sector inside the buffer cache and never passes
+   through a caller's buffer; whole sectors that line up in both
+   files are shared copy-on-write instead.  Returns the number of bytes
+   copied, which is less than SIZE if SRC ends first, or -1 if
+   the two ranges overlap within the same inode. */
+off_t
+inode_copy_range (struct inode *src, off_t src_ofs,
+                  struct inode *dst, off_t dst_ofs, off_t size)
+{
+  off_t bytes_copied = 0;
+  struct inode_disk *src_disk, *dst_disk;
+
+  if (src == dst && src_ofs < dst_ofs + size && dst_ofs < src_ofs + size)
+    return -1;
+  if (dst->deny_write_cnt)
+    return 0;
+  /* 압축되었거나 unwritten 섹터가 있으면 섹터를 그대로
+     복사하거나 공유할 수 없음 */
+  if ((get_flags (src) | get_flags (dst)) & (INODE_COMPRESSED | INODE_PREALLOC))
+    return copy_range_bounce (src, src_ofs, dst, dst_ofs, size);
+
+  src_disk = malloc (sizeof (struct inode_disk));
+  dst_disk = malloc (sizeof (struct inode_disk));
+  if (src_disk == NULL || dst_disk == NULL)
+    {
+      free (src_disk);
+      free (dst_disk);
+      return 0;
+    }
+  io_begin (src);
+  if (dst != src)
+    io_begin (dst);
+  get_disk_inode (src, src_disk);
+  journal_begin (SECTOR_CREDITS);
+
+  /* 원본 파일의 끝까지만 복사 */
+  if (src_ofs >= src_disk->length)
+    size = 0;
+  else if (size > src_disk->length - src_ofs)
+    size = src_disk->length - src_ofs;
+
+  /* 복사할 길이만큼 dst를 한 번에 확장 */
+  lock_acquire (&dst->extend_lock);
+  get_disk_inode (dst, dst_disk);
+  if (size > 0 && dst_ofs + size > dst_disk->length)
+    {
+      if (!grow_inode (dst, dst_disk, dst_ofs + size))
+        {
+          put_disk_inode (dst, dst_disk);
+          lock_release (&dst->extend_lock);
+          journal_end ();
+          if (dst != src)
+            io_end (dst);
+          io_end (src);
+          free (src_disk);
+          free (dst_disk);
+          return 0;
+        }
+    }
+  lock_release (&dst->extend_lock);
+
+  /* src와 dst가 같은 inode면 확장된 길이를 반영 */
+  if (src == dst)
+    memcpy (src_disk, dst_disk, sizeof *src_disk);
+
+  while (size > 0)
+    {
+      int src_sector_ofs = src_ofs % BLOCK_SECTOR_SIZE;
+      int dst_sector_ofs = dst_ofs % BLOCK_SECTOR_SIZE;
+      int src_left = BLOCK_SECTOR_SIZE - src_sector_ofs;
+      int dst_left = BLOCK_SECTOR_SIZE - dst_sector_ofs;
+      int chunk_size = src_left < dst_left ? src_left : dst_left;
+      if (size < chunk_size)
+        chunk_size = size;
+
+      txn_step (dst, dst_disk);
+      block_sector_t src_idx = byte_to_sector (src_disk, src_ofs);
+      block_sector_t dst_idx = byte_to_sector (dst_disk, dst_ofs);
+      if (src_idx == 0 || dst_idx == 0)
+        break;
+
+      /* 섹터 전체를 복사하는 경우 데이터 대신 섹터를 공유 */
+      if (chunk_size == BLOCK_SECTOR_SIZE && src != dst
+          && share_sector (dst_disk, dst_ofs, dst_idx, src_idx))
+        {
+          if (!(src_disk->flags & INODE_SHARED))
+            {
+              mark_shared (src);
+              src_disk->flags |= INODE_SHARED;
+            }
+        }
+      else
+        {
+          dst_idx = unshare_sector (dst_disk, dst_ofs, dst_idx,
+                                    chunk_size == BLOCK_SECTOR_SIZE);
+          if (dst_idx == 0
+              || !bc_copy (dst_idx, dst_sector_ofs, src_idx, src_sector_ofs,
+                           chunk_size))
+            break;
+        }
+
+      /* Advance. */
+      size -= chunk_size;
+      src_ofs += chunk_size;
+      dst_ofs += chunk_size;
+      bytes_copied += chunk_size;
+    }
+
+  put_disk_inode (dst, dst_disk);
+  journal_end ();
+  if (dst != src)
+    io_end (dst);
+  io_end (src);
+  free (src_disk);
+  free (dst_disk);
+  return bytes_copied;
+}
+
+/* inode_copy_range() for compressed files: copies through a
+   kernel buffer, one cluster at a time. */
+static off_t
+copy_range_bounce (struct inode *src, off_t src_ofs,
+                   struct inode *dst, off_t dst_ofs, off_t size)
+{
+  uint8_t *buffer = malloc (CLUSTER_SIZE);
+  off_t bytes_copied = 0;
+
+  while (buffer != NULL && size > 0)
+    {
+      off_t chunk_size = size < CLUSTER_SIZE ? size : CLUSTER_SIZE;
+      off_t bytes_read = inode_read_at (src, buffer, chunk_size, src_ofs);
+      off_t bytes_written = inode_write_at (dst, buffer, bytes_read, dst_ofs);
+
+      bytes_copied += bytes_written;
+      if (bytes_read < chunk_size || bytes_written < bytes_read)
+        break;
+
+      /* Advance. */
+      size -= chunk_size;
+      src_ofs += chunk_size;
+      dst_ofs += chunk_size;
+    }
+  free (buffer);
+  return bytes_copied;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -403,6 +1208,310 @@ inode_allow_write (struct inode *inode)
   inode->deny_write_cnt--;
 }
 
+/* Turns on compression for INODE, which must be an empty
+   regular file.  Returns true if successful. */
+bool
+inode_set_compressed (struct inode *inode)
+{
+  struct inode_disk *disk_inode = malloc (sizeof (struct inode_disk));
+  bool success = false;
+
+  if (disk_inode == NULL)
+    return false;
+
+  journal_begin (1);
+  lock_acquire (&inode->extend_lock);
+  get_disk_inode (inode, disk_inode);
+  if (!disk_inode->is_dir && disk_inode->length == 0
+      && !(disk_inode->flags & INODE_SHARED))
+    {
+      disk_inode->flags |= INODE_COMPRESSED;
+      bc_write_meta (inode->sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
+      success = true;
+    }
+  lock_release (&inode->extend_lock);
+  journal_end ();
+  free (disk_inode);
+  return success;
+}
+
+/* Reserves sectors so that INODE holds at least OFFSET + LENGTH
+   bytes, extending it if needed.  The new sectors come from one
+   contiguous run and are marked MAP_UNWRITTEN instead of being
+   zeroed, so later writes only fill them in.  The run is written
+   to the free map as the sectors are added to the file, so a
+   large one is spread over several journal transactions.  Fails
+   for directories and compressed files, or if no run is long
+   enough.  Returns true if successful. */
+bool
+inode_fallocate (struct inode *inode, off_t offset, off_t length)
+{
+  struct inode_disk *disk_inode = malloc (sizeof (struct inode_disk));
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+  bool success = false;
+
+  if (disk_inode == NULL)
+    return false;
+  if (offset < 0 || length <= 0 || offset + length < offset)
+    {
+      free (disk_inode);
+      return false;
+    }
+
+  io_begin (inode);
+  journal_begin (SECTOR_CREDITS);
+  lock_acquire (&inode->extend_lock);
+  get_disk_inode (inode, disk_inode);
+  if (!disk_inode->is_dir && !(disk_inode->flags & INODE_COMPRESSED)
+      && !inode->deny_write_cnt)
+    {
+      off_t old_length = disk_inode->length;
+      off_t new_length = offset + length;
+      size_t old_cnt = bytes_to_sectors (old_length);
+      size_t new_cnt = bytes_to_sectors (new_length);
+      block_sector_t start = 0;
+      size_t i = 0, confirmed = 0;
+
+      if (new_length <= old_length)
+        success = true;
+      else if (new_cnt == old_cnt || free_map_reserve (new_cnt - old_cnt,
+                                                       &start))
+        {
+          /* 기존 마지막 섹터의 파일 끝 이후 부분은 0이어야 함 */
+          if (old_length % BLOCK_SECTOR_SIZE != 0)
+            {
+              off_t tail = old_length % BLOCK_SECTOR_SIZE;
+              block_sector_t entry = byte_to_entry (disk_inode,
+                                                    old_length - 1);
+              block_sector_t sector = MAP_SECTOR (entry);
+
+              if (!(entry & MAP_UNWRITTEN)
+                  && (sector = unshare_sector (disk_inode, old_length - 1,
+                                               sector, false)) != 0)
+                bc_write (sector, (void *) zeros, 0,
+                          BLOCK_SECTOR_SIZE - tail, tail);
+            }
+
+          for (; old_cnt + i < new_cnt; i++)
+            {
+              struct sector_location sec_loc;
+
+              /* transaction이 가득 차면 등록한 섹터까지 free map과
+                 inode에 기록하고 다음 transaction에서 계속 */
+              if (!journal_extend (FALLOC_CREDITS
+                                   + FREE_MAP_CREDITS (i + 1 - confirmed)))
+                {
+                  off_t done = (off_t) (old_cnt + i) * BLOCK_SECTOR_SIZE;
+
+                  if (i > confirmed)
+                    free_map_confirm (start + confirmed, i - confirmed);
+                  confirmed = i;
+                  if (done > disk_inode->length)
+                    {
+                      disk_inode->length = done;
+                      disk_inode->flags |= INODE_PREALLOC;
+                    }
+                  put_disk_inode (inode, disk_inode);
+                  done = disk_inode->length;
+                  lock_release (&inode->extend_lock);
+                  journal_restart (FALLOC_CREDITS + FREE_MAP_CREDITS (1));
+                  lock_acquire (&inode->extend_lock);
+                  get_disk_inode (inode, disk_inode);
+                  /* 그 사이 다른 쓰기가 파일을 늘렸으면 중단 */
+                  if (disk_inode->length != done)
+                    break;
+                }
+              locate_byte ((old_cnt + i) * BLOCK_SECTOR_SIZE, &sec_loc);
+              if (!register_sector (disk_inode, (start + i) | MAP_UNWRITTEN,
+                                    sec_loc))
+                break;
+            }
+          if (i > confirmed)
+            free_map_confirm (start + confirmed, i - confirmed);
+          if (old_cnt + i < new_cnt)
+            {
+              /* 등록하지 못한 나머지는 반납하고 거기까지만 확장 */
+              free_map_cancel (start + i, new_cnt - old_cnt - i);
+              new_length = (old_cnt + i) * BLOCK_SECTOR_SIZE;
+            }
+          else
+            success = true;
+
+          if (new_length > disk_inode->length)
+            {
+              disk_inode->length = new_length;
+              disk_inode->flags |= INODE_PREALLOC;
+              put_disk_inode (inode, disk_inode);
+            }
+        }
+    }
+  lock_release (&inode->extend_lock);
+  journal_end ();
+  io_end (inode);
+  free (disk_inode);
+  return success;
+}
+
+/* Extends INODE with zeros to LENGTH bytes, if it is shorter,
+   spreading the work over as many journal transactions as it
+   takes.  Returns false if the disk fills up first. */
+bool
+inode_extend (struct inode *inode, off_t length)
+{
+  struct inode_disk *disk_inode = malloc (sizeof (struct inode_disk));
+  bool success;
+
+  if (disk_inode == NULL)
+    return false;
+
+  io_begin (inode);
+  journal_begin (SECTOR_CREDITS);
+  lock_acquire (&inode->extend_lock);
+  get_disk_inode (inode, disk_inode);
+  success = grow_inode (inode, disk_inode, length);
+  put_disk_inode (inode, disk_inode);
+  lock_release (&inode->extend_lock);
+  journal_end ();
+  io_end (inode);
+  free (disk_inode);
+  return success;
+}
+
+/* Applies the FADV_* hint ADVICE to the LEN bytes of INODE that
+   start at OFFSET, or to the rest of the file if LEN is 0.
+   FADV_WILLNEED queues the range for the read-ahead thread and
+   FADV_DONTNEED puts its cached sectors first in line for
+   eviction.  The other hints set the access pattern of the whole
+   file, whatever the range.  Returns false if ADVICE is not
+   known or the range is invalid. */
+bool
+inode_advise (struct inode *inode, off_t offset, off_t len, int advice)
+{
+  struct inode_disk *disk_inode;
+  off_t end;
+
+  if (offset < 0 || len < 0 || offset + len < offset)
+    return false;
+
+  switch (advice)
+    {
+    case FADV_NORMAL:
+    case FADV_SEQUENTIAL:
+    case FADV_RANDOM:
+    case FADV_NOREUSE:
+      inode->advice = advice;
+      return true;
+
+    case FADV_WILLNEED:
+    case FADV_DONTNEED:
+      if (!(disk_inode = malloc (sizeof (struct inode_disk))))
+        return false;
+      io_begin (inode);
+      get_disk_inode (inode, disk_inode);
+      end = len == 0 ? disk_inode->length : offset + len;
+      if (advice == FADV_WILLNEED)
+        prefetch_range (disk_inode, offset, end);
+      else
+        cool_range (disk_inode, offset, end);
+      io_end (inode);
+      free (disk_inode);
+      return true;
+
+    default:
+      return false;
+    }
+}
+
+/* Called after INODE's bytes [START, END) were read.  Queues the
+   sectors that follow for the read-ahead thread if the read
+   continued the previous one, or whatever it was if INODE is
+   advised FADV_SEQUENTIAL, and never if FADV_RANDOM.  Sectors
+   already queued are not queued again. */
+static void
+read_ahead (struct inode *inode, const struct inode_disk *disk_inode,
+            off_t start, off_t end)
+{
+  bool sequential = start == inode->ra_next;
+  off_t window;
+
+  /* seek하면 이전에 미리 읽은 구간은 의미가 없음 */
+  if (!sequential || inode->ra_end < end)
+    inode->ra_end = end;
+  inode->ra_next = end;
+
+  /* 압축된 cluster는 앞쪽 섹터만 쓰이므로 미리 읽지 않음 */
+  if (inode->advice == FADV_RANDOM
+      || (disk_inode->flags & INODE_COMPRESSED))
+    return;
+  if (inode->advice == FADV_SEQUENTIAL)
+    window = RA_MAX_SECTORS * BLOCK_SECTOR_SIZE;
+  else if (sequential)
+    window = RA_MIN_SECTORS * BLOCK_SECTOR_SIZE;
+  else
+    return;
+
+  if (inode->ra_end < end + window)
+    inode->ra_end = prefetch_range (disk_inode, inode->ra_end, end + window);
+}
+
+/* Queues the sectors holding DISK_INODE's bytes [START, END) for
+   the read-ahead thread, stopping early if its queue is full.
+   Unwritten sectors are skipped.  Returns the offset up to which
+   the range was queued. */
+static off_t
+prefetch_range (const struct inode_disk *disk_inode, off_t start, off_t end)
+{
+  off_t pos = start - start % BLOCK_SECTOR_SIZE;
+
+  if (end > disk_inode->length)
+    end = disk_inode->length;
+  for (; pos < end; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t entry = byte_to_entry (disk_inode, pos);
+
+      if (entry == 0)
+        break;
+      if (!(entry & MAP_UNWRITTEN) && !bc_prefetch_async (MAP_SECTOR (entry)))
+        break;
+    }
+  return pos;
+}
+
+/* Puts the cached sectors holding DISK_INODE's bytes [START, END)
+   first in line for eviction. */
+static void
+cool_range (const struct inode_disk *disk_inode, off_t start, off_t end)
+{
+  off_t pos = start - start % BLOCK_SECTOR_SIZE;
+
+  if (end > disk_inode->length)
+    end = disk_inode->length;
+  for (; pos < end; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t entry = byte_to_entry (disk_inode, pos);
+
+      if (entry == 0)
+        break;
+      if (!(entry & MAP_UNWRITTEN))
+        bc_cool (MAP_SECTOR (entry));
+    }
+}
+
+/* Returns the INODE_* flags of INODE. */
+static uint32_t
+get_flags (const struct inode *inode)
+{
+  struct inode_disk *disk_inode = malloc (sizeof (struct inode_disk));
+  uint32_t flags;
+
+  if (disk_inode == NULL)
+    return 0;
+  get_disk_inode (inode, disk_inode);
+  flags = disk_inode->flags;
+  free (disk_inode);
+  return flags;
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
@@ -502,7 +1611,7 @@ bool register_sector (struct inode_disk *inode_disk,
                   memset (new_block, 0, BLOCK_SECTOR_SIZE);
                   new_block->map_table[sec_loc.index1] = new_sector;
                   /* 인덱스블록을buffer cache에기록*/
-                  bc_write(inode_disk->indirect_block_sec, 
+                  bc_write_meta(inode_disk->indirect_block_sec, 
                            new_block, 0, BLOCK_SECTOR_SIZE, 0);
               } 
               else { //No block free memory 
@@ -512,7 +1621,7 @@ bool register_sector (struct inode_disk *inode_disk,
             }
             else { 
                 /* 인덱스블록을buffer cache에기록*/
-                bc_write(inode_disk->indirect_block_sec, &new_sector, 
+                bc_write_meta(inode_disk->indirect_block_sec, &new_sector, 
                         0, sizeof(block_sector_t), 
                         map_table_offset(sec_loc.index1));
             }
@@ -531,8 +1640,8 @@ bool register_sector (struct inode_disk *inode_disk,
                 //alloc free map
                 if (free_map_allocate (1, &(inode_disk->double_indirect_block_sec))) {
                     memset (new_block, 0, BLOCK_SECTOR_SIZE);
-                    bc_write(inode_disk->double_indirect_block_sec, new_block, 0,
-                            BLOCK_SECTOR_SIZE, 0);
+                    bc_write_meta(inode_disk->double_indirect_block_sec,
+                            new_block, 0, BLOCK_SECTOR_SIZE, 0);
                 }
                 else {//No free map
                     free (new_block);
@@ -547,12 +1656,12 @@ bool register_sector (struct inode_disk *inode_disk,
             if (index_2nd_block == 0) {
                 //free map alloc
                 if (free_map_allocate (1, &index_2nd_block)) {
-                    bc_write(inode_disk->double_indirect_block_sec, 
+                    bc_write_meta(inode_disk->double_indirect_block_sec, 
                             &index_2nd_block, 0, sizeof(block_sector_t),
                             map_table_offset(sec_loc.index1));
                     memset (new_block, 0, BLOCK_SECTOR_SIZE);
                     new_block->map_table[sec_loc.index2] = new_sector;
-                    bc_write(index_2nd_block, new_block, 0, 
+                    bc_write_meta(index_2nd_block, new_block, 0, 
                             BLOCK_SECTOR_SIZE, 0);
                 }
                 else {//no free map alloc
@@ -561,7 +1670,7 @@ bool register_sector (struct inode_disk *inode_disk,
                 }
             }
             else {
-                bc_write(index_2nd_block, &new_sector, 0, 
+                bc_write_meta(index_2nd_block, &new_sector, 0, 
                         sizeof(block_sector_t), 
                         map_table_offset(sec_loc.index2));
             }
@@ -575,6 +1684,13 @@ bool register_sector (struct inode_disk *inode_disk,
 
 block_sector_t byte_to_sector (const struct inode_disk *inode_disk, 
                                       off_t pos) {
+    return MAP_SECTOR (byte_to_entry (inode_disk, pos));
+}
+
+/* Returns the map entry for byte POS of INODE_DISK, including
+   its MAP_* flags, or 0 if POS is past the end. */
+static block_sector_t
+byte_to_entry (const struct inode_disk *inode_disk, off_t pos) {
     block_sector_t result_sec;// 반환할 디스크 블록 번호
     if (pos < inode_disk->length) {
       struct inode_indirect_block *ind_block;
@@ -649,10 +1765,21 @@ bool inode_update_file_length(struct inode_disk* inode_disk,
         if (chunk_size <= 0)
             break;
 
-        if (sector_ofs > 0) {
+        if (sector_ofs > 0
+            && ((inode_disk->flags & INODE_COMPRESSED)
+                || (byte_to_entry (inode_disk, offset) & MAP_UNWRITTEN))) {
+            /* 압축된 cluster나 unwritten 섹터는 섹터 내용이 곧
+               데이터가 아니므로 그대로 둠. 읽으면 0이 나옴 */
+        }
+        else if (sector_ofs > 0) {
             /* 블록오프셋이0보다클경우, 이미할당된블록*/
             sector_idx = byte_to_sector(inode_disk, offset);
             ASSERT(sector_idx != 0);
+            sector_idx = unshare_sector (inode_disk, offset, sector_idx, false);
+            if (sector_idx == 0) {
+                free(zeroes);
+                return false;
+            }
             //write at buffer cache
             bc_write(sector_idx, zeroes, 0, sector_left, sector_ofs);
         }
@@ -683,74 +1810,544 @@ bool inode_update_file_length(struct inode_disk* inode_disk,
     return true;
 }
 
-void free_inode_sectors (struct inode_disk *inode_disk) {
+/* Frees up to MAX of the last data sectors of the removed inode
+   at SECTOR, along with the index blocks that become empty, and
+   shrinks the inode to match, so that a crash after any call
+   leaves a consistent inode to carry on from.  Must be called
+   within a journal operation, and stops early rather than take
+   more than the transaction has room for.  Returns true if
+   nothing but the inode's own sector is left. */
+bool
+inode_reclaim (block_sector_t sector, size_t max)
+{
+    struct inode_disk *disk_inode = malloc (sizeof (struct inode_disk));
+    size_t sector_cnt;
 
-    int i, j;
+    if (disk_inode == NULL)
+        return false;
+    bc_read (sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
+    sector_cnt = bytes_to_sectors (disk_inode->length);
+
+    /* 뒤에서부터 해제하여 남은 map은 항상 유효 */
+    for (; sector_cnt > 0 && max > 0
+           && journal_extend (INODE_RECLAIM_CREDITS); max--) {
+        sector_cnt--;
+        release_data_sector (disk_inode,
+                             byte_to_sector (disk_inode,
+                                             sector_cnt * BLOCK_SECTOR_SIZE));
+        release_index_blocks (disk_inode, sector_cnt);
+    }
+    disk_inode->length = sector_cnt * BLOCK_SECTOR_SIZE;
+    bc_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
+    free (disk_inode);
+    return sector_cnt == 0;
+}
 
-    if (inode_disk->double_indirect_block_sec > 0) {
-        
-        struct inode_indirect_block *ind_block_1 = malloc (BLOCK_SECTOR_SIZE);
-        struct inode_indirect_block *ind_block_2 = malloc (BLOCK_SECTOR_SIZE);
-        
-        if ( (!ind_block_1) || (!ind_block_2) ) {//fail malloc
-            printf ("malloc fail inode.c :690\n");
+/* Frees the index blocks of DISK_INODE that are no longer needed
+   once data sector SECTOR_IDX, counted from the start of the
+   file, is the last one released. */
+static void
+release_index_blocks (struct inode_disk *disk_inode, size_t sector_idx)
+{
+    if (sector_idx >= DIRECT_BLOCK_ENTRIES + INDIRECT_BLOCK_ENTRIES) {
+        size_t idx = sector_idx - DIRECT_BLOCK_ENTRIES
+                     - INDIRECT_BLOCK_ENTRIES;
+        block_sector_t index_2nd_block;
+
+        if (idx % INDIRECT_BLOCK_ENTRIES != 0)
             return;
+        /* 2차 인덱스 블록의 첫 entry였으면 그 블록 해제 */
+        bc_read (disk_inode->double_indirect_block_sec, &index_2nd_block,
+                 0, sizeof (block_sector_t),
+                 map_table_offset (idx / INDIRECT_BLOCK_ENTRIES));
+        free_map_release (index_2nd_block, 1);
+        if (idx == 0) {
+            free_map_release (disk_inode->double_indirect_block_sec, 1);
+            disk_inode->double_indirect_block_sec = 0;
         }
-        bc_read (inode_disk->double_indirect_block_sec, ind_block_1, 0, BLOCK_SECTOR_SIZE, 0);
-        /* 1차인덱스블록을buffer cache에서읽음*/
-        i = 0;    
-        /* 1차인덱스블록을통해2차인덱스블록을차례로접근*/
-        while (ind_block_1->map_table[i] > 0) {
-            bc_read (ind_block_1->map_table[i], ind_block_2, 0, BLOCK_SECTOR_SIZE, 0);
-            /* 2차인덱스블록을buffer cache에서읽음*/
-            j = 0;
-            /* 2차인덱스블록에저장된디스크블록번호를접근*/
-            while (ind_block_2->map_table[j] > 0) {
-                /* free_map업데이틀통해디스크블록할당해지*/
-                free_map_release (ind_block_2->map_table[j], 1);
-                j++;
+    }
+    else if (sector_idx == DIRECT_BLOCK_ENTRIES) {
+        free_map_release (disk_inode->indirect_block_sec, 1);
+        disk_inode->indirect_block_sec = 0;
+    }
+}
+
+/* Returns the inode after the orphan inode at SECTOR. */
+block_sector_t
+inode_get_next_orphan (block_sector_t sector)
+{
+    block_sector_t next;
+
+    bc_read (sector, &next, 0, sizeof next,
+             offsetof (struct inode_disk, next_orphan));
+    return next;
+}
+
+/* Links the orphan inode at SECTOR to NEXT. */
+void
+inode_set_next_orphan (block_sector_t sector, block_sector_t next)
+{
+    bc_write_meta (sector, &next, 0, sizeof next,
+                   offsetof (struct inode_disk, next_orphan));
+}
+
+/* Releases data sector SECTOR of the file described by
+   INODE_DISK, unless a clone still references it. */
+static void
+release_data_sector (const struct inode_disk *inode_disk,
+                     block_sector_t sector)
+{
+    sector = MAP_SECTOR (sector);
+    if ((inode_disk->flags & INODE_SHARED) && refcount_unshare (sector))
+        return;
+    free_map_release (sector, 1);
+}
+
+/* Creates a copy-on-write clone of SRC: a new inode with SRC's
+   length whose map tables point at SRC's data sectors, each of
+   which gains a reference.  The work grows with the size of SRC:
+   the data is taken in runs of consecutive sectors whose
+   refcounts share a sector of the refcount file, each run in a
+   journal transaction of bounded size, and SRC is kept from
+   changing until the last one.  Meanwhile the clone sits in the
+   orphan list's building slot, so that it is reclaimed if the
+   clone fails or the system crashes; the caller links it into a
+   directory and takes it out with orphan_unhold().  Only one
+   clone may be built at a time.
+   Stores the clone's inode sector in *SECTORP and returns true if
+   successful, or returns false if allocation fails or some sector
+   already has the maximum number of references. */
+bool
+inode_clone (struct inode *src, block_sector_t *sectorp)
+{
+    struct inode_disk *src_disk, *disk_inode;
+    block_sector_t sector = 0;
+    size_t sector_cnt, i = 0;
+    bool success = false;
+
+    src_disk = malloc (sizeof (struct inode_disk));
+    disk_inode = calloc (1, sizeof (struct inode_disk));
+    if (src_disk == NULL || disk_inode == NULL) {
+        free (src_disk);
+        free (disk_inode);
+        return false;
+    }
+
+    /* 복제가 끝날 때까지 원본의 데이터와 map이 바뀌지 않도록 함 */
+    lock_acquire (&src->extend_lock);
+    while (src->io_cnt > 0 || src->migrating)
+        cond_wait (&src->migrate_done, &src->extend_lock);
+    src->migrating = true;
+    lock_release (&src->extend_lock);
+
+    get_disk_inode (src, src_disk);
+    sector_cnt = bytes_to_sectors (src_disk->length);
+
+    /* 빈 복제본을 만들어 building 자리에 둠 */
+    journal_begin (FREE_MAP_CREDITS (1) + 2 + ORPHAN_CREDITS);
+    if (free_map_allocate (1, &sector)) {
+        /* 원본도 이후의 쓰기에서 copy-on-write를 하도록 표시 */
+        if (!(src_disk->flags & INODE_SHARED)) {
+            src_disk->flags |= INODE_SHARED;
+            bc_write_meta (src->sector, src_disk, 0, BLOCK_SECTOR_SIZE, 0);
+        }
+        disk_inode->magic = INODE_MAGIC;
+        disk_inode->flags = src_disk->flags;
+        bc_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
+        orphan_hold (sector);
+        success = true;
+    }
+
+    while (success && i < sector_cnt) {
+        block_sector_t start = byte_to_sector (src_disk,
+                                               i * BLOCK_SECTOR_SIZE);
+        size_t n, j;
+
+        /* transaction이 차면 지금까지 등록한 만큼의 길이로 끊음 */
+        if (!journal_extend (CLONE_RUN_CREDITS)) {
+            disk_inode->length = i * BLOCK_SECTOR_SIZE;
+            bc_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
+            journal_restart (CLONE_RUN_CREDITS);
+        }
+
+        /* 디스크에서 연속된 섹터를 하나의 run으로 묶음 */
+        for (n = 1; n < INDIRECT_BLOCK_ENTRIES && i + n < sector_cnt
+                    && byte_to_sector (src_disk, (i + n) * BLOCK_SECTOR_SIZE)
+                       == start + n; n++)
+            continue;
+        n = refcount_share_run (start, n);
+        if (n == 0) {
+            success = false;
+            break;
+        }
+
+        for (j = 0; j < n; j++, i++) {
+            struct sector_location sec_loc;
+            locate_byte (i * BLOCK_SECTOR_SIZE, &sec_loc);
+            if (!register_sector (disk_inode,
+                                  byte_to_entry (src_disk,
+                                                 i * BLOCK_SECTOR_SIZE),
+                                  sec_loc)) {
+                /* 등록하지 못한 나머지의 참조를 되돌림 */
+                for (; j < n; j++)
+                    refcount_unshare (start + j);
+                success = false;
+                break;
             }
-            /* 2차인덱스블록할당해지*/
-            free_map_release (ind_block_1->map_table[i], 1);
-            i++;
         }
-        /* 1차인덱스블록할당해지*/
-        free_map_release (inode_disk->double_indirect_block_sec, 1);
-        free (ind_block_1);
-        free (ind_block_2);
     }
-    /* Indirect 방식으로할당된디스크블록해지 */
-    if (inode_disk->indirect_block_sec > 0) {
-        
-        struct inode_indirect_block *ind_block = malloc (BLOCK_SECTOR_SIZE);
 
-        //malloc fail
-        if (!ind_block) {
-            printf ("\ninode.c :696 malloc fail\n");
-            return;
+    /* 실패하면 등록한 만큼만 가진 복제본을 reclaim thread에 넘김 */
+    if (sector != 0) {
+        disk_inode->length = success ? src_disk->length
+                                     : (off_t) (i * BLOCK_SECTOR_SIZE);
+        bc_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
+        if (!success)
+            orphan_unhold (sector, true);
+    }
+    journal_end ();
+
+    lock_acquire (&src->extend_lock);
+    src->migrating = false;
+    cond_broadcast (&src->migrate_done, &src->extend_lock);
+    lock_release (&src->extend_lock);
+
+    *sectorp = sector;
+    free (src_disk);
+    free (disk_inode);
+    return success;
+}
+
+/* Returns the number of index blocks in the map of a file of
+   SECTOR_CNT sectors. */
+static size_t
+index_block_cnt (size_t sector_cnt)
+{
+    size_t cnt = 0;
+
+    if (sector_cnt > DIRECT_BLOCK_ENTRIES)
+        cnt++;
+    if (sector_cnt > DIRECT_BLOCK_ENTRIES + INDIRECT_BLOCK_ENTRIES)
+        cnt += 1 + DIV_ROUND_UP (sector_cnt - DIRECT_BLOCK_ENTRIES
+                                 - INDIRECT_BLOCK_ENTRIES,
+                                 INDIRECT_BLOCK_ENTRIES);
+    return cnt;
+}
+
+/* Sets INODE_SHARED in INODE's on-disk inode. */
+static void
+mark_shared (struct inode *inode)
+{
+    struct inode_disk *disk_inode = malloc (sizeof (struct inode_disk));
+    if (disk_inode == NULL)
+        return;
+
+    lock_acquire (&inode->extend_lock);
+    get_disk_inode (inode, disk_inode);
+    disk_inode->flags |= INODE_SHARED;
+    bc_write_meta (inode->sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
+    lock_release (&inode->extend_lock);
+    free (disk_inode);
+}
+
+/* Makes the data sector holding byte POS of DISK_INODE, currently
+   SECTOR, private to this file before it is written.  If a clone
+   still shares it, allocates a new sector, copies the old
+   contents unless WHOLE says the caller overwrites the entire
+   sector, and points the map entry at the copy.
+   Returns the sector to write, or 0 if allocation fails. */
+static block_sector_t
+unshare_sector (struct inode_disk *disk_inode, off_t pos,
+                block_sector_t sector, bool whole)
+{
+    block_sector_t new_sector;
+    struct sector_location sec_loc;
+
+    if (!(disk_inode->flags & INODE_SHARED))
+        return sector;
+
+    refcount_lock ();
+    if (refcount_is_shared (sector)) {
+        if (!free_map_allocate (1, &new_sector)) {
+            refcount_unlock ();
+            return 0;
         }
-        /* 인덱스블록을buffer cache에서읽음*/
-        bc_read (inode_disk->double_indirect_block_sec, ind_block, 0, BLOCK_SECTOR_SIZE, 0);
-        i = 0;   
-        /* 인덱스블록에저장된디스크블록번호를접근*/
-        
-        while (ind_block->map_table[i] > 0) {
-            /* free_map업데이트를통해디스크블록할당해지*/
-            free_map_release (ind_block->map_table[i], 1);
-            i++;
+        if (!whole)
+            bc_copy (new_sector, 0, sector, 0, BLOCK_SECTOR_SIZE);
+
+        locate_byte (pos, &sec_loc);
+        if (!register_sector (disk_inode, new_sector, sec_loc)) {
+            free_map_release (new_sector, 1);
+            refcount_unlock ();
+            return 0;
         }
-        free_map_release (inode_disk->indirect_block_sec, 1);
-        free (ind_block);
+        refcount_unshare (sector);
+        sector = new_sector;
     }
+    refcount_unlock ();
+    return sector;
+}
 
-    i = 0;
-    /* Direct 방식으로할당된디스크블록해지*/
-    while (inode_disk->direct_map_table[i] > 0) {
-        /* free_map업데이트를통해디스크블록할당해지*/
-        free_map_release (inode_disk->direct_map_table[i], 1);
-        i++;
+/* Points the map entry for byte POS of DISK_INODE, currently
+   OLD_SECTOR, at NEW_SECTOR, which belongs to another file, and
+   gives up OLD_SECTOR.  Returns false, changing nothing, if
+   NEW_SECTOR cannot take another reference. */
+static bool
+share_sector (struct inode_disk *disk_inode, off_t pos,
+              block_sector_t old_sector, block_sector_t new_sector)
+{
+    struct sector_location sec_loc;
+
+    if (old_sector == new_sector)
+        return true;
+    if (!refcount_share (new_sector))
+        return false;
+
+    locate_byte (pos, &sec_loc);
+    if (!register_sector (disk_inode, new_sector, sec_loc)) {
+        refcount_unshare (new_sector);
+        return false;
     }
+    release_data_sector (disk_inode, old_sector);
+    disk_inode->flags |= INODE_SHARED;
+    return true;
+}
 
+/* Marks the start of a read or write of INODE's data, waiting
+   first for the defragmenter to finish moving it or a clone to
+   finish sharing it. */
+static void
+io_begin (struct inode *inode)
+{
+    lock_acquire (&inode->extend_lock);
+    while (inode->migrating)
+        cond_wait (&inode->migrate_done, &inode->extend_lock);
+    inode->io_cnt++;
+    lock_release (&inode->extend_lock);
+}
+
+/* Marks the end of a read or write of INODE's data, waking a
+   clone waiting for the last one. */
+static void
+io_end (struct inode *inode)
+{
+    lock_acquire (&inode->extend_lock);
+    if (--inode->io_cnt == 0)
+        cond_broadcast (&inode->migrate_done, &inode->extend_lock);
+    lock_release (&inode->extend_lock);
+}
+
+/* Returns the number of runs of consecutive sectors that hold
+   INODE's data, or 0 if INODE is a directory, shares sectors
+   with a clone or is empty.  Such inodes are left to
+   inode_defrag(). */
+size_t
+inode_extent_cnt (struct inode *inode)
+{
+    struct inode_disk *disk_inode;
+    block_sector_t *sectors = NULL;
+    size_t sector_cnt, result = 0;
+
+    if (!(disk_inode = malloc (sizeof (struct inode_disk))))
+        return 0;
+
+    io_begin (inode);
+    get_disk_inode (inode, disk_inode);
+    sector_cnt = bytes_to_sectors (disk_inode->length);
+    if (!disk_inode->is_dir
+        && !(disk_inode->flags
+             & (INODE_SHARED | INODE_COMPRESSED | INODE_PREALLOC))
+        && sector_cnt > 0
+        && (sectors = malloc (sector_cnt * sizeof *sectors)) != NULL
+        && walk_map (disk_inode, sectors, sector_cnt, false))
+        result = count_extents (sectors, sector_cnt);
+    io_end (inode);
+
+    free (sectors);
+    free (disk_inode);
+    return result;
+}
+
+/* Moves the data of INODE, a regular file, into a single run of
+   consecutive free sectors so that it reads sequentially again.
+   The new sectors are only reserved while the data is copied and
+   flushed to disk, outside any journal operation; the swap of
+   the map entries, together with the allocation of the new
+   sectors and the release of the old ones, is one journal
+   transaction.  Gives up, changing
+   nothing, if INODE is being read or written, is already
+   contiguous, shares sectors with a clone, is too large to move
+   in one journal transaction, or no free run is long enough.
+   Returns true if INODE was moved. */
+bool
+inode_defrag (struct inode *inode)
+{
+    struct inode_disk *disk_inode;
+    block_sector_t *old_sectors = NULL, *new_sectors = NULL, start;
+    size_t sector_cnt, credits, i;
+    bool success = false;
+
+    if (!(disk_inode = malloc (sizeof (struct inode_disk))))
+        return false;
+    get_disk_inode (inode, disk_inode);
+    if (disk_inode->is_dir) {
+        free (disk_inode);
+        return false;
+    }
+
+    lock_acquire (&inode->extend_lock);
+    if (inode->io_cnt > 0 || inode->migrating || inode->removed) {
+        lock_release (&inode->extend_lock);
+        free (disk_inode);
+        return false;
+    }
+    inode->migrating = true;
+    lock_release (&inode->extend_lock);
+
+    /* 다른 접근이 없으므로 map을 다시 읽어도 바뀌지 않음 */
+    get_disk_inode (inode, disk_inode);
+    sector_cnt = bytes_to_sectors (disk_inode->length);
+    if (!(disk_inode->flags
+          & (INODE_SHARED | INODE_COMPRESSED | INODE_PREALLOC))
+        && sector_cnt > 1
+        && (old_sectors = malloc (sector_cnt * sizeof *old_sectors)) != NULL
+        && (new_sectors = malloc (sector_cnt * sizeof *new_sectors)) != NULL
+        && walk_map (disk_inode, old_sectors, sector_cnt, false)
+        && count_extents (old_sectors, sector_cnt) > 1
+        && (credits = defrag_credits (old_sectors, sector_cnt))
+           <= journal_max_credits ()
+        && free_map_reserve (sector_cnt, &start)) {
+        for (i = 0; i < sector_cnt; i++) {
+            new_sectors[i] = start + i;
+            bc_copy (new_sectors[i], 0, old_sectors[i], 0,
+                     BLOCK_SECTOR_SIZE);
+        }
+        /* 새 map이 commit되기 전에 데이터가 디스크에 있어야 함 */
+        bc_flush_all_entries ();
+
+        /* map 교체와 옛 섹터 해제만 하나의 transaction으로 */
+        journal_begin (credits);
+        if (walk_map (disk_inode, new_sectors, sector_cnt, true)) {
+            free_map_confirm (start, sector_cnt);
+            bc_write_meta (inode->sector, disk_inode, 0,
+                           BLOCK_SECTOR_SIZE, 0);
+            for (i = 0; i < sector_cnt; i++)
+                free_map_release (old_sectors[i], 1);
+            success = true;
+        }
+        else
+            free_map_cancel (start, sector_cnt);
+        journal_end ();
+    }
+
+    lock_acquire (&inode->extend_lock);
+    inode->migrating = false;
+    cond_broadcast (&inode->migrate_done, &inode->extend_lock);
+    lock_release (&inode->extend_lock);
+
+    free (old_sectors);
+    free (new_sectors);
+    free (disk_inode);
+    return success;
+}
+
+/* Copies the map entry ENTRY into *SECTOR, or with STORE, the
+   other way around.  Returns false if the entry is empty. */
+static inline bool
+map_entry (block_sector_t *entry, block_sector_t *sector, bool store)
+{
+    if (store)
+        *entry = *sector;
+    else
+        *sector = *entry;
+    return *sector != 0;
+}
+
+/* Copies the map entries of the first CNT data sectors of
+   DISK_INODE, in file order, into SECTORS, or with STORE, sets
+   them from SECTORS instead, writing back the index blocks.
+   Returns false if memory runs out or a sector is missing; the
+   caller must then discard DISK_INODE. */
+static bool
+walk_map (struct inode_disk *disk_inode, block_sector_t *sectors,
+          size_t cnt, bool store)
+{
+    struct inode_indirect_block *ind_block_1 = NULL, *ind_block_2 = NULL;
+    size_t i = 0, j, k;
+
+    for (j = 0; i < cnt && j < DIRECT_BLOCK_ENTRIES; i++, j++)
+        if (!map_entry (&disk_inode->direct_map_table[j], &sectors[i], store))
+            return false;
+    if (i == cnt)
+        return true;
+
+    ind_block_1 = malloc (BLOCK_SECTOR_SIZE);
+    ind_block_2 = malloc (BLOCK_SECTOR_SIZE);
+    if (!ind_block_1 || !ind_block_2)
+        goto done;
+
+    /* Indirect 방식의 map entry */
+    bc_read (disk_inode->indirect_block_sec, ind_block_1, 0,
+             BLOCK_SECTOR_SIZE, 0);
+    for (j = 0; i < cnt && j < INDIRECT_BLOCK_ENTRIES; i++, j++)
+        if (!map_entry (&ind_block_1->map_table[j], &sectors[i], store))
+            goto done;
+    if (store)
+        bc_write_meta (disk_inode->indirect_block_sec, ind_block_1, 0,
+                       BLOCK_SECTOR_SIZE, 0);
+    if (i == cnt)
+        goto done;
+
+    /* Double indirect 방식의 map entry */
+    bc_read (disk_inode->double_indirect_block_sec, ind_block_1, 0,
+             BLOCK_SECTOR_SIZE, 0);
+    for (k = 0; i < cnt && k < INDIRECT_BLOCK_ENTRIES; k++) {
+        bc_read (ind_block_1->map_table[k], ind_block_2, 0,
+                 BLOCK_SECTOR_SIZE, 0);
+        for (j = 0; i < cnt && j < INDIRECT_BLOCK_ENTRIES; i++, j++)
+            if (!map_entry (&ind_block_2->map_table[j], &sectors[i], store))
+                goto done;
+        if (store)
+            bc_write_meta (ind_block_1->map_table[k], ind_block_2, 0,
+                           BLOCK_SECTOR_SIZE, 0);
+    }
+
+ done:
+    free (ind_block_1);
+    free (ind_block_2);
+    return i == cnt;
+}
+
+/* Returns the number of runs of consecutive sector numbers among
+   the CNT entries of SECTORS. */
+static size_t
+count_extents (const block_sector_t *sectors, size_t cnt)
+{
+    size_t i, extents = cnt > 0;
+
+    for (i = 1; i < cnt; i++)
+        if (sectors[i] != sectors[i - 1] + 1)
+            extents++;
+    return extents;
+}
+
+/* Returns the journal credits that moving the CNT data SECTORS
+   of a file into a new run can use: allocating the run, writing
+   the index blocks and the inode, and freeing the old sectors. */
+static size_t
+defrag_credits (const block_sector_t *sectors, size_t cnt)
+{
+    block_sector_t lo = sectors[0], hi = sectors[0];
+    size_t i;
+
+    for (i = 1; i < cnt; i++) {
+        if (sectors[i] < lo)
+            lo = sectors[i];
+        if (sectors[i] > hi)
+            hi = sectors[i];
+    }
+    return (FREE_MAP_CREDITS (cnt) + index_block_cnt (cnt) + 1
+            + FREE_MAP_CREDITS (hi - lo + 1));
 }
 
 bool inode_is_dir (const struct inode *inode) {
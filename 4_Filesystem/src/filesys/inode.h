@@ -2,6 +2,7 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <iovec.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 #include "filesys/directory.h"
@@ -9,8 +10,16 @@
 
 struct bitmap;
 
+/* Journal credits, see journal_begin(), that inode_reclaim()
+   keeps in hand: enough to free one more data sector and the
+   index blocks it empties and write the inode back, and for the
+   caller then to unlink the inode from the orphan list and free
+   its sector. */
+#define INODE_RECLAIM_CREDITS 7
+
 void inode_init (void);
 bool inode_create (block_sector_t, off_t, uint32_t);
+bool inode_clone (struct inode *, block_sector_t *);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
@@ -18,9 +27,24 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_readv_at (struct inode *, const struct iovec *, int iovcnt,
+                      off_t offset, bool direct);
+off_t inode_writev_at (struct inode *, const struct iovec *, int iovcnt,
+                       off_t offset, bool direct);
+off_t inode_copy_range (struct inode *src, off_t src_ofs,
+                        struct inode *dst, off_t dst_ofs, off_t size);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+bool inode_set_compressed (struct inode *);
+bool inode_fallocate (struct inode *, off_t offset, off_t length);
+bool inode_extend (struct inode *, off_t length);
+bool inode_advise (struct inode *, off_t offset, off_t len, int advice);
+size_t inode_extent_cnt (struct inode *);
+bool inode_reclaim (block_sector_t, size_t max);
+block_sector_t inode_get_next_orphan (block_sector_t);
+void inode_set_next_orphan (block_sector_t, block_sector_t next);
+bool inode_defrag (struct inode *);
 
 bool inode_is_removed(const struct inode *); 
 bool inode_is_dir(const struct inode *); 
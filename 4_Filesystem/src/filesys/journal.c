@@ -0,0 +1,699 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/blocktrace.h"
+#include "devices/timer.h"
+#include "filesys/buffer_cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/superblock.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Every operation that changes metadata (create, remove, mkdir,
+   extending or cloning a file, ...) runs between journal_begin()
+   and journal_end().  Metadata sectors written in between with
+   bc_write_meta() join the running transaction and stay pinned
+   in the buffer cache, so they cannot reach their home location
+   before they are in the log.
+
+   journal_begin() takes the most sectors the operation can add
+   to the transaction, its credits, and holds the operation back
+   until the running transaction has room for that many; with no
+   operation left to finish, that means committing it first.  So
+   no transaction grows past JOURNAL_TXN_MAX sectors, which also
+   bounds how much of the buffer cache is pinned.  An operation
+   whose worst case is larger, such as a big write or a clone,
+   asks for more with journal_extend() as it goes, and where the
+   transaction is full, brings its changes to a consistent point
+   and carries on in the next with journal_restart().
+
+   Operations from all threads share one running transaction.  A
+   commit, run every JOURNAL_COMMIT_TICKS by the commit thread or
+   as soon as the transaction reaches JOURNAL_COMMIT_THRESHOLD
+   sectors, waits for the operations in progress to finish, holds
+   off new ones, and writes the whole group to the log in one
+   sequential pass:
+
+       descriptor   magic, sequence number, home sectors
+       data         one copy of each sector, in order
+       commit       magic, sequence number, checksum of the data
+
+   After that the buffers are unpinned and written home whenever
+   the cache gets to them.  Log space is reclaimed lazily: only
+   when too little is left for another full transaction is the
+   whole cache flushed and the log restarted right after its
+   header.
+
+   At mount after an unclean shutdown, every complete transaction
+   in the log is copied to its home sectors, in order.  A
+   transaction without a valid commit block is ignored, so an
+   operation is either all on disk or not at all.
+
+   Freeing a sector that is still in the log would let replay
+   write stale metadata over whatever the sector is reused for.
+   free_map_release() therefore calls journal_revoke(), and the
+   commit block lists the revoked sectors; replay skips logged
+   copies of a sector revoked by a later transaction.
+
+   Nothing is ever written in place to make room: an operation
+   that outruns its credits may still take whatever room no one
+   else has reserved, and beyond that the kernel panics. */
+
+/* Size of the log created by a format, in sectors. */
+#define JOURNAL_SECTORS 256
+
+/* Most home sectors one transaction can log. */
+#define JOURNAL_DESC_MAX 62
+
+/* Most sectors a transaction may take, so that it keeps no more
+   than BC_PIN_MAX buffers pinned. */
+#define JOURNAL_TXN_MAX (BC_PIN_MAX < JOURNAL_DESC_MAX \
+                         ? BC_PIN_MAX : JOURNAL_DESC_MAX)
+
+/* Most sectors one transaction can revoke. */
+#define JOURNAL_REVOKE_MAX 124
+
+/* Commit once a transaction has this many sectors or
+   revocations... */
+#define JOURNAL_COMMIT_THRESHOLD (JOURNAL_TXN_MAX * 3 / 4)
+
+/* ...or at least this often. */
+#define JOURNAL_COMMIT_TICKS (TIMER_FREQ / 5)
+
+#define JOURNAL_MAGIC 0x4a524e4c        /* "JRNL", log header. */
+#define JOURNAL_DESC_MAGIC 0x4a445343   /* "JDSC", descriptor. */
+#define JOURNAL_COMMIT_MAGIC 0x4a434d54 /* "JCMT", commit block. */
+
+/* Log header, the first sector of the log.  SEQ is the sequence
+   number of the first transaction after it. */
+struct journal_header
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* First sequence number. */
+    uint32_t unused[126];               /* Not used. */
+  };
+
+/* Descriptor block, starting each transaction. */
+struct journal_desc
+  {
+    uint32_t magic;                     /* JOURNAL_DESC_MAGIC. */
+    uint32_t seq;                       /* Sequence number. */
+    uint32_t cnt;                       /* Number of data blocks. */
+    block_sector_t sectors[JOURNAL_DESC_MAX];   /* Home sectors. */
+    uint32_t unused[128 - 3 - JOURNAL_DESC_MAX];
+  };
+
+/* Commit block, ending each transaction. */
+struct journal_commit_block
+  {
+    uint32_t magic;                     /* JOURNAL_COMMIT_MAGIC. */
+    uint32_t seq;                       /* Sequence number. */
+    uint32_t checksum;                  /* Over the data blocks. */
+    uint32_t revoke_cnt;                /* Number of revoked sectors. */
+    block_sector_t revoked[JOURNAL_REVOKE_MAX]; /* Revoked sectors. */
+  };
+
+static bool active;                     /* Journaling enabled? */
+static block_sector_t log_start;        /* First sector of the log. */
+static uint32_t log_cnt;                /* Sectors in the log. */
+static uint32_t log_ofs;                /* Next free offset in log. */
+static uint32_t seq;                    /* Running transaction's number. */
+
+static struct lock journal_lock;        /* Protects the fields below. */
+static struct condition journal_cond;   /* Signaled on state changes. */
+static int handles;                     /* Operations in progress. */
+static bool committing;                 /* Commit in progress? */
+static block_sector_t txn[JOURNAL_DESC_MAX];   /* Running transaction. */
+static size_t txn_cnt;                  /* Sectors in txn[]. */
+static size_t reserved;                 /* Credits not used yet. */
+static block_sector_t revoked[JOURNAL_REVOKE_MAX]; /* Its revocations. */
+static size_t revoke_cnt;               /* Sectors in revoked[]. */
+static block_sector_t *logged;          /* Sectors in the log now. */
+static size_t logged_cnt;               /* Sectors in logged[]. */
+static uint32_t checkpoints;            /* Times the log was emptied. */
+
+static void commit_thread (void *aux);
+static void write_transaction (const block_sector_t *, size_t cnt,
+                               const block_sector_t *revokes,
+                               size_t revoke_cnt);
+static void checkpoint (void);
+static void write_header (void);
+static void replay (void);
+static bool read_transaction (uint32_t ofs, uint32_t want_seq,
+                              struct journal_desc *,
+                              struct journal_commit_block *,
+                              uint8_t *block);
+static uint32_t checksum_add (uint32_t, const void *block);
+
+/* Allocates a log for a new file system and writes its header.
+   Stores its first sector in *SECTORP and its size in *CNTP, or
+   0 in *CNTP if the device has no room for one. */
+void
+journal_create (block_sector_t *sectorp, uint32_t *cntp)
+{
+  *cntp = 0;
+  if (!free_map_allocate (JOURNAL_SECTORS, sectorp))
+    return;
+  *cntp = JOURNAL_SECTORS;
+
+  log_start = *sectorp;
+  log_cnt = JOURNAL_SECTORS;
+  seq = 1;
+  write_header ();
+}
+
+/* Opens the log recorded in the superblock, if any.  Unless the
+   file system was CLEAN, replays committed transactions first.
+   Then starts journaling with an empty log. */
+void
+journal_open (bool clean)
+{
+  const struct superblock *sb = superblock_get ();
+  struct journal_header *header;
+  enum blocktrace_source old_source;
+
+  ASSERT (sizeof (struct journal_desc) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_commit_block) == BLOCK_SECTOR_SIZE);
+
+  if (!(sb->features & SB_FEATURE_JOURNAL))
+    return;
+  log_start = sb->journal_sector;
+  log_cnt = sb->journal_cnt;
+  ASSERT (log_cnt > 2 * (JOURNAL_DESC_MAX + 2));
+  old_source = blocktrace_set_source (BLOCKTRACE_JOURNAL);
+
+  header = malloc (BLOCK_SECTOR_SIZE);
+  if (header == NULL)
+    PANIC ("out of memory opening journal");
+  block_read (fs_device, log_start, header);
+  if (header->magic != JOURNAL_MAGIC)
+    PANIC ("journal header corrupted");
+  seq = header->seq;
+  free (header);
+
+  if (!clean)
+    replay ();
+  log_ofs = 1;
+  write_header ();
+  blocktrace_set_source (old_source);
+
+  lock_init (&journal_lock);
+  cond_init (&journal_cond);
+  handles = 0;
+  committing = false;
+  txn_cnt = revoke_cnt = logged_cnt = reserved = 0;
+  logged = malloc (log_cnt * sizeof *logged);
+  if (logged == NULL)
+    PANIC ("out of memory opening journal");
+  active = true;
+  if (thread_create ("journal", PRI_DEFAULT, commit_thread, NULL)
+      == TID_ERROR)
+    PANIC ("could not start journal commit thread");
+}
+
+/* Commits the running transaction and checkpoints the log, so
+   that it is empty at unmount.  Stops journaling. */
+void
+journal_close (void)
+{
+  if (!active)
+    return;
+  journal_commit ();
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_cond, &journal_lock);
+  checkpoint ();
+  active = false;
+  lock_release (&journal_lock);
+}
+
+/* Starts a metadata operation that adds at most CREDITS sectors
+   to the running transaction.  Waits until the transaction has
+   room for them, committing it if no other operation is left to
+   end.  Calls nest; only the outermost pair counts, and it must
+   reserve enough for the inner ones. */
+void
+journal_begin (size_t credits)
+{
+  struct thread *t = thread_current ();
+
+  if (!active || t->journal_depth++ > 0)
+    return;
+  ASSERT (credits <= JOURNAL_TXN_MAX);
+
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      if (committing)
+        cond_wait (&journal_cond, &journal_lock);
+      else if (txn_cnt + reserved + credits <= JOURNAL_TXN_MAX)
+        break;
+      else if (handles > 0)
+        cond_wait (&journal_cond, &journal_lock);
+      else
+        {
+          lock_release (&journal_lock);
+          journal_commit ();
+          lock_acquire (&journal_lock);
+        }
+    }
+  handles++;
+  reserved += credits;
+  t->journal_credits = credits;
+  lock_release (&journal_lock);
+}
+
+/* Returns the most credits that one operation can hold. */
+size_t
+journal_max_credits (void)
+{
+  return JOURNAL_TXN_MAX;
+}
+
+/* Makes sure the current operation holds at least CREDITS unused
+   credits, taking more from the running transaction if it has
+   room.  Returns false if it has not; the caller should then
+   bring its changes to a consistent point and call
+   journal_restart().  A nested operation cannot be split, so for
+   it this always returns true and it takes what room is left. */
+bool
+journal_extend (size_t credits)
+{
+  struct thread *t = thread_current ();
+  bool success = true;
+
+  if (!active)
+    return true;
+  ASSERT (t->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  if (t->journal_credits < credits)
+    {
+      size_t more = credits - t->journal_credits;
+      success = txn_cnt + reserved + more <= JOURNAL_TXN_MAX;
+      if (success)
+        {
+          reserved += more;
+          t->journal_credits = credits;
+        }
+    }
+  lock_release (&journal_lock);
+  return success || t->journal_depth > 1;
+}
+
+/* Ends the current operation and starts another with CREDITS
+   credits, letting the transaction commit in between.  Does
+   nothing if the operation is nested in another, whose changes
+   must stay in one transaction. */
+void
+journal_restart (size_t credits)
+{
+  if (!active || thread_current ()->journal_depth > 1)
+    return;
+  journal_end ();
+  journal_begin (credits);
+}
+
+/* Ends a metadata operation.  The thread whose operation brings
+   the transaction to the commit threshold commits it for the
+   whole group. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+  bool full;
+
+  if (t->journal_depth == 0 || --t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  handles--;
+  reserved -= t->journal_credits;
+  t->journal_credits = 0;
+  full = (txn_cnt >= JOURNAL_COMMIT_THRESHOLD
+          || revoke_cnt >= JOURNAL_COMMIT_THRESHOLD);
+  /* The credits given back may be what a waiting operation
+     needs. */
+  cond_broadcast (&journal_cond, &journal_lock);
+  lock_release (&journal_lock);
+
+  if (full)
+    journal_commit ();
+}
+
+/* Adds SECTOR to the running transaction, using one of the
+   current operation's credits unless it is there already.  Must
+   be called between journal_begin() and journal_end().  Returns
+   true if SECTOR is logged and its buffer must be pinned, false
+   if journaling is off. */
+bool
+journal_add (block_sector_t sector)
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  if (!active)
+    return false;
+  ASSERT (t->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < txn_cnt; i++)
+    if (txn[i] == sector)
+      break;
+  if (i == txn_cnt)
+    {
+      if (t->journal_credits > 0)
+        {
+          t->journal_credits--;
+          reserved--;
+        }
+      else if (txn_cnt + reserved >= JOURNAL_TXN_MAX)
+        PANIC ("journal transaction overflow at sector %"PRDSNu,
+               sector);
+      txn[txn_cnt++] = sector;
+    }
+  lock_release (&journal_lock);
+  return true;
+}
+
+/* Records that SECTOR has been freed, so that no copy of it in
+   the log is replayed over its next use.  A copy in the running
+   transaction is simply dropped.  Returns false if the commit
+   block has no room left to record it; SECTOR must then not be
+   reused until journal_checkpoints() changes, when no copy of it
+   is left in the log. */
+bool
+journal_revoke (block_sector_t sector)
+{
+  bool success = true;
+  size_t i;
+
+  if (!active)
+    return true;
+  journal_begin (0);
+  lock_acquire (&journal_lock);
+
+  for (i = 0; i < txn_cnt; i++)
+    if (txn[i] == sector)
+      {
+        txn[i] = txn[--txn_cnt];
+        bc_unpin (sector);
+        break;
+      }
+
+  for (i = 0; i < logged_cnt; i++)
+    if (logged[i] == sector)
+      break;
+  if (i < logged_cnt)
+    {
+      if (revoke_cnt < JOURNAL_REVOKE_MAX)
+        revoked[revoke_cnt++] = sector;
+      else
+        success = false;
+    }
+
+  lock_release (&journal_lock);
+  journal_end ();
+  return success;
+}
+
+/* Commits the running transaction, if it is not empty.  Must not
+   be called between journal_begin() and journal_end(). */
+void
+journal_commit (void)
+{
+  static block_sector_t sectors[JOURNAL_DESC_MAX];
+  static block_sector_t revokes[JOURNAL_REVOKE_MAX];
+  size_t cnt, rcnt, i;
+
+  if (!active)
+    return;
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_cond, &journal_lock);
+  if (txn_cnt == 0 && revoke_cnt == 0)
+    {
+      lock_release (&journal_lock);
+      return;
+    }
+
+  /* Close the transaction to new operations and let the ones in
+     progress finish. */
+  committing = true;
+  while (handles > 0)
+    cond_wait (&journal_cond, &journal_lock);
+  cnt = txn_cnt;
+  rcnt = revoke_cnt;
+  memcpy (sectors, txn, cnt * sizeof *sectors);
+  memcpy (revokes, revoked, rcnt * sizeof *revokes);
+  txn_cnt = revoke_cnt = 0;
+  lock_release (&journal_lock);
+
+  /* Nothing can change the logged sectors now, so the log can be
+     written without the lock. */
+  write_transaction (sectors, cnt, revokes, rcnt);
+  for (i = 0; i < cnt; i++)
+    bc_unpin (sectors[i]);
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j;
+      for (j = 0; j < logged_cnt; j++)
+        if (logged[j] == sectors[i])
+          break;
+      if (j == logged_cnt)
+        logged[logged_cnt++] = sectors[i];
+    }
+  if (log_cnt - log_ofs < JOURNAL_DESC_MAX + 2)
+    checkpoint ();
+  committing = false;
+  cond_broadcast (&journal_cond, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Returns the number of times the log has been emptied so far.
+   Once it changes, no sector freed before is left in the log. */
+uint32_t
+journal_checkpoints (void)
+{
+  return checkpoints;
+}
+
+/* Commit thread: commits at regular intervals, so that small
+   transactions do not wait indefinitely for the threshold. */
+static void
+commit_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (JOURNAL_COMMIT_TICKS);
+      journal_commit ();
+    }
+}
+
+/* Writes the CNT home sectors in SECTORS, with their current
+   contents, and the RCNT revoked sectors in REVOKES to the log as
+   transaction SEQ, and advances. */
+static void
+write_transaction (const block_sector_t *sectors, size_t cnt,
+                   const block_sector_t *revokes, size_t rcnt)
+{
+  struct journal_desc *desc;
+  struct journal_commit_block *commit;
+  uint8_t *block;
+  uint32_t checksum = 0;
+  enum blocktrace_source old_source;
+  size_t i;
+
+  ASSERT (cnt <= JOURNAL_DESC_MAX);
+  ASSERT (log_ofs + cnt + 2 <= log_cnt);
+
+  desc = calloc (1, sizeof *desc);
+  commit = calloc (1, sizeof *commit);
+  block = malloc (BLOCK_SECTOR_SIZE);
+  if (desc == NULL || commit == NULL || block == NULL)
+    PANIC ("out of memory committing journal");
+
+  old_source = blocktrace_set_source (BLOCKTRACE_JOURNAL);
+  desc->magic = JOURNAL_DESC_MAGIC;
+  desc->seq = seq;
+  desc->cnt = cnt;
+  memcpy (desc->sectors, sectors, cnt * sizeof *sectors);
+  block_write (fs_device, log_start + log_ofs, desc);
+
+  for (i = 0; i < cnt; i++)
+    {
+      bc_read (sectors[i], block, 0, BLOCK_SECTOR_SIZE, 0);
+      checksum = checksum_add (checksum, block);
+      block_write (fs_device, log_start + log_ofs + 1 + i, block);
+    }
+
+  /* The commit block goes last: until it is on disk, the
+     transaction does not exist. */
+  commit->magic = JOURNAL_COMMIT_MAGIC;
+  commit->seq = seq;
+  commit->checksum = checksum;
+  commit->revoke_cnt = rcnt;
+  memcpy (commit->revoked, revokes, rcnt * sizeof *revokes);
+  block_write (fs_device, log_start + log_ofs + 1 + cnt, commit);
+
+  blocktrace_set_source (old_source);
+
+  log_ofs += cnt + 2;
+  seq++;
+  free (desc);
+  free (commit);
+  free (block);
+}
+
+/* Writes every committed change home and empties the log.
+   Called with journal_lock held and no transaction pinned. */
+static void
+checkpoint (void)
+{
+  bc_flush_all_entries ();
+  log_ofs = 1;
+  logged_cnt = 0;
+  write_header ();
+  checkpoints++;
+}
+
+/* Writes the log header, marking SEQ as the next transaction. */
+static void
+write_header (void)
+{
+  struct journal_header *header = calloc (1, sizeof *header);
+  enum blocktrace_source old_source;
+
+  if (header == NULL)
+    PANIC ("out of memory writing journal header");
+  header->magic = JOURNAL_MAGIC;
+  header->seq = seq;
+  old_source = blocktrace_set_source (BLOCKTRACE_JOURNAL);
+  block_write (fs_device, log_start, header);
+  blocktrace_set_source (old_source);
+  free (header);
+}
+
+/* A sector revoked by transaction SEQ, found during replay. */
+struct revoke_rec
+  {
+    struct list_elem elem;
+    block_sector_t sector;
+    uint32_t seq;
+  };
+
+/* Reads the transaction at log offset OFS into DESC and COMMIT
+   and checks that it is complete and numbered WANT_SEQ, using
+   BLOCK as scratch space. */
+static bool
+read_transaction (uint32_t ofs, uint32_t want_seq,
+                  struct journal_desc *desc,
+                  struct journal_commit_block *commit, uint8_t *block)
+{
+  uint32_t checksum = 0;
+  uint32_t i;
+
+  if (ofs + 2 > log_cnt)
+    return false;
+  block_read (fs_device, log_start + ofs, desc);
+  if (desc->magic != JOURNAL_DESC_MAGIC || desc->seq != want_seq
+      || desc->cnt > JOURNAL_DESC_MAX || ofs + desc->cnt + 2 > log_cnt)
+    return false;
+  block_read (fs_device, log_start + ofs + 1 + desc->cnt, commit);
+  if (commit->magic != JOURNAL_COMMIT_MAGIC || commit->seq != want_seq
+      || commit->revoke_cnt > JOURNAL_REVOKE_MAX)
+    return false;
+  for (i = 0; i < desc->cnt; i++)
+    {
+      block_read (fs_device, log_start + ofs + 1 + i, block);
+      checksum = checksum_add (checksum, block);
+    }
+  return checksum == commit->checksum;
+}
+
+/* Returns true if SECTOR, logged by transaction SEQ, was revoked
+   by a later transaction in REVOKES. */
+static bool
+is_revoked (struct list *revokes, block_sector_t sector, uint32_t seq)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (revokes); e != list_end (revokes); e = list_next (e))
+    {
+      struct revoke_rec *r = list_entry (e, struct revoke_rec, elem);
+      if (r->sector == sector && r->seq > seq)
+        return true;
+    }
+  return false;
+}
+
+/* Copies every complete transaction in the log, oldest first, to
+   its home sectors, stopping at the first one that is torn or
+   belongs to an older generation of the log.  A first pass finds
+   the complete transactions and collects their revocations. */
+static void
+replay (void)
+{
+  struct journal_desc *desc = malloc (sizeof *desc);
+  struct journal_commit_block *commit = malloc (sizeof *commit);
+  uint8_t *block = malloc (BLOCK_SECTOR_SIZE);
+  struct list revokes;
+  uint32_t ofs, end_seq;
+  uint32_t i;
+
+  if (desc == NULL || commit == NULL || block == NULL)
+    PANIC ("out of memory replaying journal");
+  list_init (&revokes);
+
+  for (ofs = 1, end_seq = seq;
+       read_transaction (ofs, end_seq, desc, commit, block);
+       ofs += desc->cnt + 2, end_seq++)
+    for (i = 0; i < commit->revoke_cnt; i++)
+      {
+        struct revoke_rec *r = malloc (sizeof *r);
+        if (r == NULL)
+          PANIC ("out of memory replaying journal");
+        r->sector = commit->revoked[i];
+        r->seq = end_seq;
+        list_push_back (&revokes, &r->elem);
+      }
+
+  if (end_seq != seq)
+    printf ("journal: replaying %"PRIu32" transactions\n", end_seq - seq);
+  for (ofs = 1; seq != end_seq; ofs += desc->cnt + 2, seq++)
+    {
+      block_read (fs_device, log_start + ofs, desc);
+      for (i = 0; i < desc->cnt; i++)
+        if (!is_revoked (&revokes, desc->sectors[i], seq))
+          {
+            block_read (fs_device, log_start + ofs + 1 + i, block);
+            block_write (fs_device, desc->sectors[i], block);
+          }
+    }
+
+  while (!list_empty (&revokes))
+    free (list_entry (list_pop_front (&revokes), struct revoke_rec, elem));
+  free (desc);
+  free (commit);
+  free (block);
+}
+
+/* Folds one data block into a running transaction checksum. */
+static uint32_t
+checksum_add (uint32_t checksum, const void *block)
+{
+  return checksum * 31 + hash_bytes (block, BLOCK_SECTOR_SIZE);
+}
@@ -0,0 +1,23 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+void journal_create (block_sector_t *sectorp, uint32_t *cntp);
+void journal_open (bool clean);
+void journal_close (void);
+
+void journal_begin (size_t credits);
+bool journal_extend (size_t credits);
+void journal_restart (size_t credits);
+void journal_end (void);
+size_t journal_max_credits (void);
+bool journal_add (block_sector_t);
+bool journal_revoke (block_sector_t);
+void journal_commit (void);
+uint32_t journal_checkpoints (void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,197 @@
+#include "filesys/lz.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+
+/* A small LZ77 codec in the style of LZ4, fast enough to run on
+   every write of a compressed file.
+
+   The output is a series of sequences.  Each starts with a token
+   byte whose high nibble is a literal count and whose low nibble
+   is a match length minus LZ_MIN_MATCH; a nibble of 15 is
+   continued by extra bytes that are added in until one is not
+   255.  The literals follow, then a 2-byte little-endian offset
+   back into the output.  The last sequence has literals only. */
+
+#define LZ_MIN_MATCH 4                  /* Shortest match encoded. */
+#define LZ_MAX_OFFSET 0xffff            /* Farthest match back. */
+#define LZ_HASH_BITS 10                 /* Match finder table size. */
+
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Hashes the 4 bytes at P into the match finder table. */
+static inline size_t
+hash4 (const uint8_t *p)
+{
+  return (read32 (p) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the extra bytes for a nibble of 15 with LEN left over.
+   Returns the new output position, or a null pointer if the
+   output is full. */
+static uint8_t *
+put_length (uint8_t *op, const uint8_t *oend, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    {
+      if (op >= oend)
+        return NULL;
+      *op++ = 255;
+    }
+  if (op >= oend)
+    return NULL;
+  *op++ = len;
+  return op;
+}
+
+/* Appends a sequence of LIT_LEN literals from LIT followed by a
+   match of MATCH_LEN bytes OFFSET back, or no match if MATCH_LEN
+   is 0.  Returns the new output position, or a null pointer if
+   the output is full. */
+static uint8_t *
+put_sequence (uint8_t *op, const uint8_t *oend, const uint8_t *lit,
+              size_t lit_len, size_t offset, size_t match_len)
+{
+  size_t ml = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+  if (op >= oend)
+    return NULL;
+  *op++ = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+  if (lit_len >= 15 && (op = put_length (op, oend, lit_len - 15)) == NULL)
+    return NULL;
+  if ((size_t) (oend - op) < lit_len)
+    return NULL;
+  memcpy (op, lit, lit_len);
+  op += lit_len;
+
+  if (match_len == 0)
+    return op;
+  if (oend - op < 2)
+    return NULL;
+  *op++ = offset & 0xff;
+  *op++ = offset >> 8;
+  if (ml >= 15 && (op = put_length (op, oend, ml - 15)) == NULL)
+    return NULL;
+  return op;
+}
+
+/* Reads the extra bytes of a nibble of 15 at *IP into *LEN.
+   Returns false if the input ends first. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+  uint8_t b;
+
+  do
+    {
+      if (*ip >= iend)
+        return false;
+      b = *(*ip)++;
+      *len += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Compresses the SRC_LEN bytes at SRC into DST, which has room
+   for DST_CAP bytes.  SRC_LEN must be less than 64 kB.
+   Returns the compressed size, or 0 if it would exceed DST_CAP
+   or memory runs out. */
+size_t
+lz_compress (const void *src_, size_t src_len, void *dst_, size_t dst_cap)
+{
+  const uint8_t *src = src_;
+  const uint8_t *ip = src, *anchor = src, *end = src + src_len;
+  uint8_t *dst = dst_, *op = dst;
+  const uint8_t *oend = dst + dst_cap;
+  uint16_t *table;
+
+  ASSERT (src_len <= 0xffff);
+
+  table = calloc (1 << LZ_HASH_BITS, sizeof *table);
+  if (table == NULL)
+    return 0;
+
+  while (end - ip >= LZ_MIN_MATCH)
+    {
+      size_t h = hash4 (ip);
+      const uint8_t *ref = src + table[h];
+
+      table[h] = ip - src;
+      if (ref < ip && ip - ref <= LZ_MAX_OFFSET
+          && read32 (ref) == read32 (ip))
+        {
+          const uint8_t *mp = ip + LZ_MIN_MATCH;
+          const uint8_t *rp = ref + LZ_MIN_MATCH;
+
+          while (mp < end && *mp == *rp)
+            mp++, rp++;
+          op = put_sequence (op, oend, anchor, ip - anchor, ip - ref,
+                             mp - ip);
+          if (op == NULL)
+            break;
+          ip = anchor = mp;
+        }
+      else
+        ip++;
+    }
+  if (op != NULL)
+    op = put_sequence (op, oend, anchor, end - anchor, 0, 0);
+
+  free (table);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC into DST, which has
+   room for DST_CAP bytes.  Returns the decompressed size, or -1
+   if SRC is corrupt or does not fit. */
+int
+lz_decompress (const void *src_, size_t src_len, void *dst_, size_t dst_cap)
+{
+  const uint8_t *ip = src_, *iend = ip + src_len;
+  uint8_t *dst = dst_, *op = dst, *oend = dst + dst_cap;
+
+  while (ip < iend)
+    {
+      uint8_t token = *ip++;
+      size_t lit_len = token >> 4;
+      size_t match_len = token & 15;
+      size_t offset;
+
+      if (lit_len == 15 && !get_length (&ip, iend, &lit_len))
+        return -1;
+      if ((size_t) (iend - ip) < lit_len || (size_t) (oend - op) < lit_len)
+        return -1;
+      memcpy (op, ip, lit_len);
+      op += lit_len;
+      ip += lit_len;
+
+      /* The last sequence has no match. */
+      if (ip == iend)
+        break;
+      if (iend - ip < 2)
+        return -1;
+      offset = ip[0] | ip[1] << 8;
+      ip += 2;
+      if (offset == 0 || offset > (size_t) (op - dst))
+        return -1;
+      if (match_len == 15 && !get_length (&ip, iend, &match_len))
+        return -1;
+      match_len += LZ_MIN_MATCH;
+      if ((size_t) (oend - op) < match_len)
+        return -1;
+
+      /* Byte by byte, since the match may overlap its copy. */
+      for (; match_len > 0; match_len--, op++)
+        *op = op[-offset];
+    }
+  return op - dst;
+}
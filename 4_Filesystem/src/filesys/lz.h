@@ -0,0 +1,11 @@
+#ifndef FILESYS_LZ_H
+#define FILESYS_LZ_H
+
+#include <stddef.h>
+
+size_t lz_compress (const void *src, size_t src_len,
+                    void *dst, size_t dst_cap);
+int lz_decompress (const void *src, size_t src_len,
+                   void *dst, size_t dst_cap);
+
+#endif /* filesys/lz.h */
@@ -0,0 +1,191 @@
+#include "filesys/orphan.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/superblock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Deferred deletion of removed files.
+
+   When the last opener closes a removed file, inode_close() only
+   pushes its inode onto the orphan list and returns.  A reclaim
+   thread then frees the file's sectors from the end, at most
+   RECLAIM_BATCH at a time, each batch in its own journal
+   transaction together with the inode shrunk to match.  Once the
+   inode holds nothing, it is unlinked from the list and its own
+   sector freed in one more transaction.
+
+   The list is threaded through the inodes themselves (see
+   inode_set_next_orphan()) and its head lives in a sector of its
+   own, written through the journal like other metadata.  A crash
+   at any point thus leaves a list on disk from which the thread
+   carries on at the next mount, and no space leaks.
+
+   An inode still being built over several transactions, such as
+   a clone, sits in a building slot next to the head instead: the
+   reclaim thread leaves it alone, but if the builder gives up or
+   the system crashes first, it moves onto the list. */
+
+/* Sectors freed per transaction. */
+#define RECLAIM_BATCH 64
+
+/* On-disk orphan list head.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct orphan_block
+  {
+    block_sector_t head;                /* First orphan inode, or 0. */
+    block_sector_t building;            /* Inode being built, or 0. */
+    uint32_t unused[126];               /* Not used. */
+  };
+
+static struct orphan_block orphans;     /* In-memory copy. */
+static block_sector_t orphan_sector;    /* Where it lives on disk. */
+static struct lock orphan_lock;         /* Protects the list. */
+static struct condition orphan_cond;    /* Signaled when it grows. */
+
+/* Held by the reclaim thread while it works on a batch.
+   orphan_close() takes it for good. */
+static struct lock reclaim_lock;
+
+static void reclaim_thread (void *aux);
+static void set_head (block_sector_t);
+static void push (block_sector_t);
+
+/* Writes an empty orphan list at format time. */
+void
+orphan_create (void) 
+{
+  ASSERT (sizeof orphans == BLOCK_SECTOR_SIZE);
+  memset (&orphans, 0, sizeof orphans);
+  bc_write (ORPHAN_SECTOR, &orphans, 0, BLOCK_SECTOR_SIZE, 0);
+}
+
+/* Reads the orphan list and starts reclaiming whatever is on it,
+   including files left over from before a crash and an inode
+   whose building it interrupted. */
+void
+orphan_open (void) 
+{
+  lock_init (&orphan_lock);
+  cond_init (&orphan_cond);
+  lock_init (&reclaim_lock);
+  orphan_sector = superblock_get ()->orphan_sector;
+  bc_read (orphan_sector, &orphans, 0, BLOCK_SECTOR_SIZE, 0);
+  if (orphans.building != 0)
+    {
+      journal_begin (ORPHAN_CREDITS);
+      push (orphans.building);
+      journal_end ();
+    }
+  if (thread_create ("reclaim", PRI_DEFAULT, reclaim_thread, NULL)
+      == TID_ERROR)
+    PANIC ("could not start reclaim thread");
+}
+
+/* Stops the reclaim thread after the batch in progress.  Orphans
+   still on the list are reclaimed after the next mount. */
+void
+orphan_close (void) 
+{
+  lock_acquire (&reclaim_lock);
+}
+
+/* Puts the removed inode at INODE_SECTOR on the orphan list for
+   the reclaim thread.  Must be called within a journal
+   transaction. */
+void
+orphan_add (block_sector_t inode_sector) 
+{
+  lock_acquire (&orphan_lock);
+  push (inode_sector);
+  cond_signal (&orphan_cond, &orphan_lock);
+  lock_release (&orphan_lock);
+}
+
+/* Puts the inode at INODE_SECTOR, about to be built over several
+   journal transactions, in the building slot, so that it is
+   reclaimed if a crash comes first.  Only one inode can be built
+   at a time; the caller serializes builders.  Must be called
+   within a journal transaction. */
+void
+orphan_hold (block_sector_t inode_sector) 
+{
+  lock_acquire (&orphan_lock);
+  ASSERT (orphans.building == 0);
+  orphans.building = inode_sector;
+  bc_write_meta (orphan_sector, &orphans, 0, BLOCK_SECTOR_SIZE, 0);
+  lock_release (&orphan_lock);
+}
+
+/* Takes the inode at INODE_SECTOR out of the building slot: if
+   RECLAIM is false, because it is complete and linked into a
+   directory, otherwise onto the orphan list to be freed.  Must be
+   called within a journal transaction. */
+void
+orphan_unhold (block_sector_t inode_sector, bool reclaim) 
+{
+  lock_acquire (&orphan_lock);
+  ASSERT (orphans.building == inode_sector);
+  if (reclaim)
+    {
+      push (inode_sector);
+      cond_signal (&orphan_cond, &orphan_lock);
+    }
+  else
+    {
+      orphans.building = 0;
+      bc_write_meta (orphan_sector, &orphans, 0, BLOCK_SECTOR_SIZE, 0);
+    }
+  lock_release (&orphan_lock);
+}
+
+/* Reclaim thread: frees the sectors of the inode at the head of
+   the list, batch by batch, then the inode itself. */
+static void
+reclaim_thread (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      lock_acquire (&orphan_lock);
+      while (orphans.head == 0)
+        cond_wait (&orphan_cond, &orphan_lock);
+      lock_release (&orphan_lock);
+
+      lock_acquire (&reclaim_lock);
+      journal_begin (INODE_RECLAIM_CREDITS);
+      lock_acquire (&orphan_lock);
+      block_sector_t sector = orphans.head;
+      if (inode_reclaim (sector, RECLAIM_BATCH))
+        {
+          set_head (inode_get_next_orphan (sector));
+          free_map_release (sector, 1);
+        }
+      lock_release (&orphan_lock);
+      journal_end ();
+      lock_release (&reclaim_lock);
+    }
+}
+
+/* Links the inode at SECTOR in as the first orphan, taking it
+   out of the building slot if it was there. */
+static void
+push (block_sector_t sector) 
+{
+  inode_set_next_orphan (sector, orphans.head);
+  if (orphans.building == sector)
+    orphans.building = 0;
+  set_head (sector);
+}
+
+/* Makes SECTOR the first orphan. */
+static void
+set_head (block_sector_t sector) 
+{
+  orphans.head = sector;
+  bc_write_meta (orphan_sector, &orphans, 0, BLOCK_SECTOR_SIZE, 0);
+}
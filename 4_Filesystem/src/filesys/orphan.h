@@ -0,0 +1,19 @@
+#ifndef FILESYS_ORPHAN_H
+#define FILESYS_ORPHAN_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Journal credits, see journal_begin(), that orphan_add(),
+   orphan_hold() or orphan_unhold() can use: the inode and the
+   list head. */
+#define ORPHAN_CREDITS 2
+
+void orphan_create (void);
+void orphan_open (void);
+void orphan_close (void);
+void orphan_add (block_sector_t inode_sector);
+void orphan_hold (block_sector_t inode_sector);
+void orphan_unhold (block_sector_t inode_sector, bool reclaim);
+
+#endif /* filesys/orphan.h */
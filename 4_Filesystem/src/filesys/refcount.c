@@ -0,0 +1,171 @@
+#include "filesys/refcount.h"
+#include <debug.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/superblock.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Per-sector reference counts for copy-on-write clones.
+
+   The refcount file holds one byte per sector of the file system
+   device, counting the references to that sector beyond the
+   first.  A freshly allocated sector therefore has a count of 0,
+   which is also what an all-zero refcount file says, and only
+   sectors shared between a file and its clones ever have a
+   nonzero count.  The file is read and written through the
+   buffer cache like any other, so the hot parts stay cached. */
+
+/* Largest count one byte can hold. */
+#define REFCOUNT_MAX UINT8_MAX
+
+static struct file *refcount_file;   /* Refcount file. */
+static struct lock refcount_lock_;   /* Serializes count updates. */
+static int refcount_depth;           /* Recursive holds of the lock. */
+
+static uint8_t get_count (block_sector_t);
+static void set_count (block_sector_t, uint8_t);
+
+/* Creates a new, all-zero refcount file on disk. */
+void
+refcount_create (void) 
+{
+  if (!inode_create (REFCOUNT_SECTOR, block_size (fs_device), 0))
+    PANIC ("refcount file creation failed");
+}
+
+/* Opens the refcount file. */
+void
+refcount_open (void) 
+{
+  lock_init (&refcount_lock_);
+  refcount_file = file_open (inode_open (superblock_get ()->refcount_sector));
+  if (refcount_file == NULL)
+    PANIC ("can't open refcount file");
+}
+
+/* Closes the refcount file. */
+void
+refcount_close (void) 
+{
+  file_close (refcount_file);
+}
+
+/* Adds a reference to SECTOR.  Returns false, leaving the count
+   unchanged, if SECTOR already has the maximum number of
+   references. */
+bool
+refcount_share (block_sector_t sector) 
+{
+  uint8_t cnt;
+
+  refcount_lock ();
+  cnt = get_count (sector);
+  if (cnt < REFCOUNT_MAX)
+    set_count (sector, cnt + 1);
+  refcount_unlock ();
+  return cnt < REFCOUNT_MAX;
+}
+
+/* Adds a reference to each of up to CNT consecutive sectors
+   starting at START, stopping where their counts spill into the
+   next sector of the refcount file, so that only one sector of
+   it is read and written.  Returns the number of sectors done,
+   or 0, leaving every count unchanged, if one of them already has
+   the maximum number of references or memory runs out. */
+size_t
+refcount_share_run (block_sector_t start, size_t cnt) 
+{
+  uint8_t *counts;
+  size_t i;
+
+  counts = malloc (BLOCK_SECTOR_SIZE);
+  if (counts == NULL)
+    return 0;
+  if (cnt > BLOCK_SECTOR_SIZE - start % BLOCK_SECTOR_SIZE)
+    cnt = BLOCK_SECTOR_SIZE - start % BLOCK_SECTOR_SIZE;
+
+  refcount_lock ();
+  file_read_at (refcount_file, counts, cnt, start);
+  for (i = 0; i < cnt; i++)
+    if (counts[i] == REFCOUNT_MAX)
+      break;
+  if (i == cnt)
+    {
+      for (i = 0; i < cnt; i++)
+        counts[i]++;
+      file_write_at (refcount_file, counts, cnt, start);
+    }
+  else
+    cnt = 0;
+  refcount_unlock ();
+  free (counts);
+  return cnt;
+}
+
+/* Returns true if SECTOR is referenced more than once.
+   The answer only stays valid while the caller holds
+   refcount_lock(). */
+bool
+refcount_is_shared (block_sector_t sector) 
+{
+  return get_count (sector) > 0;
+}
+
+/* Drops one reference to SECTOR.  Returns true if other
+   references remain, false if the caller held the last one and
+   should release SECTOR in the free map. */
+bool
+refcount_unshare (block_sector_t sector) 
+{
+  uint8_t cnt;
+
+  refcount_lock ();
+  cnt = get_count (sector);
+  if (cnt > 0)
+    set_count (sector, cnt - 1);
+  refcount_unlock ();
+  return cnt > 0;
+}
+
+/* Acquires the lock that must be held across a copy-on-write
+   decision, so that two files unsharing the same sector at once
+   cannot both believe they still share it.  May be taken
+   recursively by the functions above. */
+void
+refcount_lock (void) 
+{
+  if (!lock_held_by_current_thread (&refcount_lock_))
+    lock_acquire (&refcount_lock_);
+  else
+    refcount_depth++;
+}
+
+/* Releases one level of refcount_lock(). */
+void
+refcount_unlock (void) 
+{
+  if (refcount_depth > 0)
+    refcount_depth--;
+  else
+    lock_release (&refcount_lock_);
+}
+
+/* Reads SECTOR's count from the refcount file. */
+static uint8_t
+get_count (block_sector_t sector) 
+{
+  uint8_t cnt = 0;
+  file_read_at (refcount_file, &cnt, 1, sector);
+  return cnt;
+}
+
+/* Writes SECTOR's count to the refcount file. */
+static void
+set_count (block_sector_t sector, uint8_t cnt) 
+{
+  file_write_at (refcount_file, &cnt, 1, sector);
+}
@@ -0,0 +1,25 @@
+#ifndef FILESYS_REFCOUNT_H
+#define FILESYS_REFCOUNT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Journal credits, see journal_begin(), that one
+   refcount_share(), refcount_share_run() or refcount_unshare()
+   can use. */
+#define REFCOUNT_CREDITS 1
+
+void refcount_create (void);
+void refcount_open (void);
+void refcount_close (void);
+
+bool refcount_share (block_sector_t);
+size_t refcount_share_run (block_sector_t start, size_t cnt);
+bool refcount_is_shared (block_sector_t);
+bool refcount_unshare (block_sector_t);
+
+void refcount_lock (void);
+void refcount_unlock (void);
+
+#endif /* filesys/refcount.h */
@@ -0,0 +1,163 @@
+#include "filesys/superblock.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+
+/* The superblock is the one fixed location on disk.  It records
+   where the system files live, the device geometry the file
+   system was made for, and running counts of free sectors and
+   inodes so that statfs() never has to scan anything.
+
+   The counts are kept in memory while mounted and written back
+   only at unmount, together with the clean flag.  Mounting
+   clears the flag on disk first, so after a crash the next
+   mount sees an unclean file system and recounts.
+
+   The superblock is read and written with block_read() and
+   block_write() directly rather than through the buffer cache,
+   so that the clean flag reaches the disk exactly when we say
+   and never before the data it vouches for. */
+
+static struct superblock sb;    /* In-memory copy. */
+static struct lock sb_lock;     /* Protects the counts. */
+
+static void write_superblock (void);
+
+/* Initializes the superblock module. */
+void
+superblock_init (void) 
+{
+  ASSERT (sizeof sb == BLOCK_SECTOR_SIZE);
+  lock_init (&sb_lock);
+}
+
+/* Writes a superblock for a freshly formatted file system with
+   FREE_CNT free sectors and only the root directory, whose
+   JOURNAL_CNT-sector log starts at JOURNAL_SECTOR (no log if
+   JOURNAL_CNT is 0).  Everything the format wrote is flushed
+   first, so the superblock can be marked clean. */
+void
+superblock_format (uint32_t free_cnt, block_sector_t journal_sector,
+                   uint32_t journal_cnt) 
+{
+  memset (&sb, 0, sizeof sb);
+  sb.magic = SUPERBLOCK_MAGIC;
+  sb.sector_cnt = block_size (fs_device);
+  sb.sector_size = BLOCK_SECTOR_SIZE;
+  sb.free_map_sector = FREE_MAP_SECTOR;
+  sb.root_dir_sector = ROOT_DIR_SECTOR;
+  sb.refcount_sector = REFCOUNT_SECTOR;
+  sb.orphan_sector = ORPHAN_SECTOR;
+  sb.warmup_sector = WARMUP_SECTOR;
+  sb.features = SB_FEATURE_REFCOUNT | SB_FEATURE_ORPHAN;
+  sb.free_cnt = free_cnt;
+  sb.inode_cnt = 1;
+  sb.clean = 1;
+  if (journal_cnt > 0) 
+    {
+      sb.features |= SB_FEATURE_JOURNAL;
+      sb.journal_sector = journal_sector;
+      sb.journal_cnt = journal_cnt;
+    }
+
+  bc_flush_all_entries ();
+  write_superblock ();
+}
+
+/* Reads and checks the superblock and marks the file system as
+   in use on disk.  Returns true if it was cleanly unmounted, in
+   which case the counts can be trusted, false if they must be
+   recomputed with superblock_set_counts(). */
+bool
+superblock_mount (void) 
+{
+  bool was_clean;
+
+  block_read (fs_device, SUPERBLOCK_SECTOR, &sb);
+
+  if (sb.magic != SUPERBLOCK_MAGIC)
+    PANIC ("no file system found; format with -f");
+  if (sb.sector_size != BLOCK_SECTOR_SIZE
+      || sb.sector_cnt != block_size (fs_device))
+    PANIC ("file system geometry does not match device (%"PRIu32
+           " sectors, device has %"PRDSNu")",
+           sb.sector_cnt, block_size (fs_device));
+  if (sb.features & ~SB_FEATURES_KNOWN)
+    PANIC ("file system has unsupported features %#"PRIx32,
+           sb.features & ~SB_FEATURES_KNOWN);
+
+  was_clean = sb.clean != 0;
+  sb.clean = 0;
+  write_superblock ();
+  return was_clean;
+}
+
+/* Writes the counts back and marks the file system clean.
+   The caller must already have flushed the buffer cache. */
+void
+superblock_unmount (void) 
+{
+  lock_acquire (&sb_lock);
+  sb.clean = 1;
+  write_superblock ();
+  lock_release (&sb_lock);
+}
+
+/* Returns the in-memory superblock. */
+const struct superblock *
+superblock_get (void) 
+{
+  return &sb;
+}
+
+/* Replaces the counts, after they have been recomputed following
+   an unclean mount. */
+void
+superblock_set_counts (uint32_t free_cnt, uint32_t inode_cnt) 
+{
+  lock_acquire (&sb_lock);
+  sb.free_cnt = free_cnt;
+  sb.inode_cnt = inode_cnt;
+  lock_release (&sb_lock);
+}
+
+/* Adds DELTA to the free sector count. */
+void
+superblock_add_free (int delta) 
+{
+  lock_acquire (&sb_lock);
+  sb.free_cnt += delta;
+  lock_release (&sb_lock);
+}
+
+/* Adds DELTA to the inode count. */
+void
+superblock_add_inodes (int delta) 
+{
+  lock_acquire (&sb_lock);
+  sb.inode_cnt += delta;
+  lock_release (&sb_lock);
+}
+
+/* Fills in ST from the counts. */
+void
+superblock_statfs (struct statfs *st) 
+{
+  lock_acquire (&sb_lock);
+  st->f_bsize = sb.sector_size;
+  st->f_blocks = sb.sector_cnt;
+  st->f_bfree = sb.free_cnt;
+  st->f_files = sb.inode_cnt;
+  st->f_features = sb.features;
+  lock_release (&sb_lock);
+}
+
+/* Writes the in-memory superblock straight to disk. */
+static void
+write_superblock (void) 
+{
+  block_write (fs_device, SUPERBLOCK_SECTOR, &sb);
+}
@@ -0,0 +1,56 @@
+#ifndef FILESYS_SUPERBLOCK_H
+#define FILESYS_SUPERBLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <statfs.h>
+#include "devices/block.h"
+
+/* Sector of the superblock. */
+#define SUPERBLOCK_SECTOR 0
+
+/* Identifies a formatted file system. */
+#define SUPERBLOCK_MAGIC 0x53465350     /* "PSFS" */
+
+/* Feature flags.  A mount fails if the superblock has a flag set
+   that this kernel does not know. */
+#define SB_FEATURE_REFCOUNT 0x1         /* Copy-on-write clones. */
+#define SB_FEATURE_JOURNAL 0x2          /* Metadata journal. */
+#define SB_FEATURE_ORPHAN 0x4           /* Deferred deletion list. */
+#define SB_FEATURES_KNOWN (SB_FEATURE_REFCOUNT | SB_FEATURE_JOURNAL \
+                           | SB_FEATURE_ORPHAN)
+
+/* On-disk superblock.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct superblock
+  {
+    uint32_t magic;                     /* SUPERBLOCK_MAGIC. */
+    uint32_t sector_cnt;                /* Sectors in the device. */
+    uint32_t sector_size;               /* BLOCK_SECTOR_SIZE. */
+    block_sector_t free_map_sector;     /* Free map inode. */
+    block_sector_t root_dir_sector;     /* Root directory inode. */
+    block_sector_t refcount_sector;     /* Refcount file inode. */
+    uint32_t features;                  /* SB_FEATURE_* flags. */
+    uint32_t free_cnt;                  /* Free sectors. */
+    uint32_t inode_cnt;                 /* Files and directories. */
+    uint32_t clean;                     /* Nonzero if cleanly unmounted. */
+    block_sector_t journal_sector;      /* First sector of the log. */
+    uint32_t journal_cnt;               /* Sectors in the log. */
+    block_sector_t orphan_sector;       /* Orphan list head. */
+    block_sector_t warmup_sector;       /* Warm-up list, or 0. */
+    uint32_t unused[114];               /* Not used. */
+  };
+
+void superblock_init (void);
+void superblock_format (uint32_t free_cnt, block_sector_t journal_sector,
+                        uint32_t journal_cnt);
+bool superblock_mount (void);
+void superblock_unmount (void);
+const struct superblock *superblock_get (void);
+
+void superblock_set_counts (uint32_t free_cnt, uint32_t inode_cnt);
+void superblock_add_free (int delta);
+void superblock_add_inodes (int delta);
+void superblock_statfs (struct statfs *);
+
+#endif /* filesys/superblock.h */
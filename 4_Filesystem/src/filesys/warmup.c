@@ -0,0 +1,113 @@
+#include "filesys/warmup.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/filesys.h"
+#include "filesys/superblock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache warm-up across reboots.
+
+   At unmount the sectors with the most hits in the buffer cache
+   are written, hottest first, to a reserved sector.  At the next
+   mount a prefetch thread reads them back into the cache, so the
+   root directory, the free map and the files in use before the
+   shutdown are cached by the time user programs ask for them.
+
+   The list is only a hint.  It is written with block_write() and
+   never goes through the cache or the journal: a crash leaves the
+   list of the last clean unmount, and a sector that has been freed
+   or reused since is merely read in for nothing. */
+
+#define WARMUP_MAGIC 0x4d524157         /* "WARM" */
+
+/* Sectors remembered across a reboot. */
+#define WARMUP_MAX BUFFER_CACHE_ENTRY_NB
+
+/* On-disk warm-up list.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct warmup_block
+  {
+    uint32_t magic;                     /* WARMUP_MAGIC. */
+    uint32_t cnt;                       /* Entries in sectors[]. */
+    block_sector_t sectors[126];        /* Hottest first. */
+  };
+
+static struct warmup_block warm;        /* List being prefetched. */
+static block_sector_t warmup_sector;    /* Where it lives on disk. */
+
+/* Held by the prefetch thread while it runs.
+   warmup_close() takes it for good. */
+static struct lock prefetch_lock;
+static bool stop;                       /* Tells the thread to quit. */
+
+static void prefetch_thread (void *aux);
+
+/* Writes an empty warm-up list at format time. */
+void
+warmup_create (void) 
+{
+  ASSERT (sizeof warm == BLOCK_SECTOR_SIZE);
+  memset (&warm, 0, sizeof warm);
+  warm.magic = WARMUP_MAGIC;
+  block_write (fs_device, WARMUP_SECTOR, &warm);
+}
+
+/* Reads the warm-up list saved at the last unmount and starts
+   prefetching it in the background.  Must be called after the
+   journal has been replayed, or stale home locations of logged
+   sectors could be cached. */
+void
+warmup_open (void) 
+{
+  lock_init (&prefetch_lock);
+  stop = false;
+  warm.cnt = 0;
+  warmup_sector = superblock_get ()->warmup_sector;
+  if (warmup_sector == 0)
+    return;
+
+  block_read (fs_device, warmup_sector, &warm);
+  if (warm.magic != WARMUP_MAGIC || warm.cnt > WARMUP_MAX) 
+    {
+      warm.cnt = 0;
+      return;
+    }
+  if (thread_create ("prefetch", PRI_DEFAULT, prefetch_thread, NULL)
+      == TID_ERROR)
+    warm.cnt = 0;
+}
+
+/* Stops prefetching and saves the sectors now hottest in the
+   cache.  Must be called before bc_term(). */
+void
+warmup_close (void) 
+{
+  struct warmup_block list;
+
+  stop = true;
+  lock_acquire (&prefetch_lock);
+  if (warmup_sector == 0)
+    return;
+
+  memset (&list, 0, sizeof list);
+  list.magic = WARMUP_MAGIC;
+  list.cnt = bc_hottest (list.sectors, WARMUP_MAX);
+  block_write (fs_device, warmup_sector, &list);
+}
+
+/* Reads the sectors on the list into the buffer cache, hottest
+   first, skipping any that lie beyond the end of the device. */
+static void
+prefetch_thread (void *aux UNUSED) 
+{
+  block_sector_t size = block_size (fs_device);
+  uint32_t i;
+
+  lock_acquire (&prefetch_lock);
+  for (i = 0; i < warm.cnt && !stop; i++)
+    if (warm.sectors[i] < size)
+      bc_prefetch (warm.sectors[i]);
+  lock_release (&prefetch_lock);
+}
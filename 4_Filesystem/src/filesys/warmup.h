@@ -0,0 +1,8 @@
+#ifndef FILESYS_WARMUP_H
+#define FILESYS_WARMUP_H
+
+void warmup_create (void);
+void warmup_open (void);
+void warmup_close (void);
+
+#endif /* filesys/warmup.h */
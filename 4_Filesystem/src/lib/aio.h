@@ -0,0 +1,63 @@
+#ifndef __LIB_AIO_H
+#define __LIB_AIO_H
+
+#include <stdint.h>
+
+/* Asynchronous I/O ring shared between a user process and the
+   kernel.
+
+   The process fills submission queue entries at sq[sq_tail %
+   AIO_SQ_ENTRIES] and advances sq_tail, then calls aio_enter()
+   to hand every entry between sq_head and sq_tail to the kernel
+   in one trap.  Kernel worker threads perform the I/O and post
+   a completion queue entry at cq[cq_tail % AIO_CQ_ENTRIES],
+   advancing cq_tail.  The process reaps completions by reading
+   entries up to cq_tail and advancing cq_head; no system call
+   is needed for that.
+
+   Each index is written by exactly one side: sq_tail and cq_head
+   by the process, sq_head and cq_tail by the kernel.  The whole
+   ring must lie within a single page. */
+
+/* Number of entries in each queue. */
+#define AIO_SQ_ENTRIES 32
+#define AIO_CQ_ENTRIES 64
+
+/* Operations. */
+enum aio_opcode
+  {
+    AIO_READ,                   /* Read LEN bytes at OFFSET into BUF. */
+    AIO_WRITE                   /* Write LEN bytes from BUF at OFFSET. */
+  };
+
+/* Submission queue entry. */
+struct aio_sqe
+  {
+    int opcode;                 /* AIO_READ or AIO_WRITE. */
+    int fd;                     /* File descriptor. */
+    void *buf;                  /* User buffer. */
+    unsigned len;               /* Number of bytes. */
+    unsigned offset;            /* File offset; the file position is
+                                   neither used nor changed. */
+    uint32_t user_data;         /* Copied to the completion. */
+  };
+
+/* Completion queue entry. */
+struct aio_cqe
+  {
+    uint32_t user_data;         /* From the submission. */
+    int res;                    /* Bytes transferred, or -1. */
+  };
+
+/* The shared ring. */
+struct aio_ring
+  {
+    volatile unsigned sq_head;  /* Next entry the kernel consumes. */
+    volatile unsigned sq_tail;  /* Next entry the process fills. */
+    volatile unsigned cq_head;  /* Next entry the process reaps. */
+    volatile unsigned cq_tail;  /* Next entry the kernel posts. */
+    struct aio_sqe sq[AIO_SQ_ENTRIES];
+    struct aio_cqe cq[AIO_CQ_ENTRIES];
+  };
+
+#endif /* lib/aio.h */
@@ -0,0 +1,35 @@
+#ifndef __LIB_BLOCKSTAT_H
+#define __LIB_BLOCKSTAT_H
+
+#include <stdint.h>
+
+/* Block device roles accepted by blockstat(), numbered as in
+   the kernel's enum block_type. */
+#define BLOCKSTAT_KERNEL 0
+#define BLOCKSTAT_FILESYS 1
+#define BLOCKSTAT_SCRATCH 2
+#define BLOCKSTAT_SWAP 3
+
+/* Latency histogram buckets.  Bucket I counts requests that took
+   at least 2**I but less than 2**(I+1) CPU cycles; the last
+   bucket also counts all slower ones. */
+#define BLOCKSTAT_BUCKETS 32
+
+/* I/O statistics of a block device since boot, as returned by
+   the blockstat() system call.  Times are in CPU cycles as
+   counted by the time stamp counter. */
+struct blockstat
+  {
+    uint64_t read_cnt;          /* Sectors read. */
+    uint64_t write_cnt;         /* Sectors written. */
+    uint64_t request_cnt;       /* Requests completed. */
+    uint64_t seq_cnt;           /* Requests submitted that started where
+                                   the one before them ended. */
+    uint64_t busy_cycles;       /* Time with a request in flight. */
+    uint64_t total_cycles;      /* Time since the device was found. */
+    uint32_t in_flight;         /* Requests submitted, not completed. */
+    uint32_t max_in_flight;     /* Most requests ever in flight. */
+    uint32_t latency[BLOCKSTAT_BUCKETS];  /* Submission to completion. */
+  };
+
+#endif /* lib/blockstat.h */
@@ -0,0 +1,12 @@
+#ifndef __LIB_FADVISE_H
+#define __LIB_FADVISE_H
+
+/* Access pattern hints for the fadvise() system call. */
+#define FADV_NORMAL 0           /* No particular pattern. */
+#define FADV_SEQUENTIAL 1       /* Read from start to end; read ahead more. */
+#define FADV_RANDOM 2           /* Random probes; do not read ahead. */
+#define FADV_WILLNEED 3         /* Load the range into the cache now. */
+#define FADV_DONTNEED 4         /* Evict the range from the cache first. */
+#define FADV_NOREUSE 5          /* Data is read once; do not keep it. */
+
+#endif /* lib/fadvise.h */
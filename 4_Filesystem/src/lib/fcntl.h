@@ -0,0 +1,7 @@
+#ifndef __LIB_FCNTL_H
+#define __LIB_FCNTL_H
+
+/* Flags for the open_flags() system call. */
+#define O_DIRECT 0x1            /* Whole sectors bypass the buffer cache. */
+
+#endif /* lib/fcntl.h */
@@ -0,0 +1,17 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/* One segment of a scatter/gather buffer, as passed to the
+   readv() and writev() system calls. */
+struct iovec
+  {
+    void *iov_base;             /* Start of segment. */
+    size_t iov_len;             /* Number of bytes in segment. */
+  };
+
+/* Maximum number of segments in a single readv() or writev(). */
+#define IOV_MAX 16
+
+#endif /* lib/iovec.h */
@@ -0,0 +1,15 @@
+#ifndef __LIB_STATFS_H
+#define __LIB_STATFS_H
+
+/* File system statistics, as returned by the statfs() system
+   call. */
+struct statfs
+  {
+    unsigned f_bsize;           /* Bytes per sector. */
+    unsigned f_blocks;          /* Sectors in the file system. */
+    unsigned f_bfree;           /* Free sectors. */
+    unsigned f_files;           /* Files and directories. */
+    unsigned f_features;        /* On-disk feature flags. */
+  };
+
+#endif /* lib/statfs.h */
@@ -28,7 +28,23 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_READV,                  /* Scatter read from a file. */
+    SYS_WRITEV,                 /* Gather write to a file. */
+    SYS_COPY_FILE_RANGE,        /* Copy between files in the kernel. */
+    SYS_REFLINK,                /* Create a copy-on-write clone of a file. */
+    SYS_AIO_SETUP,              /* Register an asynchronous I/O ring. */
+    SYS_AIO_ENTER,              /* Submit and wait for asynchronous I/O. */
+    SYS_STATFS,                 /* Get file system statistics. */
+    SYS_COMPRESS,               /* Compress an empty file's data. */
+    SYS_FALLOCATE,              /* Reserve space for a file. */
+    SYS_FADVISE,                /* Declare a file access pattern. */
+    SYS_OPEN_FLAGS,             /* Open a file with O_* flags. */
+    SYS_BLOCKSTAT,              /* Get block device I/O statistics. */
+    SYS_EXTENTS,                /* Count the runs of a file's sectors. */
+    SYS_DEFRAG                  /* Move a file's data into one run. */
   };
 
 #endif /* lib/syscall-nr.h */
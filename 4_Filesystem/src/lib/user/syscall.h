@@ -3,6 +3,12 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <iovec.h>
+#include <aio.h>
+#include <statfs.h>
+#include <fadvise.h>
+#include <fcntl.h>
+#include <blockstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +51,20 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int fd_in, int fd_out, unsigned length);
+bool reflink (int fd, const char *file);
+bool aio_setup (struct aio_ring *ring);
+int aio_enter (unsigned min_complete);
+bool statfs (struct statfs *);
+bool compress (int fd);
+bool fallocate (int fd, unsigned offset, unsigned length);
+bool fadvise (int fd, unsigned offset, unsigned len, int advice);
+int open_flags (const char *file, int flags);
+bool blockstat (int role, struct blockstat *);
+int extents (int fd);
+bool defrag (int fd);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,85 @@
+/* Writes a file with a batch of asynchronous writes submitted in
+   one aio_enter(), reads it back the same way, and checks that
+   a request on a bad file descriptor completes with -1 instead
+   of holding up the rest of the batch. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE 1000
+#define CHUNK_CNT 4
+#define FILE_SIZE (CHUNK_SIZE * CHUNK_CNT)
+static char buf[FILE_SIZE];
+static char rbuf[FILE_SIZE];
+
+/* The ring may not cross a page boundary. */
+static struct aio_ring ring __attribute__ ((aligned (4096)));
+
+/* Queues one request. */
+static void
+queue (int opcode, int fd, char *p, int i) 
+{
+  struct aio_sqe *sqe = &ring.sq[ring.sq_tail % AIO_SQ_ENTRIES];
+
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->buf = p + i * CHUNK_SIZE;
+  sqe->len = CHUNK_SIZE;
+  sqe->offset = i * CHUNK_SIZE;
+  sqe->user_data = i;
+  ring.sq_tail++;
+}
+
+/* Reaps CNT completions and checks that request I returned
+   EXPECT[I] bytes. */
+static void
+reap (int cnt, const int expect[]) 
+{
+  while (cnt-- > 0) 
+    {
+      struct aio_cqe *cqe;
+
+      if (ring.cq_head == ring.cq_tail)
+        fail ("completion queue empty");
+      cqe = &ring.cq[ring.cq_head % AIO_CQ_ENTRIES];
+      if (cqe->res != expect[cqe->user_data])
+        fail ("request %u returned %d, expected %d",
+              cqe->user_data, cqe->res, expect[cqe->user_data]);
+      ring.cq_head++;
+    }
+}
+
+void
+test_main (void) 
+{
+  static const int full[] = {CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE,
+                             CHUNK_SIZE, -1};
+  int fd;
+  int i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("aio", 0), "create \"aio\"");
+  CHECK ((fd = open ("aio")) > 1, "open \"aio\"");
+  CHECK (aio_setup (&ring), "aio_setup");
+
+  for (i = 0; i < CHUNK_CNT; i++)
+    queue (AIO_WRITE, fd, buf, i);
+  CHECK (aio_enter (CHUNK_CNT) == CHUNK_CNT, "submit writes");
+  reap (CHUNK_CNT, full);
+
+  for (i = 0; i < CHUNK_CNT; i++)
+    queue (AIO_READ, fd, rbuf, i);
+  queue (AIO_READ, 1234, rbuf, 0);
+  ring.sq[(ring.sq_tail - 1) % AIO_SQ_ENTRIES].user_data = CHUNK_CNT;
+  CHECK (aio_enter (CHUNK_CNT + 1) == CHUNK_CNT + 1, "submit reads");
+  reap (CHUNK_CNT + 1, full);
+  compare_bytes (rbuf, buf, FILE_SIZE, 0, "aio");
+  msg ("close \"aio\"");
+  close (fd);
+
+  check_file ("aio", buf, FILE_SIZE);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(aio-rw) begin
+(aio-rw) create "aio"
+(aio-rw) open "aio"
+(aio-rw) aio_setup
+(aio-rw) submit writes
+(aio-rw) submit reads
+(aio-rw) close "aio"
+(aio-rw) open "aio" for verification
+(aio-rw) verified contents of "aio"
+(aio-rw) close "aio"
+(aio-rw) end
+EOF
+pass;
@@ -0,0 +1,64 @@
+/* Checks that blockstat() reports the sectors, requests and
+   latencies of direct I/O to the file system device, and that it
+   rejects roles that do not exist. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (16 * 512)
+static char buf[FILE_SIZE];
+
+/* Returns the number of requests in ST's latency histogram. */
+static uint64_t
+histogram_total (const struct blockstat *st)
+{
+  uint64_t total = 0;
+  int i;
+
+  for (i = 0; i < BLOCKSTAT_BUCKETS; i++)
+    total += st->latency[i];
+  return total;
+}
+
+void
+test_main (void) 
+{
+  struct blockstat before, after;
+  int fd;
+
+  CHECK (!blockstat (42, &before), "blockstat role 42 (must fail)");
+  CHECK (blockstat (BLOCKSTAT_FILESYS, &before), "blockstat filesys");
+
+  memset (buf, 'b', sizeof buf);
+  CHECK (create ("stats", 0), "create \"stats\"");
+  CHECK ((fd = open_flags ("stats", O_DIRECT)) > 1,
+         "open \"stats\" with O_DIRECT");
+  CHECK (write (fd, buf, FILE_SIZE) == FILE_SIZE,
+         "direct write %d bytes", FILE_SIZE);
+  seek (fd, 0);
+  CHECK (read (fd, buf, FILE_SIZE) == FILE_SIZE,
+         "direct read %d bytes", FILE_SIZE);
+  msg ("close \"stats\"");
+  close (fd);
+
+  CHECK (blockstat (BLOCKSTAT_FILESYS, &after), "blockstat filesys");
+  if (after.write_cnt - before.write_cnt < FILE_SIZE / 512)
+    fail ("only %llu sectors written",
+          after.write_cnt - before.write_cnt);
+  if (after.read_cnt - before.read_cnt < FILE_SIZE / 512)
+    fail ("only %llu sectors read", after.read_cnt - before.read_cnt);
+  if (after.request_cnt <= before.request_cnt)
+    fail ("request count did not grow");
+  if (after.seq_cnt > after.request_cnt + after.in_flight)
+    fail ("more sequential requests than requests");
+  if (after.max_in_flight == 0)
+    fail ("no request was ever in flight");
+  if (after.busy_cycles == 0 || after.busy_cycles > after.total_cycles)
+    fail ("busy for %llu of %llu cycles",
+          after.busy_cycles, after.total_cycles);
+  if (histogram_total (&after) != after.request_cnt)
+    fail ("histogram holds %llu requests, not %llu",
+          histogram_total (&after), after.request_cnt);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(blockstat) begin
+(blockstat) blockstat role 42 (must fail)
+(blockstat) blockstat filesys
+(blockstat) create "stats"
+(blockstat) open "stats" with O_DIRECT
+(blockstat) direct write 8192 bytes
+(blockstat) direct read 8192 bytes
+(blockstat) close "stats"
+(blockstat) blockstat filesys
+(blockstat) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = join ('', map (substr ("0123456789abcdef", int ($_ / 7) % 16, 1),
+			     0 .. 11999));
+substr ($data, 3000, 5000) = random_bytes (5000);
+check_archive ({"data" => [$data]});
+pass;
@@ -0,0 +1,47 @@
+/* Turns on compression for an empty file, fills it with
+   compressible text, overwrites part of it with random bytes
+   that do not compress, and checks the contents. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 12000
+#define NOISE_OFS 3000
+#define NOISE_SIZE 5000
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  static const char digits[] = "0123456789abcdef";
+  size_t ofs;
+  int fd;
+  int i;
+
+  for (i = 0; i < FILE_SIZE; i++)
+    buf[i] = digits[i / 7 % 16];
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (compress (fd), "compress \"data\"");
+
+  msg ("write \"data\" in small pieces");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += 1000)
+    if (write (fd, buf + ofs, 1000) != 1000)
+      fail ("write at offset %zu failed", ofs);
+  CHECK (!compress (fd), "compress non-empty \"data\" (must fail)");
+
+  random_init (0);
+  random_bytes (buf + NOISE_OFS, NOISE_SIZE);
+  seek (fd, NOISE_OFS);
+  CHECK (write (fd, buf + NOISE_OFS, NOISE_SIZE) == NOISE_SIZE,
+         "overwrite %d bytes with random data", NOISE_SIZE);
+
+  msg ("close \"data\"");
+  close (fd);
+
+  check_file ("data", buf, FILE_SIZE);
+}
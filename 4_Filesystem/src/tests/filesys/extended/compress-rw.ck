@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(compress-rw) begin
+(compress-rw) create "data"
+(compress-rw) open "data"
+(compress-rw) compress "data"
+(compress-rw) write "data" in small pieces
+(compress-rw) compress non-empty "data" (must fail)
+(compress-rw) overwrite 5000 bytes with random data
+(compress-rw) close "data"
+(compress-rw) open "data" for verification
+(compress-rw) verified contents of "data"
+(compress-rw) close "data"
+(compress-rw) end
+EOF
+pass;
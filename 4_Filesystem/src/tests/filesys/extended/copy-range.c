@@ -0,0 +1,44 @@
+/* Copies a file with copy_file_range() in two pieces, the first
+   ending in the middle of a sector, and checks the copy. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 6789
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int src_fd, dst_fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((src_fd = open ("src")) > 1, "open \"src\"");
+  CHECK ((dst_fd = open ("dst")) > 1, "open \"dst\"");
+
+  CHECK (write (src_fd, buf, FILE_SIZE) == FILE_SIZE, "write \"src\"");
+  msg ("seek \"src\"");
+  seek (src_fd, 0);
+
+  CHECK (copy_file_range (src_fd, dst_fd, 1000) == 1000,
+         "copy 1000 bytes from \"src\" to \"dst\"");
+  CHECK (copy_file_range (src_fd, dst_fd, 100000) == FILE_SIZE - 1000,
+         "copy rest of \"src\" to \"dst\"");
+  CHECK (copy_file_range (src_fd, dst_fd, 100) == 0,
+         "copy at end of \"src\"");
+  CHECK (tell (dst_fd) == FILE_SIZE, "tell \"dst\"");
+
+  msg ("close \"src\"");
+  close (src_fd);
+  msg ("close \"dst\"");
+  close (dst_fd);
+
+  check_file ("src", buf, FILE_SIZE);
+  check_file ("dst", buf, FILE_SIZE);
+}
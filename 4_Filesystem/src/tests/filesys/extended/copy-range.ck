@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-range) begin
+(copy-range) create "src"
+(copy-range) create "dst"
+(copy-range) open "src"
+(copy-range) open "dst"
+(copy-range) write "src"
+(copy-range) seek "src"
+(copy-range) copy 1000 bytes from "src" to "dst"
+(copy-range) copy rest of "src" to "dst"
+(copy-range) copy at end of "src"
+(copy-range) tell "dst"
+(copy-range) close "src"
+(copy-range) close "dst"
+(copy-range) open "src" for verification
+(copy-range) verified contents of "src"
+(copy-range) close "src"
+(copy-range) open "dst" for verification
+(copy-range) verified contents of "dst"
+(copy-range) close "dst"
+(copy-range) end
+EOF
+pass;
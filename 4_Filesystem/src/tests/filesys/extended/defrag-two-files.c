@@ -0,0 +1,77 @@
+/* Grows two files one sector at a time in turn, so that their
+   sectors interleave on disk, then keeps reading them back while
+   the defragmenter may move them.  Then defragments both and
+   checks that each is left in one run with its contents intact. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (48 * 512)
+#define READ_PASSES 200
+static char buf_a[FILE_SIZE];
+static char buf_b[FILE_SIZE];
+static char buf_check[FILE_SIZE];
+
+static void
+verify_quietly (const char *file_name, int fd, const char *buf) 
+{
+  seek (fd, 0);
+  if (read (fd, buf_check, FILE_SIZE) != FILE_SIZE
+      || memcmp (buf_check, buf, FILE_SIZE))
+    fail ("contents of \"%s\" differ", file_name);
+}
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+  size_t ofs;
+  int i;
+
+  random_init (0);
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+
+  msg ("write \"a\" and \"b\" alternately");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += 512)
+    {
+      if (write (fd_a, buf_a + ofs, 512) != 512)
+        fail ("write at offset %zu in \"a\" failed", ofs);
+      if (write (fd_b, buf_b + ofs, 512) != 512)
+        fail ("write at offset %zu in \"b\" failed", ofs);
+    }
+  CHECK (extents (fd_a) > 1, "\"a\" is fragmented");
+  CHECK (extents (fd_b) > 1, "\"b\" is fragmented");
+
+  msg ("read \"a\" and \"b\" %d times", READ_PASSES);
+  for (i = 0; i < READ_PASSES; i++)
+    {
+      verify_quietly ("a", fd_a, buf_a);
+      verify_quietly ("b", fd_b, buf_b);
+    }
+
+  /* The defrag thread may already have moved either file. */
+  msg ("defrag \"a\" and \"b\"");
+  defrag (fd_a);
+  defrag (fd_b);
+  CHECK (extents (fd_a) == 1, "\"a\" is in one run");
+  CHECK (extents (fd_b) == 1, "\"b\" is in one run");
+
+  msg ("close \"a\"");
+  close (fd_a);
+
+  msg ("close \"b\"");
+  close (fd_b);
+
+  check_file ("a", buf_a, FILE_SIZE);
+  check_file ("b", buf_b, FILE_SIZE);
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(defrag-two-files) begin
+(defrag-two-files) create "a"
+(defrag-two-files) create "b"
+(defrag-two-files) open "a"
+(defrag-two-files) open "b"
+(defrag-two-files) write "a" and "b" alternately
+(defrag-two-files) "a" is fragmented
+(defrag-two-files) "b" is fragmented
+(defrag-two-files) read "a" and "b" 200 times
+(defrag-two-files) defrag "a" and "b"
+(defrag-two-files) "a" is in one run
+(defrag-two-files) "b" is in one run
+(defrag-two-files) close "a"
+(defrag-two-files) close "b"
+(defrag-two-files) open "a" for verification
+(defrag-two-files) verified contents of "a"
+(defrag-two-files) close "a"
+(defrag-two-files) open "b" for verification
+(defrag-two-files) verified contents of "b"
+(defrag-two-files) close "b"
+(defrag-two-files) end
+EOF
+pass;
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (10240);
+substr ($data, 1536, 512) = "c" x 512;
+substr ($data, 5000, 100) = "u" x 100;
+substr ($data, 512, 1024) = "d" x 1024;
+check_archive ({"direct" => [$data]});
+pass;
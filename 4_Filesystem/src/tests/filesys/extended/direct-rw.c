@@ -0,0 +1,63 @@
+/* Writes and reads a file through a descriptor opened with
+   O_DIRECT, mixing in unaligned transfers and writes through an
+   ordinary descriptor, and checks that both views agree. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (20 * 512)
+static char buf[FILE_SIZE];
+static char copy[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int dfd, fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("direct", 0), "create \"direct\"");
+  CHECK (open_flags ("direct", 0x80) == -1,
+         "open \"direct\" with unknown flag (must fail)");
+  CHECK ((dfd = open_flags ("direct", O_DIRECT)) > 1,
+         "open \"direct\" with O_DIRECT");
+  CHECK ((fd = open ("direct")) > 1, "open \"direct\"");
+
+  CHECK (write (dfd, buf, FILE_SIZE) == FILE_SIZE,
+         "direct write %d bytes", FILE_SIZE);
+  CHECK (read (fd, copy, FILE_SIZE) == FILE_SIZE,
+         "cached read %d bytes", FILE_SIZE);
+  if (memcmp (copy, buf, FILE_SIZE))
+    fail ("cached read differs from direct write");
+
+  /* Goes through the cache and must be seen by direct reads. */
+  memset (buf + 1536, 'c', 512);
+  seek (fd, 1536);
+  CHECK (write (fd, buf + 1536, 512) == 512, "cached write 512 bytes");
+
+  /* Not sector-aligned, so not direct either. */
+  memset (buf + 5000, 'u', 100);
+  seek (dfd, 5000);
+  CHECK (write (dfd, buf + 5000, 100) == 100, "unaligned write 100 bytes");
+
+  /* Overwrites a sector that is cached, which must not come back. */
+  memset (buf + 512, 'd', 1024);
+  seek (dfd, 512);
+  CHECK (write (dfd, buf + 512, 1024) == 1024, "direct write 1024 bytes");
+
+  seek (dfd, 0);
+  CHECK (read (dfd, copy, FILE_SIZE) == FILE_SIZE,
+         "direct read %d bytes", FILE_SIZE);
+  if (memcmp (copy, buf, FILE_SIZE))
+    fail ("direct read differs from what was written");
+
+  msg ("close \"direct\"");
+  close (dfd);
+  close (fd);
+
+  check_file ("direct", buf, FILE_SIZE);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(direct-rw) begin
+(direct-rw) create "direct"
+(direct-rw) open "direct" with unknown flag (must fail)
+(direct-rw) open "direct" with O_DIRECT
+(direct-rw) open "direct"
+(direct-rw) direct write 10240 bytes
+(direct-rw) cached read 10240 bytes
+(direct-rw) cached write 512 bytes
+(direct-rw) unaligned write 100 bytes
+(direct-rw) direct write 1024 bytes
+(direct-rw) direct read 10240 bytes
+(direct-rw) close "direct"
+(direct-rw) open "direct" for verification
+(direct-rw) verified contents of "direct"
+(direct-rw) close "direct"
+(direct-rw) end
+EOF
+pass;
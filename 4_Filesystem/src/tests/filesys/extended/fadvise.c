@@ -0,0 +1,70 @@
+/* Gives each access pattern hint for a file, reading it in small
+   pieces under the ones that steer read-ahead and eviction, and
+   checks that the hints never change what is read. */
+
+#include <fadvise.h>
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 8192
+#define CHUNK_SIZE 500
+static char buf[FILE_SIZE];
+static char copy[FILE_SIZE];
+
+static void
+read_in_chunks (int fd, const char *how) 
+{
+  size_t ofs;
+
+  seek (fd, 0);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE) 
+    {
+      size_t size = FILE_SIZE - ofs;
+      if (size > CHUNK_SIZE)
+        size = CHUNK_SIZE;
+      if (read (fd, copy + ofs, size) != (int) size)
+        fail ("read %zu bytes at offset %zu failed", size, ofs);
+    }
+  if (memcmp (copy, buf, FILE_SIZE))
+    fail ("contents of \"data\" differ when read %s", how);
+  msg ("read \"data\" %s", how);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, FILE_SIZE) == FILE_SIZE,
+         "write %d bytes to \"data\"", FILE_SIZE);
+
+  read_in_chunks (fd, "without a hint");
+  CHECK (fadvise (fd, 0, 0, FADV_SEQUENTIAL), "fadvise sequential");
+  read_in_chunks (fd, "sequentially");
+  CHECK (fadvise (fd, 0, 0, FADV_RANDOM), "fadvise random");
+  read_in_chunks (fd, "randomly");
+  CHECK (fadvise (fd, 0, 0, FADV_NOREUSE), "fadvise noreuse");
+  read_in_chunks (fd, "once");
+  CHECK (fadvise (fd, 1000, 4000, FADV_DONTNEED),
+         "fadvise dontneed 4000 bytes at 1000");
+  CHECK (fadvise (fd, 0, 0, FADV_WILLNEED), "fadvise willneed");
+  CHECK (fadvise (fd, 0, 0, FADV_NORMAL), "fadvise normal");
+  read_in_chunks (fd, "after willneed");
+
+  CHECK (!fadvise (fd, 0, 0, 99), "fadvise unknown advice (must fail)");
+  CHECK (!fadvise (fd + 100, 0, 0, FADV_WILLNEED),
+         "fadvise bad fd (must fail)");
+
+  msg ("close \"data\"");
+  close (fd);
+
+  check_file ("data", buf, FILE_SIZE);
+}
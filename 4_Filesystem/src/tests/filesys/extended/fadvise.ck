@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fadvise) begin
+(fadvise) create "data"
+(fadvise) open "data"
+(fadvise) write 8192 bytes to "data"
+(fadvise) read "data" without a hint
+(fadvise) fadvise sequential
+(fadvise) read "data" sequentially
+(fadvise) fadvise random
+(fadvise) read "data" randomly
+(fadvise) fadvise noreuse
+(fadvise) read "data" once
+(fadvise) fadvise dontneed 4000 bytes at 1000
+(fadvise) fadvise willneed
+(fadvise) fadvise normal
+(fadvise) read "data" after willneed
+(fadvise) fadvise unknown advice (must fail)
+(fadvise) fadvise bad fd (must fail)
+(fadvise) close "data"
+(fadvise) open "data" for verification
+(fadvise) verified contents of "data"
+(fadvise) close "data"
+(fadvise) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = "\0" x 22000;
+substr ($data, 700, 1000) = random_bytes (1000);
+substr ($data, 4096, 512) = random_bytes (512);
+check_archive ({"prealloc" => [$data]});
+pass;
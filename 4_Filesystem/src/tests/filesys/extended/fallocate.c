@@ -0,0 +1,49 @@
+/* Preallocates a file, checks that it reads as zeros, writes
+   into parts of it, extends the reservation, and checks the
+   contents. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 22000
+static char buf[FILE_SIZE];
+static char buf_check[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  struct statfs before, after;
+  int fd;
+
+  CHECK (create ("prealloc", 0), "create \"prealloc\"");
+  CHECK ((fd = open ("prealloc")) > 1, "open \"prealloc\"");
+  CHECK (statfs (&before), "statfs");
+  CHECK (fallocate (fd, 0, 20000), "fallocate 20000 bytes");
+  CHECK (filesize (fd) == 20000, "filesize is 20000");
+  CHECK (statfs (&after), "statfs");
+  if (before.f_bfree - after.f_bfree < (20000 + 511) / 512)
+    fail ("f_bfree only went from %u to %u", before.f_bfree, after.f_bfree);
+
+  CHECK (read (fd, buf_check, 20000) == 20000, "read \"prealloc\"");
+  if (memcmp (buf_check, buf, 20000))
+    fail ("preallocated data is not zero");
+
+  random_init (0);
+  random_bytes (buf + 700, 1000);
+  random_bytes (buf + 4096, 512);
+  seek (fd, 700);
+  CHECK (write (fd, buf + 700, 1000) == 1000, "write 1000 bytes at 700");
+  seek (fd, 4096);
+  CHECK (write (fd, buf + 4096, 512) == 512, "write 512 bytes at 4096");
+
+  CHECK (fallocate (fd, 19000, 3000), "fallocate 3000 bytes at 19000");
+  CHECK (filesize (fd) == FILE_SIZE, "filesize is %d", FILE_SIZE);
+
+  msg ("close \"prealloc\"");
+  close (fd);
+
+  check_file ("prealloc", buf, FILE_SIZE);
+}
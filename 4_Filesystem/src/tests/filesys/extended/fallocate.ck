@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fallocate) begin
+(fallocate) create "prealloc"
+(fallocate) open "prealloc"
+(fallocate) statfs
+(fallocate) fallocate 20000 bytes
+(fallocate) filesize is 20000
+(fallocate) statfs
+(fallocate) read "prealloc"
+(fallocate) write 1000 bytes at 700
+(fallocate) write 512 bytes at 4096
+(fallocate) fallocate 3000 bytes at 19000
+(fallocate) filesize is 22000
+(fallocate) close "prealloc"
+(fallocate) open "prealloc" for verification
+(fallocate) verified contents of "prealloc"
+(fallocate) close "prealloc"
+(fallocate) end
+EOF
+pass;
@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({
+  "f1" => ["f1" . ("\0" x 14)],
+  "f3" => ["f3" . ("\0" x 14)],
+  "f5" => ["f5" . ("\0" x 14)],
+  "f7" => ["f7" . ("\0" x 14)],
+  "f9" => ["f9" . ("\0" x 14)],
+  "f11" => ["f11" . ("\0" x 13)],
+  "f13" => ["f13" . ("\0" x 13)],
+  "f15" => ["f15" . ("\0" x 13)],
+  "f17" => ["f17" . ("\0" x 13)],
+  "f19" => ["f19" . ("\0" x 13)],
+  "f21" => ["f21" . ("\0" x 13)],
+  "f23" => ["f23" . ("\0" x 13)],
+  "f25" => ["f25" . ("\0" x 13)],
+  "f27" => ["f27" . ("\0" x 13)],
+  "f29" => ["f29" . ("\0" x 13)],
+  "f31" => ["f31" . ("\0" x 13)],
+  "f33" => ["f33" . ("\0" x 13)],
+  "f35" => ["f35" . ("\0" x 13)],
+  "f37" => ["f37" . ("\0" x 13)],
+  "f39" => ["f39" . ("\0" x 13)],
+});
+pass;
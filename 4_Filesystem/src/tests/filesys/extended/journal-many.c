@@ -0,0 +1,58 @@
+/* Creates and removes many small files in a row, so that their
+   metadata updates are grouped into a few journal transactions,
+   then checks the survivors. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 40
+
+void
+test_main (void) 
+{
+  char name[16];
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+      fd = open (name);
+      if (fd < 2)
+        fail ("open \"%s\" failed", name);
+      if (write (fd, name, sizeof name) != sizeof name)
+        fail ("write \"%s\" failed", name);
+      close (fd);
+    }
+  msg ("created %d files", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  msg ("removed every other file");
+
+  for (i = 1; i < FILE_CNT; i += 2)
+    {
+      char buf[sizeof name];
+      int fd;
+
+      snprintf (name, sizeof name, "f%d", i);
+      fd = open (name);
+      if (fd < 2)
+        fail ("open \"%s\" failed", name);
+      if (read (fd, buf, sizeof buf) != sizeof buf
+          || memcmp (buf, name, sizeof name))
+        fail ("contents of \"%s\" differ", name);
+      close (fd);
+    }
+  msg ("verified remaining files");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(journal-many) begin
+(journal-many) created 40 files
+(journal-many) removed every other file
+(journal-many) verified remaining files
+(journal-many) end
+EOF
+pass;
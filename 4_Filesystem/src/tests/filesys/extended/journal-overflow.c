@@ -0,0 +1,49 @@
+/* Creates a file whose index blocks alone are more than one
+   journal transaction can hold, checks that it reads back as
+   zeros, then removes it and waits for its sectors to come
+   back. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (3000 * 512)
+static char buf[4096];
+static char zeros[sizeof buf];
+
+void
+test_main (void) 
+{
+  struct statfs before, after;
+  int fd;
+  int ofs;
+  int i;
+
+  CHECK (statfs (&before), "statfs");
+  CHECK (create ("big", FILE_SIZE), "create \"big\" of %d bytes", FILE_SIZE);
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+  CHECK (filesize (fd) == FILE_SIZE, "filesize is %d", FILE_SIZE);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+    {
+      int size = FILE_SIZE - ofs < (int) sizeof buf ? FILE_SIZE - ofs
+                                                    : (int) sizeof buf;
+      if (read (fd, buf, size) != size)
+        fail ("read %d bytes at offset %d failed", size, ofs);
+      if (memcmp (buf, zeros, size))
+        fail ("data at offset %d is not zero", ofs);
+    }
+  msg ("verified contents of \"big\"");
+  CHECK (remove ("big"), "remove \"big\"");
+  msg ("close \"big\"");
+  close (fd);
+
+  /* Sectors are freed in the background, so wait for them. */
+  CHECK (statfs (&after), "statfs");
+  for (i = 0; i < 1000000 && after.f_bfree != before.f_bfree; i++)
+    statfs (&after);
+  if (after.f_bfree != before.f_bfree)
+    fail ("only %u of %u free sectors came back",
+          after.f_bfree, before.f_bfree);
+  msg ("all sectors reclaimed");
+}
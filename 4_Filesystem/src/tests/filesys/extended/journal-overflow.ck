@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(journal-overflow) begin
+(journal-overflow) statfs
+(journal-overflow) create "big" of 1536000 bytes
+(journal-overflow) open "big"
+(journal-overflow) filesize is 1536000
+(journal-overflow) verified contents of "big"
+(journal-overflow) remove "big"
+(journal-overflow) close "big"
+(journal-overflow) statfs
+(journal-overflow) all sectors reclaimed
+(journal-overflow) end
+EOF
+pass;
@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($clone) = random_bytes (70000);
+substr ($clone, 1000, 600) = random_bytes (600);
+check_archive ({"clone" => [$clone]});
+pass;
@@ -0,0 +1,48 @@
+/* Clones a file with reflink(), writes into the middle of the
+   clone, and checks that only the clone changed, including after
+   the original is removed. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 70000
+#define PATCH_OFS 1000
+#define PATCH_SIZE 600
+static char buf[FILE_SIZE];
+static char cloned[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  memcpy (cloned, buf, sizeof cloned);
+  random_bytes (cloned + PATCH_OFS, PATCH_SIZE);
+
+  CHECK (create ("orig", 0), "create \"orig\"");
+  CHECK ((fd = open ("orig")) > 1, "open \"orig\"");
+  CHECK (write (fd, buf, FILE_SIZE) == FILE_SIZE, "write \"orig\"");
+  CHECK (reflink (fd, "clone"), "reflink \"orig\" to \"clone\"");
+  CHECK (!reflink (fd, "clone"), "reflink to existing \"clone\" (must fail)");
+  msg ("close \"orig\"");
+  close (fd);
+
+  CHECK ((fd = open ("clone")) > 1, "open \"clone\"");
+  msg ("seek \"clone\"");
+  seek (fd, PATCH_OFS);
+  CHECK (write (fd, cloned + PATCH_OFS, PATCH_SIZE) == PATCH_SIZE,
+         "write \"clone\"");
+  msg ("close \"clone\"");
+  close (fd);
+
+  check_file ("orig", buf, FILE_SIZE);
+  check_file ("clone", cloned, FILE_SIZE);
+
+  CHECK (remove ("orig"), "remove \"orig\"");
+  check_file ("clone", cloned, FILE_SIZE);
+}
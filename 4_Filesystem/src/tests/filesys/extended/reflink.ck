@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(reflink) begin
+(reflink) create "orig"
+(reflink) open "orig"
+(reflink) write "orig"
+(reflink) reflink "orig" to "clone"
+(reflink) reflink to existing "clone" (must fail)
+(reflink) close "orig"
+(reflink) open "clone"
+(reflink) seek "clone"
+(reflink) write "clone"
+(reflink) close "clone"
+(reflink) open "orig" for verification
+(reflink) verified contents of "orig"
+(reflink) close "orig"
+(reflink) open "clone" for verification
+(reflink) verified contents of "clone"
+(reflink) close "clone"
+(reflink) remove "orig"
+(reflink) open "clone" for verification
+(reflink) verified contents of "clone"
+(reflink) close "clone"
+(reflink) end
+EOF
+pass;
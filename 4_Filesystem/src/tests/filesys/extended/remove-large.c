@@ -0,0 +1,36 @@
+/* Removes a large file while it is open, then closes it.  The
+   close must not wait for the file's sectors to be freed, but
+   they must all come back soon after. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (300 * 512)
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  struct statfs before, after;
+  int fd;
+  int i;
+
+  CHECK (statfs (&before), "statfs");
+  CHECK (create ("large", 0), "create \"large\"");
+  CHECK ((fd = open ("large")) > 1, "open \"large\"");
+  CHECK (write (fd, buf, FILE_SIZE) == FILE_SIZE, "write \"large\"");
+  CHECK (remove ("large"), "remove \"large\"");
+  CHECK (open ("large") == -1, "open removed \"large\" (must fail)");
+  msg ("close \"large\"");
+  close (fd);
+
+  /* Sectors are freed in the background, so wait for them. */
+  CHECK (statfs (&after), "statfs");
+  for (i = 0; i < 1000000 && after.f_bfree != before.f_bfree; i++)
+    statfs (&after);
+  if (after.f_bfree != before.f_bfree)
+    fail ("only %u of %u free sectors came back",
+          after.f_bfree, before.f_bfree);
+  msg ("all sectors reclaimed");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(remove-large) begin
+(remove-large) statfs
+(remove-large) create "large"
+(remove-large) open "large"
+(remove-large) write "large"
+(remove-large) remove "large"
+(remove-large) open removed "large" (must fail)
+(remove-large) close "large"
+(remove-large) statfs
+(remove-large) all sectors reclaimed
+(remove-large) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Checks that statfs() tracks files and free sectors as a file
+   is created, grown, and removed.  Sectors of a removed file are
+   freed in the background, so the free count is polled. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 5000
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  struct statfs before, during, after;
+  int fd;
+  int i;
+
+  CHECK (statfs (&before), "statfs");
+  if (before.f_bsize != 512)
+    fail ("f_bsize is %u, expected 512", before.f_bsize);
+  if (before.f_bfree == 0 || before.f_bfree >= before.f_blocks)
+    fail ("f_bfree %u out of range (f_blocks %u)",
+          before.f_bfree, before.f_blocks);
+  if (before.f_files == 0)
+    fail ("no files counted, not even the root directory");
+
+  CHECK (create ("stat", 0), "create \"stat\"");
+  CHECK ((fd = open ("stat")) > 1, "open \"stat\"");
+  CHECK (write (fd, buf, FILE_SIZE) == FILE_SIZE, "write \"stat\"");
+  msg ("close \"stat\"");
+  close (fd);
+
+  CHECK (statfs (&during), "statfs");
+  if (during.f_files != before.f_files + 1)
+    fail ("f_files went from %u to %u after create",
+          before.f_files, during.f_files);
+  if (before.f_bfree - during.f_bfree < (FILE_SIZE + 511) / 512 + 1)
+    fail ("f_bfree only went from %u to %u after write",
+          before.f_bfree, during.f_bfree);
+
+  CHECK (remove ("stat"), "remove \"stat\"");
+  CHECK (statfs (&after), "statfs");
+  for (i = 0; i < 100000 && after.f_bfree != before.f_bfree; i++)
+    statfs (&after);
+  if (after.f_files != before.f_files || after.f_bfree != before.f_bfree)
+    fail ("counts not restored after remove: %u files, %u free",
+          after.f_files, after.f_bfree);
+}
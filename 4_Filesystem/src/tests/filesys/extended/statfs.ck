@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(statfs) begin
+(statfs) statfs
+(statfs) create "stat"
+(statfs) open "stat"
+(statfs) write "stat"
+(statfs) close "stat"
+(statfs) statfs
+(statfs) remove "stat"
+(statfs) statfs
+(statfs) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Writes a file with writev() from three segments and reads it
+   back with readv() into segments split at different offsets,
+   checking that the data lines up across segment boundaries. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 5678
+static char buf[FILE_SIZE];
+static char rbuf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  struct iovec iov[3];
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("vec", 0), "create \"vec\"");
+  CHECK ((fd = open ("vec")) > 1, "open \"vec\"");
+
+  iov[0].iov_base = buf;
+  iov[0].iov_len = 100;
+  iov[1].iov_base = buf + 100;
+  iov[1].iov_len = 1700;
+  iov[2].iov_base = buf + 1800;
+  iov[2].iov_len = FILE_SIZE - 1800;
+  CHECK (writev (fd, iov, 3) == FILE_SIZE, "writev \"vec\"");
+  msg ("close \"vec\"");
+  close (fd);
+
+  CHECK ((fd = open ("vec")) > 1, "open \"vec\"");
+  iov[0].iov_base = rbuf;
+  iov[0].iov_len = 512;
+  iov[1].iov_base = rbuf + 512;
+  iov[1].iov_len = FILE_SIZE - 512;
+  CHECK (readv (fd, iov, 2) == FILE_SIZE, "readv \"vec\"");
+  compare_bytes (rbuf, buf, FILE_SIZE, 0, "vec");
+  msg ("close \"vec\"");
+  close (fd);
+
+  check_file ("vec", buf, FILE_SIZE);
+}
@@ -0,0 +1,46 @@
+/* Reads a file over and over so that its sectors are the hottest
+   in the buffer cache when the file system is unmounted.  The
+   persistence check then reboots, which prefetches them again
+   while the archive is being written, and checks the file. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 6000
+#define READ_CNT 20
+static char buf[FILE_SIZE];
+static char copy[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+  int i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("hot", 0), "create \"hot\"");
+  CHECK ((fd = open ("hot")) > 1, "open \"hot\"");
+  CHECK (write (fd, buf, FILE_SIZE) == FILE_SIZE,
+         "write %d bytes to \"hot\"", FILE_SIZE);
+  msg ("close \"hot\"");
+  close (fd);
+
+  CHECK ((fd = open ("hot")) > 1, "open \"hot\" for reading");
+  msg ("read \"hot\" %d times", READ_CNT);
+  for (i = 0; i < READ_CNT; i++)
+    {
+      seek (fd, 0);
+      if (read (fd, copy, FILE_SIZE) != FILE_SIZE
+          || memcmp (copy, buf, FILE_SIZE))
+        fail ("pass %d: contents of \"hot\" differ", i);
+    }
+  msg ("close \"hot\"");
+  close (fd);
+
+  check_file ("hot", buf, FILE_SIZE);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(warm-reboot) begin
+(warm-reboot) create "hot"
+(warm-reboot) open "hot"
+(warm-reboot) write 6000 bytes to "hot"
+(warm-reboot) close "hot"
+(warm-reboot) open "hot" for reading
+(warm-reboot) read "hot" 20 times
+(warm-reboot) close "hot"
+(warm-reboot) open "hot" for verification
+(warm-reboot) verified contents of "hot"
+(warm-reboot) close "hot"
+(warm-reboot) end
+EOF
+pass;
@@ -28,12 +28,19 @@
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/aio.h"
 #else
 #include "tests/threads/tests.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/blocktrace.h"
+#include "devices/diskmodel.h"
 #include "devices/ide.h"
+#include "devices/pci.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -52,6 +59,17 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -ramdisk, -ramdisk-load: Size of the RAM disk in kB, and
+   whether to fill it from the scratch disk. */
+static size_t ramdisk_kb;
+static bool ramdisk_load;
+
+/* -blocktrace: Number of block trace records to keep. */
+static size_t blocktrace_cnt;
+
+/* -stripe: Devices and chunk size for the striped device md0. */
+static char *stripe_spec;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -122,10 +140,20 @@ main (void)
 
 #ifdef FILESYS
   /* Initialize file system. */
+  blocktrace_init (blocktrace_cnt);
+  pci_init ();
   ide_init ();
+  virtio_blk_init ();
+  ramdisk_init (ramdisk_kb, ramdisk_load);
+  if (stripe_spec != NULL)
+    stripe_init (stripe_spec);
+  diskmodel_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef USERPROG
+  aio_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -247,6 +275,29 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_kb = atoi (value);
+      else if (!strcmp (name, "-ramdisk-load"))
+        ramdisk_load = true;
+      else if (!strcmp (name, "-stripe"))
+        {
+          if (value == NULL)
+            PANIC ("-stripe needs a list of devices");
+          stripe_spec = value;
+        }
+      else if (!strcmp (name, "-blocktrace"))
+        blocktrace_cnt = value != NULL ? atoi (value) : 16384;
+      else if (!strcmp (name, "-diskmodel"))
+        {
+          if (value == NULL)
+            PANIC ("-diskmodel needs a device and parameters");
+          diskmodel_configure (value);
+        }
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (value == NULL || !block_set_scheduler (value))
+            PANIC ("unknown I/O scheduler `%s'", value != NULL ? value : "");
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -373,6 +424,17 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -iosched=SCHED     Use SCHED (noop, clook, deadline) for disks.\n"
+          "  -ramdisk=KB        Create a KB kB RAM disk named ram0.\n"
+          "  -ramdisk-load      Fill ram0 from the scratch disk.\n"
+          "  -stripe=DEV,DEV[,...][:CHUNK]\n"
+          "                     Stripe md0 over DEVs in CHUNK-sector chunks.\n"
+          "  -blocktrace[=N]    Trace the last N (16384) block accesses and\n"
+          "                     print them at power off.\n"
+          "  -diskmodel=DEV:PARAMS\n"
+          "                     Slow DEV down to a modeled disk.  PARAMS are\n"
+          "                     comma-separated: a preset (hdd, laptop, ssd)\n"
+          "                     and/or lat=US, seek=US, rpm=N, bw=KB.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -146,6 +146,14 @@ struct thread
   struct hash vm; 
   struct list mmap_list;
   int mapid;
+  /* Registered asynchronous I/O ring, or NULL */
+  struct aio_context *aio;
+  /* Nesting depth of journal_begin() */
+  int journal_depth;
+  /* Journal credits not used yet by the outermost operation */
+  size_t journal_credits;
+  /* Subsystem tag for block trace records (enum blocktrace_source) */
+  uint8_t io_source;
   };
 
 /* If false (default), use round-robin scheduler.
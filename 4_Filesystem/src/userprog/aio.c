@@ -0,0 +1,364 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+
+/* Asynchronous I/O.
+
+   aio_enter() copies each submission queue entry into an
+   aio_request and appends it to a global queue, then returns
+   without waiting for the I/O.  A small pool of kernel worker
+   threads takes requests off the queue, performs them against
+   the submitting process's memory through its page directory,
+   and posts the result to the process's completion queue.
+
+   The pages of a request's buffer, faulted in when aio_enter()
+   checks it, are pinned from submission to completion, so that
+   munmap() does not take them away while a worker uses them.
+   This kernel has no frame eviction; one added later must skip
+   pinned pages too.
+
+   The kernel never accepts more requests than there is room for
+   in the completion queue, counting completions that have been
+   posted but not yet reaped, so posting a completion can never
+   overwrite one the process has not seen. */
+
+/* Number of worker threads. */
+#define AIO_WORKERS 2
+
+/* A submitted request. */
+struct aio_request
+  {
+    struct list_elem elem;      /* Element in request_list. */
+    struct aio_context *ctx;    /* Submitting process's ring. */
+    struct file *file;          /* Private reopened file. */
+    int opcode;                 /* AIO_READ or AIO_WRITE. */
+    uint8_t *buf;               /* User buffer. */
+    unsigned len;               /* Number of bytes. */
+    struct vm_entry **pages;    /* Pinned pages of the buffer. */
+    size_t page_cnt;            /* Number of pinned pages. */
+    off_t offset;               /* File offset. */
+    uint32_t user_data;         /* Returned in the completion. */
+  };
+
+static struct list request_list;     /* Queued requests. */
+static struct lock request_lock;     /* Protects request_list. */
+static struct semaphore request_sema;/* Counts queued requests. */
+
+static void aio_worker (void *aux);
+static bool pin_buffer (struct aio_context *, struct aio_request *);
+static void unpin_buffer (struct aio_request *);
+static int do_request (struct aio_request *);
+static void post_completion (struct aio_context *, uint32_t user_data,
+                             int res);
+
+/* Initializes the request queue and starts the worker threads. */
+void
+aio_init (void) 
+{
+  int i;
+
+  list_init (&request_list);
+  lock_init (&request_lock);
+  sema_init (&request_sema, 0);
+  for (i = 0; i < AIO_WORKERS; i++)
+    if (thread_create ("aio_worker", PRI_DEFAULT, aio_worker, NULL)
+        == TID_ERROR)
+      PANIC ("could not start aio worker");
+}
+
+/* Registers URING, which the caller has checked to be a
+   writable user mapping that lies within a single page, as the
+   running process's ring.  The ring is reset to empty.
+   Returns the new context, or a null pointer on failure. */
+struct aio_context *
+aio_create (struct aio_ring *uring) 
+{
+  struct thread *cur = thread_current ();
+  struct aio_context *ctx;
+  struct aio_ring *ring;
+
+  ring = pagedir_get_page (cur->pagedir, uring);
+  if (ring == NULL)
+    return NULL;
+
+  ctx = malloc (sizeof *ctx);
+  if (ctx == NULL)
+    return NULL;
+  ctx->uring = uring;
+  ctx->ring = ring;
+  ctx->pagedir = cur->pagedir;
+  lock_init (&ctx->lock);
+  cond_init (&ctx->done);
+  ctx->inflight = 0;
+
+  ring->sq_head = ring->sq_tail = 0;
+  ring->cq_head = ring->cq_tail = 0;
+  return ctx;
+}
+
+/* Waits for CTX's outstanding requests and frees it.
+   Called when the owning process exits, before its memory is
+   torn down. */
+void
+aio_destroy (struct aio_context *ctx) 
+{
+  if (ctx == NULL)
+    return;
+  aio_drain (ctx);
+  free (ctx);
+}
+
+/* Returns true if one more request may be submitted to CTX
+   without risking a completion queue overflow. */
+bool
+aio_can_submit (struct aio_context *ctx) 
+{
+  unsigned unreaped;
+  bool ok;
+
+  lock_acquire (&ctx->lock);
+  unreaped = ctx->ring->cq_tail - ctx->ring->cq_head;
+  ok = (unreaped <= AIO_CQ_ENTRIES
+        && ctx->inflight + unreaped < AIO_CQ_ENTRIES);
+  lock_release (&ctx->lock);
+  return ok;
+}
+
+/* Queues SQE, already checked by the caller, for a worker, and
+   pins the pages of its buffer.  FILE is a private file handle
+   that the request takes over and closes when it completes. */
+void
+aio_submit (struct aio_context *ctx, const struct aio_sqe *sqe,
+            struct file *file) 
+{
+  struct aio_request *req = malloc (sizeof *req);
+
+  if (req != NULL) 
+    {
+      req->ctx = ctx;
+      req->file = file;
+      req->opcode = sqe->opcode;
+      req->buf = sqe->buf;
+      req->len = sqe->len;
+      req->offset = sqe->offset;
+      req->user_data = sqe->user_data;
+    }
+  if (req == NULL || !pin_buffer (ctx, req)) 
+    {
+      free (req);
+      lock_acquire (&filesys_lock);
+      file_close (file);
+      lock_release (&filesys_lock);
+      aio_fail (ctx, sqe->user_data);
+      return;
+    }
+
+  lock_acquire (&ctx->lock);
+  ctx->inflight++;
+  lock_release (&ctx->lock);
+
+  lock_acquire (&request_lock);
+  list_push_back (&request_list, &req->elem);
+  lock_release (&request_lock);
+  sema_up (&request_sema);
+}
+
+/* Posts a failed completion for USER_DATA without doing any
+   I/O, for submissions that were rejected. */
+void
+aio_fail (struct aio_context *ctx, uint32_t user_data) 
+{
+  lock_acquire (&ctx->lock);
+  post_completion (ctx, user_data, -1);
+  lock_release (&ctx->lock);
+}
+
+/* Waits until at least MIN_COMPLETE completions are waiting to
+   be reaped in CTX, or until nothing more is in flight. */
+void
+aio_wait (struct aio_context *ctx, unsigned min_complete) 
+{
+  lock_acquire (&ctx->lock);
+  while (ctx->inflight > 0
+         && ctx->ring->cq_tail - ctx->ring->cq_head < min_complete)
+    cond_wait (&ctx->done, &ctx->lock);
+  lock_release (&ctx->lock);
+}
+
+/* Waits until every request submitted to CTX has completed. */
+void
+aio_drain (struct aio_context *ctx) 
+{
+  lock_acquire (&ctx->lock);
+  while (ctx->inflight > 0)
+    cond_wait (&ctx->done, &ctx->lock);
+  lock_release (&ctx->lock);
+}
+
+/* Waits until no request of CTX, which may be null, has VME
+   pinned, so that its page can be unmapped. */
+void
+aio_wait_unpinned (struct aio_context *ctx, struct vm_entry *vme) 
+{
+  if (ctx == NULL)
+    return;
+  lock_acquire (&ctx->lock);
+  while (vme->pinned > 0)
+    cond_wait (&ctx->done, &ctx->lock);
+  lock_release (&ctx->lock);
+}
+
+/* Pins the pages of REQ's buffer, which belongs to the running
+   process.  Returns false, pinning nothing, if one of them is
+   not loaded or memory runs out. */
+static bool
+pin_buffer (struct aio_context *ctx, struct aio_request *req) 
+{
+  uint8_t *upage = pg_round_down (req->buf);
+  size_t i;
+
+  req->page_cnt = req->len > 0
+                  ? pg_no (req->buf + req->len - 1) - pg_no (upage) + 1 : 0;
+  req->pages = NULL;
+  if (req->page_cnt == 0)
+    return true;
+  req->pages = malloc (req->page_cnt * sizeof *req->pages);
+  if (req->pages == NULL)
+    return false;
+
+  for (i = 0; i < req->page_cnt; i++, upage += PGSIZE) 
+    {
+      struct vm_entry *vme = find_vme (upage);
+      if (vme == NULL || !vme->is_loaded) 
+        {
+          free (req->pages);
+          return false;
+        }
+      req->pages[i] = vme;
+    }
+
+  lock_acquire (&ctx->lock);
+  for (i = 0; i < req->page_cnt; i++)
+    req->pages[i]->pinned++;
+  lock_release (&ctx->lock);
+  return true;
+}
+
+/* Unpins the pages of REQ's buffer.  REQ's context's lock must
+   be held. */
+static void
+unpin_buffer (struct aio_request *req) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&req->ctx->lock));
+
+  for (i = 0; i < req->page_cnt; i++)
+    req->pages[i]->pinned--;
+  free (req->pages);
+}
+
+/* Worker thread: performs queued requests forever. */
+static void
+aio_worker (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      struct aio_request *req;
+      struct aio_context *ctx;
+      int res;
+
+      sema_down (&request_sema);
+      lock_acquire (&request_lock);
+      req = list_entry (list_pop_front (&request_list),
+                        struct aio_request, elem);
+      lock_release (&request_lock);
+
+      ctx = req->ctx;
+      res = do_request (req);
+
+      lock_acquire (&filesys_lock);
+      file_close (req->file);
+      lock_release (&filesys_lock);
+
+      lock_acquire (&ctx->lock);
+      unpin_buffer (req);
+      ctx->inflight--;
+      post_completion (ctx, req->user_data, res);
+      lock_release (&ctx->lock);
+      free (req);
+    }
+}
+
+/* Performs REQ one user page at a time, reaching the user
+   buffer through the owner's page directory since a worker runs
+   with no user address space of its own.  The file system lock
+   is taken per page so that other processes' I/O interleaves.
+   Returns the number of bytes transferred, which is short at end
+   of file. */
+static int
+do_request (struct aio_request *req) 
+{
+  uint32_t *pd = req->ctx->pagedir;
+  uint8_t *ubuf = req->buf;
+  unsigned left = req->len;
+  off_t offset = req->offset;
+  int done = 0;
+
+  while (left > 0) 
+    {
+      unsigned page_left = PGSIZE - pg_ofs (ubuf);
+      unsigned chunk = left < page_left ? left : page_left;
+      /* Pinned by aio_submit(), so still mapped. */
+      uint8_t *kbuf = pagedir_get_page (pd, ubuf);
+      off_t n;
+
+      ASSERT (kbuf != NULL);
+
+      lock_acquire (&filesys_lock);
+      if (req->opcode == AIO_READ) 
+        {
+          n = file_read_at (req->file, kbuf, chunk, offset);
+          /* Writes through the kernel alias do not set the user
+             PTE's dirty bit, which munmap() relies on. */
+          if (n > 0)
+            pagedir_set_dirty (pd, ubuf, true);
+        }
+      else
+        n = file_write_at (req->file, kbuf, chunk, offset);
+      lock_release (&filesys_lock);
+
+      done += n;
+      if (n != (off_t) chunk)
+        break;
+      ubuf += chunk;
+      offset += chunk;
+      left -= chunk;
+    }
+  return done;
+}
+
+/* Writes a completion to CTX's completion queue and wakes any
+   waiter.  CTX's lock must be held. */
+static void
+post_completion (struct aio_context *ctx, uint32_t user_data, int res) 
+{
+  struct aio_ring *ring = ctx->ring;
+  struct aio_cqe *cqe = &ring->cq[ring->cq_tail % AIO_CQ_ENTRIES];
+
+  ASSERT (lock_held_by_current_thread (&ctx->lock));
+
+  cqe->user_data = user_data;
+  cqe->res = res;
+  /* The entry must be in place before the process can see it. */
+  barrier ();
+  ring->cq_tail++;
+  cond_broadcast (&ctx->done, &ctx->lock);
+}
@@ -0,0 +1,35 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <aio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+struct file;
+struct vm_entry;
+
+/* A process's registered asynchronous I/O ring. */
+struct aio_context
+  {
+    struct aio_ring *uring;     /* Ring, user address. */
+    struct aio_ring *ring;      /* Same ring, kernel address. */
+    uint32_t *pagedir;          /* Owner's page directory. */
+    struct lock lock;           /* Protects inflight and cq_tail. */
+    struct condition done;      /* Signaled on each completion. */
+    int inflight;               /* Requests queued or running. */
+  };
+
+void aio_init (void);
+struct aio_context *aio_create (struct aio_ring *uring);
+void aio_destroy (struct aio_context *);
+
+bool aio_can_submit (struct aio_context *);
+void aio_submit (struct aio_context *, const struct aio_sqe *,
+                 struct file *);
+void aio_fail (struct aio_context *, uint32_t user_data);
+void aio_wait (struct aio_context *, unsigned min_complete);
+void aio_drain (struct aio_context *);
+void aio_wait_unpinned (struct aio_context *, struct vm_entry *);
+
+#endif /* userprog/aio.h */
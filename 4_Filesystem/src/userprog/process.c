@@ -9,6 +9,7 @@
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
+#include "userprog/aio.h"
 #include "userprog/syscall.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -250,6 +251,11 @@ process_exit (void)
 {
     struct thread *cur = thread_current ();
     uint32_t *pd;
+
+    //Wait for in-flight async I/O before tearing anything down
+    aio_destroy(cur->aio);
+    cur->aio = NULL;
+
     //실습 : 유저프로세스가 파일을 닫지 않고 프로세스가 끝내려고 하는 경우 파일을 다 닫아주기 위함
 
     //Close file discripter step by step
@@ -595,6 +601,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
         vme->offset = ofs;
         vme->read_bytes = p_read_bytes;
         vme->zero_bytes = p_zero_bytes;
+        vme->pinned = 0;
 
         /* insert_vme() 함수를 사용해서 생성한 vm_entry를 해시테이블에 추가 */
         insert_vme (&thread_current()->vm, vme);
@@ -634,6 +641,7 @@ setup_stack (void **esp)
     vme->writable = true;
     vme->type = VM_ANON;
     vme->is_loaded = true;
+    vme->pinned = 0;
     /* insert_vme() 함수로 해시테이블에 추가 */
     insert_vme (&thread_current()->vm, vme);
 
@@ -682,6 +690,9 @@ struct file *process_get_file (int fd){
     //t = current thread
     struct thread *t = thread_current();
 
+    //Out of range fd. fdt is not zeroed past next_fd
+    if(fd < 2 || fd >= t->next_fd)
+        return NULL;
     //If not NULL, return file id
     if(t->fdt[fd] != NULL)
         return t->fdt[fd];
@@ -14,6 +14,12 @@
 #include "vm/page.h"
 #include "userprog/pagedir.h"
 #include "threads/vaddr.h"
+#include <iovec.h>
+#include <fcntl.h>
+#include "userprog/aio.h"
+#include "filesys/inode.h"
+#include "filesys/superblock.h"
+#include "devices/block.h"
 
 
 static void syscall_handler (struct intr_frame *);
@@ -39,6 +45,23 @@ bool sys_mkdir(const char *dir);
 int sys_inumber(int fd);
 bool sys_readdir(int fd, char *name);
 
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int fd_in, int fd_out, unsigned size);
+bool reflink (int fd, const char *file);
+bool aio_setup (struct aio_ring *ring, void *esp);
+int aio_enter (unsigned min_complete, void *esp);
+bool statfs (struct statfs *st);
+bool compress (int fd);
+bool fallocate (int fd, unsigned offset, unsigned length);
+bool fadvise (int fd, unsigned offset, unsigned len, int advice);
+int open_flags (const char *file, int flags);
+bool blockstat (int role, struct blockstat *st);
+int extents (int fd);
+bool defrag (int fd);
+static bool get_iovec (const struct iovec *uiov, int iovcnt,
+                       struct iovec *kiov, void *esp, bool to_write);
+
 void
 syscall_init (void) {
     intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
@@ -51,7 +74,7 @@ syscall_handler (struct intr_frame *f) {
     uint32_t *esp = f->esp;// Get user stack pointer
     check_address((void *)esp, (void *)esp); // 주소값이 유효한지 확인
     int syscall_nr = *esp; 
-    int arg[3];
+    int arg[4];
     
     /* System Call switch */
     switch(syscall_nr) {
@@ -171,6 +194,90 @@ syscall_handler (struct intr_frame *f) {
             get_argument(esp , arg , 1);
             f -> eax = sys_inumber(arg[0]);
             break;
+
+        case SYS_READV:
+        case SYS_WRITEV: {
+            struct iovec iov[IOV_MAX];
+            bool is_read = syscall_nr == SYS_READV;
+
+            get_argument(esp, arg, 3);
+            /* iovec 배열과 모든 segment를 한 번에 검사 */
+            if (!get_iovec((const struct iovec *) arg[1], arg[2], iov,
+                           f->esp, is_read)) {
+                f->eax = -1;
+                break;
+            }
+            f->eax = is_read ? readv(arg[0], iov, arg[2])
+                             : writev(arg[0], iov, arg[2]);
+            break;
+        }
+
+        case SYS_COPY_FILE_RANGE:
+            get_argument(esp, arg, 3);
+            f->eax = copy_file_range(arg[0], arg[1], (unsigned) arg[2]);
+            break;
+
+        case SYS_REFLINK:
+            get_argument(esp, arg, 2);
+            check_valid_string((const void *) arg[1], f->esp);
+            f->eax = reflink(arg[0], (const char *) arg[1]);
+            break;
+
+        case SYS_AIO_SETUP:
+            get_argument(esp, arg, 1);
+            f->eax = aio_setup((struct aio_ring *) arg[0], f->esp);
+            break;
+
+        case SYS_AIO_ENTER:
+            get_argument(esp, arg, 1);
+            f->eax = aio_enter((unsigned) arg[0], f->esp);
+            break;
+
+        case SYS_STATFS:
+            get_argument(esp, arg, 1);
+            check_valid_buffer((void *) arg[0], sizeof (struct statfs),
+                               f->esp, true);
+            f->eax = statfs((struct statfs *) arg[0]);
+            break;
+
+        case SYS_COMPRESS:
+            get_argument(esp, arg, 1);
+            f->eax = compress(arg[0]);
+            break;
+
+        case SYS_FALLOCATE:
+            get_argument(esp, arg, 3);
+            f->eax = fallocate(arg[0], (unsigned) arg[1], (unsigned) arg[2]);
+            break;
+
+        case SYS_FADVISE:
+            get_argument(esp, arg, 4);
+            f->eax = fadvise(arg[0], (unsigned) arg[1], (unsigned) arg[2],
+                             arg[3]);
+            break;
+
+        case SYS_OPEN_FLAGS:
+            get_argument(esp, arg, 2);
+            check_valid_string((const void *)arg[0], f->esp);
+            f->eax = open_flags((const char *)arg[0], arg[1]);
+            break;
+
+        case SYS_BLOCKSTAT:
+            get_argument(esp, arg, 2);
+            check_valid_buffer((void *) arg[1], sizeof (struct blockstat),
+                               f->esp, true);
+            f->eax = blockstat(arg[0], (struct blockstat *) arg[1]);
+            break;
+
+        case SYS_EXTENTS:
+            get_argument(esp, arg, 1);
+            f->eax = extents(arg[0]);
+            break;
+
+        case SYS_DEFRAG:
+            get_argument(esp, arg, 1);
+            f->eax = defrag(arg[0]);
+            break;
         //NOT SYSCALL
         default :
             exit(-1);
@@ -276,6 +383,24 @@ int open(const char *file){
     return fd;
 }
 
+//Like open, with O_* flags. O_DIRECT moves whole sectors around the cache
+int open_flags (const char *file, int flags) {
+
+    struct file *f;
+    int fd;
+
+    if (flags & ~O_DIRECT)
+        return -1;
+
+    lock_acquire(&filesys_lock);
+    f = filesys_open(file);
+    if (f != NULL && (flags & O_DIRECT))
+        file_set_direct(f, true);
+    fd = process_add_file(f);
+    lock_release(&filesys_lock);
+    return fd;
+}
+
 int filesize(int fd){
     struct file *f;
     //Get file
@@ -350,6 +475,278 @@ int write (int fd, void *buffer, unsigned size) {
     return bytesize;
 }
 
+//Scatter read. Segments are already validated by get_iovec
+int readv (int fd, const struct iovec *iov, int iovcnt) {
+
+    struct file *f;
+    int size = 0;
+    int i;
+
+    //Lock acquire, once for every segment
+    lock_acquire (&filesys_lock);
+
+    if (fd == 0) {
+        for (i = 0; i < iovcnt; i++) {
+            char *buffer = iov[i].iov_base;
+            unsigned count = iov[i].iov_len;
+            while (count--)
+                *buffer++ = input_getc();
+            size += iov[i].iov_len;
+        }
+        lock_release(&filesys_lock);
+        return size;
+    }
+
+    //If NULL file, return -1
+    if ((f = process_get_file(fd)) == NULL) {
+        lock_release(&filesys_lock);
+        return -1;
+    }
+
+    //One inode_readv_at pass for every segment
+    size = file_readv(f, iov, iovcnt);
+
+    lock_release(&filesys_lock);
+    return size;
+}
+
+//Gather write. Segments are already validated by get_iovec
+int writev (int fd, const struct iovec *iov, int iovcnt) {
+
+    struct file *f;
+    int size = 0;
+    int i;
+
+    if (fd == 1) {
+        for (i = 0; i < iovcnt; i++) {
+            putbuf(iov[i].iov_base, iov[i].iov_len);
+            size += iov[i].iov_len;
+        }
+        return size;
+    }
+
+    lock_acquire(&filesys_lock);
+
+    //Get file, if NULL or directory, return -1
+    if (!(f = process_get_file(fd))
+        || inode_is_dir (file_get_inode(f))) {
+        lock_release(&filesys_lock);
+        return -1;
+    }
+
+    //One inode_writev_at pass for every segment
+    size = file_writev(f, iov, iovcnt);
+
+    lock_release(&filesys_lock);
+    return size;
+}
+
+//Copy SIZE bytes from fd_in to fd_out inside the kernel
+int copy_file_range (int fd_in, int fd_out, unsigned size) {
+
+    struct file *in, *out;
+    int bytes_copied;
+
+    //off_t is signed
+    if (size > INT32_MAX)
+        size = INT32_MAX;
+
+    lock_acquire(&filesys_lock);
+
+    //Both must be open regular files
+    if (!(in = process_get_file(fd_in)) || !(out = process_get_file(fd_out))
+        || inode_is_dir(file_get_inode(in))
+        || inode_is_dir(file_get_inode(out))) {
+        lock_release(&filesys_lock);
+        return -1;
+    }
+
+    bytes_copied = file_copy(out, in, size);
+
+    lock_release(&filesys_lock);
+    return bytes_copied;
+}
+
+//Create FILE as a copy-on-write clone of fd
+bool reflink (int fd, const char *file) {
+
+    struct file *src;
+    bool success = false;
+
+    lock_acquire(&filesys_lock);
+    if ((src = process_get_file(fd)))
+        success = filesys_clone(src, file);
+    lock_release(&filesys_lock);
+    return success;
+}
+
+//Register RING as this process's async I/O ring
+bool aio_setup (struct aio_ring *ring, void *esp) {
+
+    struct thread *cur = thread_current();
+    struct vm_entry *vme;
+
+    //One ring per process
+    if (cur->aio != NULL)
+        return false;
+
+    //Workers reach the ring through one kernel page, so it must not
+    //straddle a page boundary
+    if (pg_round_down(ring) != pg_round_down((char *) (ring + 1) - 1))
+        return false;
+
+    /* 커널이 completion을 기록하므로 writable이어야 함.
+       munmap으로 사라질 수 있는 mmap 페이지는 허용하지 않음 */
+    vme = check_address(ring, esp);
+    if (vme == NULL || !vme->writable || vme->type == VM_FILE)
+        return false;
+
+    cur->aio = aio_create(ring);
+    return cur->aio != NULL;
+}
+
+//Submit every queued SQE, then wait for MIN_COMPLETE completions.
+//Returns the number of SQEs consumed, or -1 without a ring
+int aio_enter (unsigned min_complete, void *esp) {
+
+    struct aio_context *ctx = thread_current()->aio;
+    struct aio_ring *ring;
+    int submitted = 0;
+
+    if (ctx == NULL)
+        return -1;
+    ring = ctx->uring;
+
+    //Stop early if the completion queue could overflow
+    while (ring->sq_head != ring->sq_tail && aio_can_submit(ctx)) {
+        struct aio_sqe sqe = ring->sq[ring->sq_head % AIO_SQ_ENTRIES];
+        bool is_read = sqe.opcode == AIO_READ;
+        struct file *f = NULL;
+
+        ring->sq_head++;
+        submitted++;
+
+        if ((sqe.opcode != AIO_READ && sqe.opcode != AIO_WRITE)
+            || sqe.len > INT32_MAX) {
+            aio_fail(ctx, sqe.user_data);
+            continue;
+        }
+        /* read, write와 같이 잘못된 버퍼는 프로세스 종료 */
+        check_valid_buffer(sqe.buf, sqe.len, esp, is_read);
+
+        //Each request gets its own file, so closing fd does not matter
+        lock_acquire(&filesys_lock);
+        struct file *open_file = process_get_file(sqe.fd);
+        if (open_file != NULL
+            && (is_read || !inode_is_dir(file_get_inode(open_file))))
+            f = file_reopen(open_file);
+        lock_release(&filesys_lock);
+
+        if (f == NULL)
+            aio_fail(ctx, sqe.user_data);
+        else
+            aio_submit(ctx, &sqe, f);
+    }
+
+    aio_wait(ctx, min_complete);
+    return submitted;
+}
+
+//File system statistics, straight from the superblock counters
+bool statfs (struct statfs *st) {
+    superblock_statfs(st);
+    return true;
+}
+
+//Store the data of fd, an empty file, in compressed clusters
+bool compress (int fd) {
+
+    struct file *f;
+    bool success = false;
+
+    lock_acquire(&filesys_lock);
+    if ((f = process_get_file(fd)))
+        success = inode_set_compressed(file_get_inode(f));
+    lock_release(&filesys_lock);
+    return success;
+}
+
+//Reserve unwritten sectors so fd holds at least offset + length bytes
+bool fallocate (int fd, unsigned offset, unsigned length) {
+
+    struct file *f;
+    bool success = false;
+
+    if (offset > INT32_MAX || length > INT32_MAX)
+        return false;
+
+    lock_acquire(&filesys_lock);
+    if ((f = process_get_file(fd)))
+        success = inode_fallocate(file_get_inode(f), offset, length);
+    lock_release(&filesys_lock);
+    return success;
+}
+
+//Record how fd will be accessed, to steer read-ahead and eviction
+bool fadvise (int fd, unsigned offset, unsigned len, int advice) {
+
+    struct file *f;
+    bool success = false;
+
+    if (offset > INT32_MAX || len > INT32_MAX)
+        return false;
+
+    lock_acquire(&filesys_lock);
+    if ((f = process_get_file(fd)))
+        success = inode_advise(file_get_inode(f), offset, len, advice);
+    lock_release(&filesys_lock);
+    return success;
+}
+
+//I/O statistics of the block device playing role, see <blockstat.h>
+bool blockstat (int role, struct blockstat *st) {
+
+    struct blockstat kst;
+    struct block *block;
+
+    if (role < 0 || role >= BLOCK_ROLE_CNT
+        || (block = block_get_role(role)) == NULL)
+        return false;
+
+    /* interrupt를 끈 채로 user page를 건드리지 않도록 복사해서 전달 */
+    block_get_stats(block, &kst);
+    memcpy(st, &kst, sizeof kst);
+    return true;
+}
+
+//Number of runs of consecutive sectors holding fd's data, 0 for a
+//file the defragmenter leaves alone, -1 for a bad fd
+int extents (int fd) {
+
+    struct file *f;
+    int cnt = -1;
+
+    lock_acquire(&filesys_lock);
+    if ((f = process_get_file(fd)))
+        cnt = inode_extent_cnt(file_get_inode(f));
+    lock_release(&filesys_lock);
+    return cnt;
+}
+
+//Move fd's data into one run now instead of waiting for the
+//defrag thread
+bool defrag (int fd) {
+
+    struct file *f;
+    bool success = false;
+
+    lock_acquire(&filesys_lock);
+    if ((f = process_get_file(fd)))
+        success = inode_defrag(file_get_inode(f));
+    lock_release(&filesys_lock);
+    return success;
+}
+
 void seek (int fd, unsigned position) {
     lock_acquire(&filesys_lock);
     struct file *f = process_get_file(fd);
@@ -378,13 +775,17 @@ void close (int fd) {
 
 void check_valid_buffer (void *buffer, unsigned size, void *esp, 
                          bool to_write) {
-    unsigned i;
     char *local_buffer = (char *)buffer;
-    
+    char *end = local_buffer + size;
+
+    //Wrap around the address space
+    if (end < local_buffer)
+        exit(-1);
+
     /* 인자로 받은 buffer부터 buffer + size까지의 크기가 한페이지의 
-       크기를 넘을 수 도 있음 */
-    //Use for loop
-    for (i=0; i<size; i++) {
+       크기를 넘을 수 도 있음. vm_entry는 페이지 단위이므로
+       페이지마다 한 번씩만 검사 */
+    while (local_buffer < end) {
         /* check_address를 이용해서 주소의 유저영역여부를 검사함과 동시에 
            vm_entry구조체를 얻음 */
         struct vm_entry *vme = check_address ((const void*)local_buffer, esp);
@@ -395,10 +796,32 @@ void check_valid_buffer (void *buffer, unsigned size, void *esp,
                 exit(-1);
             }
         }
-        local_buffer++;
+        //Next page
+        local_buffer = (char *) pg_round_down (local_buffer) + PGSIZE;
     }
 }
 
+/* Copies the IOVCNT-element iovec array at user address UIOV into
+   KIOV, which must have room for IOV_MAX entries, and validates
+   every segment it describes.  Copying first means the segments
+   cannot change under us after they have been checked.
+   Returns false if IOVCNT is out of range. */
+static bool get_iovec (const struct iovec *uiov, int iovcnt,
+                       struct iovec *kiov, void *esp, bool to_write) {
+    int i;
+
+    if (iovcnt < 0 || iovcnt > IOV_MAX)
+        return false;
+
+    check_valid_buffer ((void *) uiov, iovcnt * sizeof *uiov, esp, false);
+    memcpy (kiov, uiov, iovcnt * sizeof *uiov);
+
+    for (i = 0; i < iovcnt; i++)
+        check_valid_buffer (kiov[i].iov_base, kiov[i].iov_len, esp,
+                            to_write);
+    return true;
+}
+
 void check_valid_string (const void *str, void *esp) {
     /* str에 대한 vm_entry의 존재여부를 확인 */
     //if no vm_entry in str, check address return NULL
@@ -472,6 +895,7 @@ int mmap(int fd, void* addr) {
 		vme->zero_bytes = page_zero_bytes;
         vme->writable = true;
         vme->is_loaded = false;
+        vme->pinned = 0;
         vme->vaddr = addr;
 
         //input mmap elem to vme list 
@@ -508,6 +932,9 @@ void do_munmap (struct mmap_file* mmap_file) {
 
         struct vm_entry *vme = list_entry(e, struct vm_entry, mmap_elem);
 
+        //Async I/O may still be using the page
+        aio_wait_unpinned(t->aio, vme);
+
         //if loaded vme? 
         if(vme->is_loaded) {
             //Look dirty or not 
@@ -538,7 +965,7 @@ void do_munmap (struct mmap_file* mmap_file) {
     }
 }
 
-void munmap (int mapid) {   
+void munmap (int mapid) {
     struct thread* t = thread_current();
     struct list_elem *e = list_begin(&t->mmap_list);
     struct list_elem *next;
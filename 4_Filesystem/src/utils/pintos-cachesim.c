@@ -0,0 +1,695 @@
+/* pintos-cachesim: replays a Pintos block trace against several
+   cache replacement policies at several cache sizes, to pick a
+   policy and size for the buffer cache without rebooting Pintos
+   for each one.
+
+   The trace is what a kernel booted with -blocktrace prints at
+   power off, one "bt" line per access (see devices/blocktrace.c):
+
+     bt TICK DEVICE SECTOR COUNT R|W io|ref SOURCE
+
+   Other lines are ignored, so the whole output of a Pintos run
+   may be given.  Each record counts as COUNT accesses, to SECTOR
+   and the sectors after it.  Reads and writes are treated alike,
+   as in a write-back cache.
+
+   "ref" records are the sectors the buffer cache was asked for,
+   which is the stream a cache policy sees, so they are replayed
+   by default if the trace has any.  "io" records are only the
+   requests that reached the disk, already filtered by the
+   kernel's own cache, which is mostly useful for a second-level
+   cache such as a disk's.
+
+   The policies are:
+
+     clock  second chance, as the buffer cache does it
+     lru    least recently used
+     2q     the full 2Q of Johnson and Shasha (VLDB 1994), with
+            25% of the cache for first-time sectors and a history
+            of half the cache size
+     arc    Adaptive Replacement Cache of Megiddo and Modha
+            (FAST 2003) */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Most distinct devices in a trace. */
+#define MAX_DEVICES 64
+
+/* Cache sizes tried if none are given, in sectors. */
+static const size_t default_sizes[] =
+  {16, 32, 64, 128, 256, 512, 1024, 4096};
+#define DEFAULT_SIZE_CNT (sizeof default_sizes / sizeof *default_sizes)
+
+static const char *program_name;
+
+/* The accesses to replay, each a device number in the upper 32
+   bits and a sector in the lower 32. */
+static uint64_t *trace;
+static size_t trace_cnt, trace_max;
+
+/* Device names, indexed by device number. */
+static char *devices[MAX_DEVICES];
+static int device_cnt;
+
+/* Prints a formatted message and exits. */
+static void
+die (const char *format, const char *arg)
+{
+  fprintf (stderr, "%s: ", program_name);
+  fprintf (stderr, format, arg);
+  fputc ('\n', stderr);
+  exit (EXIT_FAILURE);
+}
+
+/* Returns the number of the device named NAME, adding it if it
+   is new. */
+static uint64_t
+device_number (const char *name)
+{
+  int i;
+
+  for (i = 0; i < device_cnt; i++)
+    if (!strcmp (devices[i], name))
+      return i;
+  if (device_cnt >= MAX_DEVICES)
+    die ("%s: too many devices", name);
+  devices[device_cnt] = strdup (name);
+  if (devices[device_cnt] == NULL)
+    die ("%s", "out of memory");
+  return device_cnt++;
+}
+
+/* Appends an access to KEY to the trace. */
+static void
+add_access (uint64_t key)
+{
+  if (trace_cnt >= trace_max)
+    {
+      trace_max = trace_max > 0 ? trace_max * 2 : 4096;
+      trace = realloc (trace, trace_max * sizeof *trace);
+      if (trace == NULL)
+        die ("%s", "out of memory");
+    }
+  trace[trace_cnt++] = key;
+}
+
+/* Returns true if NAME is one of the comma-separated names in
+   LIST, or if LIST is null. */
+static bool
+in_list (const char *list, const char *name)
+{
+  size_t len = strlen (name);
+  const char *p;
+
+  if (list == NULL)
+    return true;
+  for (p = list; p != NULL; p = strchr (p, ','))
+    {
+      if (*p == ',')
+        p++;
+      if (!strncmp (p, name, len) && (p[len] == ',' || p[len] == '\0'))
+        return true;
+    }
+  return false;
+}
+
+/* Reads the trace records in IN of the given KIND ("io" or
+   "ref"), or of the kind there are any "ref" records of if KIND
+   is null, that are on DEVICE (any if null) and come from one of
+   SOURCES (any if null).  Returns the kind read. */
+static const char *
+read_trace (FILE *in, const char *kind, const char *device,
+            const char *sources)
+{
+  struct record
+    {
+      char device[64];
+      unsigned long sector, cnt;
+      char kind[8];
+      char source[16];
+    };
+  struct record *records = NULL;
+  size_t record_cnt = 0, record_max = 0, i;
+  bool have_refs = false;
+  char line[256];
+
+  while (fgets (line, sizeof line, in) != NULL)
+    {
+      struct record r;
+      unsigned long tick;
+      char op;
+
+      if (strncmp (line, "bt ", 3)
+          || sscanf (line, "bt %lu %63s %lu %lu %c %7s %15s", &tick,
+                     r.device, &r.sector, &r.cnt, &op, r.kind,
+                     r.source) != 7)
+        continue;
+      if (!strcmp (r.kind, "ref"))
+        have_refs = true;
+      if ((device != NULL && strcmp (r.device, device))
+          || !in_list (sources, r.source))
+        continue;
+
+      if (record_cnt >= record_max)
+        {
+          record_max = record_max > 0 ? record_max * 2 : 4096;
+          records = realloc (records, record_max * sizeof *records);
+          if (records == NULL)
+            die ("%s", "out of memory");
+        }
+      records[record_cnt++] = r;
+    }
+
+  if (kind == NULL)
+    kind = have_refs ? "ref" : "io";
+  for (i = 0; i < record_cnt; i++)
+    if (!strcmp (records[i].kind, kind))
+      {
+        uint64_t dev = device_number (records[i].device);
+        unsigned long j;
+
+        for (j = 0; j < records[i].cnt; j++)
+          add_access ((dev << 32) | (uint32_t) (records[i].sector + j));
+      }
+  free (records);
+  return kind;
+}
+
+/* Cache bookkeeping shared by the policies. */
+
+/* Lists a node may be on.  Which ones a policy uses is up to the
+   policy. */
+enum list_id
+  {
+    L_NONE,
+    L_MAIN,                     /* LRU; 2Q Am; ARC T2. */
+    L_IN,                       /* 2Q A1in; ARC T1. */
+    L_OUT,                      /* 2Q A1out; ARC B1. */
+    L_OUT2,                     /* ARC B2. */
+    L_CNT
+  };
+
+/* A cached sector, or a remembered one that is no longer cached. */
+struct node
+  {
+    uint64_t key;               /* Device and sector. */
+    struct node *prev, *next;   /* List neighbors. */
+    struct node *hnext;         /* Next in hash bucket. */
+    enum list_id list;          /* List the node is on. */
+    bool ref;                   /* CLOCK reference bit. */
+  };
+
+/* A doubly linked list with a sentinel.  The front is the most
+   recently inserted end. */
+struct list
+  {
+    struct node head;
+    size_t size;
+  };
+
+/* A simulated cache. */
+struct cache
+  {
+    struct node *nodes;         /* Node pool. */
+    struct node *free;          /* Unused nodes, linked by NEXT. */
+    struct node **buckets;      /* Hash table of nodes in use. */
+    size_t bucket_mask;         /* Number of buckets minus 1. */
+    struct list lists[L_CNT];   /* Lists, indexed by enum list_id. */
+  };
+
+/* Sets up C with room for NODE_CNT nodes. */
+static void
+cache_init (struct cache *c, size_t node_cnt)
+{
+  size_t bucket_cnt = 1, i;
+
+  while (bucket_cnt < node_cnt * 2)
+    bucket_cnt *= 2;
+  c->nodes = calloc (node_cnt, sizeof *c->nodes);
+  c->buckets = calloc (bucket_cnt, sizeof *c->buckets);
+  if (c->nodes == NULL || c->buckets == NULL)
+    die ("%s", "out of memory");
+  c->bucket_mask = bucket_cnt - 1;
+  c->free = NULL;
+  for (i = 0; i < node_cnt; i++)
+    {
+      c->nodes[i].next = c->free;
+      c->free = &c->nodes[i];
+    }
+  for (i = 0; i < L_CNT; i++)
+    {
+      c->lists[i].head.prev = c->lists[i].head.next = &c->lists[i].head;
+      c->lists[i].size = 0;
+    }
+}
+
+/* Frees C's memory. */
+static void
+cache_destroy (struct cache *c)
+{
+  free (c->nodes);
+  free (c->buckets);
+}
+
+static struct node **
+bucket (struct cache *c, uint64_t key)
+{
+  uint64_t h = key * 0x9e3779b97f4a7c15ull;
+  return &c->buckets[(h >> 32) & c->bucket_mask];
+}
+
+/* Returns the node for KEY in C, or a null pointer. */
+static struct node *
+lookup (struct cache *c, uint64_t key)
+{
+  struct node *n;
+
+  for (n = *bucket (c, key); n != NULL; n = n->hnext)
+    if (n->key == key)
+      return n;
+  return NULL;
+}
+
+/* Removes node N from the list it is on. */
+static void
+unlink_node (struct cache *c, struct node *n)
+{
+  n->prev->next = n->next;
+  n->next->prev = n->prev;
+  c->lists[n->list].size--;
+  n->list = L_NONE;
+}
+
+/* Puts node N at the front of list L. */
+static void
+push_front (struct cache *c, enum list_id l, struct node *n)
+{
+  struct list *list = &c->lists[l];
+
+  if (n->list != L_NONE)
+    unlink_node (c, n);
+  n->next = list->head.next;
+  n->prev = &list->head;
+  list->head.next->prev = n;
+  list->head.next = n;
+  list->size++;
+  n->list = l;
+}
+
+/* Returns the node at the back of list L, which must not be
+   empty. */
+static struct node *
+back (struct cache *c, enum list_id l)
+{
+  return c->lists[l].head.prev;
+}
+
+static size_t
+size (struct cache *c, enum list_id l)
+{
+  return c->lists[l].size;
+}
+
+/* Returns a new node for KEY, not on any list. */
+static struct node *
+new_node (struct cache *c, uint64_t key)
+{
+  struct node *n = c->free, **b;
+
+  if (n == NULL)
+    die ("%s", "node pool exhausted");
+  c->free = n->next;
+  n->key = key;
+  n->list = L_NONE;
+  n->ref = false;
+  b = bucket (c, key);
+  n->hnext = *b;
+  *b = n;
+  return n;
+}
+
+/* Forgets node N entirely. */
+static void
+delete_node (struct cache *c, struct node *n)
+{
+  struct node **p;
+
+  if (n->list != L_NONE)
+    unlink_node (c, n);
+  for (p = bucket (c, n->key); *p != n; p = &(*p)->hnext)
+    continue;
+  *p = n->hnext;
+  n->next = c->free;
+  c->free = n;
+}
+
+/* The policies.  Each replays the trace against a cache of
+   CAPACITY sectors and returns the number of hits. */
+
+static size_t
+sim_clock (size_t capacity)
+{
+  struct cache c;
+  struct node **frames = calloc (capacity, sizeof *frames);
+  size_t hand = 0, used = 0, hits = 0, i;
+
+  if (frames == NULL)
+    die ("%s", "out of memory");
+  cache_init (&c, capacity);
+  for (i = 0; i < trace_cnt; i++)
+    {
+      struct node *n = lookup (&c, trace[i]);
+
+      if (n != NULL)
+        {
+          hits++;
+          n->ref = true;
+          continue;
+        }
+      if (used < capacity)
+        hand = used++;
+      else
+        {
+          /* Give referenced frames a second chance. */
+          while (frames[hand]->ref)
+            {
+              frames[hand]->ref = false;
+              hand = (hand + 1) % capacity;
+            }
+          delete_node (&c, frames[hand]);
+        }
+      frames[hand] = new_node (&c, trace[i]);
+      frames[hand]->ref = true;
+      hand = (hand + 1) % capacity;
+    }
+  cache_destroy (&c);
+  free (frames);
+  return hits;
+}
+
+static size_t
+sim_lru (size_t capacity)
+{
+  struct cache c;
+  size_t hits = 0, i;
+
+  cache_init (&c, capacity);
+  for (i = 0; i < trace_cnt; i++)
+    {
+      struct node *n = lookup (&c, trace[i]);
+
+      if (n != NULL)
+        hits++;
+      else
+        {
+          if (size (&c, L_MAIN) >= capacity)
+            delete_node (&c, back (&c, L_MAIN));
+          n = new_node (&c, trace[i]);
+        }
+      push_front (&c, L_MAIN, n);
+    }
+  cache_destroy (&c);
+  return hits;
+}
+
+static size_t
+sim_2q (size_t capacity)
+{
+  size_t k_in = capacity / 4 > 0 ? capacity / 4 : 1;
+  size_t k_out = capacity / 2 > 0 ? capacity / 2 : 1;
+  struct cache c;
+  size_t hits = 0, i;
+
+  cache_init (&c, capacity + k_out + 1);
+  for (i = 0; i < trace_cnt; i++)
+    {
+      struct node *n = lookup (&c, trace[i]);
+
+      if (n != NULL && n->list == L_MAIN)
+        {
+          hits++;
+          push_front (&c, L_MAIN, n);
+          continue;
+        }
+      if (n != NULL && n->list == L_IN)
+        {
+          /* A1in is FIFO: a second access soon after the first
+             says nothing about the long term. */
+          hits++;
+          continue;
+        }
+
+      /* Miss.  Make room, preferring to evict from A1in once it
+         is over its share, which sends the sector to A1out. */
+      if (size (&c, L_MAIN) + size (&c, L_IN) >= capacity)
+        {
+          if (size (&c, L_IN) > k_in || size (&c, L_MAIN) == 0)
+            {
+              push_front (&c, L_OUT, back (&c, L_IN));
+              if (size (&c, L_OUT) > k_out)
+                delete_node (&c, back (&c, L_OUT));
+            }
+          else
+            delete_node (&c, back (&c, L_MAIN));
+        }
+
+      /* A sector seen again after leaving A1in has proven
+         itself. */
+      if (n != NULL && n->list == L_OUT && lookup (&c, trace[i]) == n)
+        push_front (&c, L_MAIN, n);
+      else
+        push_front (&c, L_IN, new_node (&c, trace[i]));
+    }
+  cache_destroy (&c);
+  return hits;
+}
+
+/* ARC's REPLACE: moves the LRU sector of T1 or T2 to its ghost
+   list, depending on target size P.  IN_B2 is true if the
+   sector being brought in was found in B2. */
+static void
+arc_replace (struct cache *c, size_t p, bool in_b2)
+{
+  size_t t1 = size (c, L_IN);
+
+  if (t1 > 0 && (size (c, L_MAIN) == 0 || (in_b2 && t1 == p) || t1 > p))
+    push_front (c, L_OUT, back (c, L_IN));
+  else
+    push_front (c, L_OUT2, back (c, L_MAIN));
+}
+
+static size_t
+sim_arc (size_t capacity)
+{
+  struct cache c;
+  size_t p = 0, hits = 0, i;
+
+  cache_init (&c, 2 * capacity + 1);
+  for (i = 0; i < trace_cnt; i++)
+    {
+      struct node *n = lookup (&c, trace[i]);
+      size_t t1 = size (&c, L_IN), t2 = size (&c, L_MAIN);
+      size_t b1 = size (&c, L_OUT), b2 = size (&c, L_OUT2);
+
+      if (n != NULL && (n->list == L_IN || n->list == L_MAIN))
+        {
+          /* Case I: hit in T1 or T2. */
+          hits++;
+          push_front (&c, L_MAIN, n);
+        }
+      else if (n != NULL && n->list == L_OUT)
+        {
+          /* Case II: ghost hit in B1, so T1 should be bigger. */
+          size_t delta = b1 >= b2 ? 1 : b2 / b1;
+          p = p + delta < capacity ? p + delta : capacity;
+          arc_replace (&c, p, false);
+          push_front (&c, L_MAIN, n);
+        }
+      else if (n != NULL && n->list == L_OUT2)
+        {
+          /* Case III: ghost hit in B2, so T2 should be bigger. */
+          size_t delta = b2 >= b1 ? 1 : b1 / b2;
+          p = p > delta ? p - delta : 0;
+          arc_replace (&c, p, true);
+          push_front (&c, L_MAIN, n);
+        }
+      else
+        {
+          /* Case IV: not seen recently at all. */
+          if (t1 + b1 == capacity)
+            {
+              if (t1 < capacity)
+                {
+                  delete_node (&c, back (&c, L_OUT));
+                  arc_replace (&c, p, false);
+                }
+              else
+                delete_node (&c, back (&c, L_IN));
+            }
+          else if (t1 + t2 + b1 + b2 >= capacity)
+            {
+              if (t1 + t2 + b1 + b2 == 2 * capacity)
+                delete_node (&c, back (&c, L_OUT2));
+              arc_replace (&c, p, false);
+            }
+          push_front (&c, L_IN, new_node (&c, trace[i]));
+        }
+    }
+  cache_destroy (&c);
+  return hits;
+}
+
+/* A policy. */
+struct policy
+  {
+    const char *name;
+    size_t (*simulate) (size_t capacity);
+  };
+
+static const struct policy policies[] =
+  {
+    {"clock", sim_clock},
+    {"lru", sim_lru},
+    {"2q", sim_2q},
+    {"arc", sim_arc},
+  };
+#define POLICY_CNT (sizeof policies / sizeof *policies)
+
+/* Returns the number of distinct keys in the trace, which is the
+   number of misses no cache can avoid. */
+static size_t
+distinct_cnt (void)
+{
+  struct cache c;
+  size_t cnt = 0, i;
+
+  cache_init (&c, trace_cnt);
+  for (i = 0; i < trace_cnt; i++)
+    if (lookup (&c, trace[i]) == NULL)
+      {
+        new_node (&c, trace[i]);
+        cnt++;
+      }
+  cache_destroy (&c);
+  return cnt;
+}
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "pintos-cachesim: replays a Pintos block trace against cache "
+           "policies\n"
+           "usage: %s [-k KIND] [-d DEVICE] [-s SOURCES] [-c SIZES] [FILE]\n"
+           "  where KIND is `ref' (cache accesses, the default if the\n"
+           "    trace has any) or `io' (disk requests),\n"
+           "    DEVICE limits the replay to one device, e.g. hda2,\n"
+           "    SOURCES limits it to a comma-separated list of sources,\n"
+           "    e.g. `other,journal',\n"
+           "    SIZES is a comma-separated list of cache sizes in sectors\n"
+           "    (default: 16,32,64,128,256,512,1024,4096),\n"
+           "    and FILE is the output of a run with -blocktrace (default:\n"
+           "    standard input).\n",
+           program_name);
+  exit (EXIT_FAILURE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *kind = NULL, *device = NULL, *sources = NULL;
+  const char *size_list = NULL;
+  size_t sizes[64], size_cnt = 0, distinct, i, j;
+  FILE *in = stdin;
+
+  program_name = argv[0];
+  for (argv++; *argv != NULL && (*argv)[0] == '-' && (*argv)[1] != '\0';
+       argv++)
+    {
+      const char *opt = *argv;
+
+      if (strlen (opt) != 2 || argv[1] == NULL)
+        usage ();
+      argv++;
+      switch (opt[1])
+        {
+        case 'k':
+          kind = *argv;
+          if (strcmp (kind, "ref") && strcmp (kind, "io"))
+            usage ();
+          break;
+        case 'd':
+          device = *argv;
+          break;
+        case 's':
+          sources = *argv;
+          break;
+        case 'c':
+          size_list = *argv;
+          break;
+        default:
+          usage ();
+        }
+    }
+  (void) argc;
+
+  if (size_list != NULL)
+    {
+      const char *p = size_list;
+
+      while (size_cnt < sizeof sizes / sizeof *sizes)
+        {
+          char *end;
+          unsigned long s = strtoul (p, &end, 10);
+          if (end == p || s == 0 || (*end != ',' && *end != '\0'))
+            die ("%s: bad cache size list", size_list);
+          sizes[size_cnt++] = s;
+          if (*end == '\0')
+            break;
+          p = end + 1;
+        }
+    }
+  else
+    for (size_cnt = 0; size_cnt < DEFAULT_SIZE_CNT; size_cnt++)
+      sizes[size_cnt] = default_sizes[size_cnt];
+
+  if (*argv != NULL)
+    {
+      if (argv[1] != NULL)
+        usage ();
+      in = fopen (*argv, "r");
+      if (in == NULL)
+        die ("%s: could not open", *argv);
+    }
+  kind = read_trace (in, kind, device, sources);
+  if (in != stdin)
+    fclose (in);
+  if (trace_cnt == 0)
+    die ("%s", "no matching trace records");
+
+  distinct = distinct_cnt ();
+  printf ("%zu accesses to %zu sectors (%s records, %s, %s)\n",
+          trace_cnt, distinct, kind,
+          device != NULL ? device : "all devices",
+          sources != NULL ? sources : "all sources");
+  printf ("best possible hit ratio with an unlimited cache: %.2f%%\n\n",
+          100.0 * (trace_cnt - distinct) / trace_cnt);
+
+  printf ("%8s", "size");
+  for (j = 0; j < POLICY_CNT; j++)
+    printf ("%10s", policies[j].name);
+  printf ("\n");
+  for (i = 0; i < size_cnt; i++)
+    {
+      printf ("%8zu", sizes[i]);
+      for (j = 0; j < POLICY_CNT; j++)
+        printf ("%9.2f%%",
+                100.0 * policies[j].simulate (sizes[i]) / trace_cnt);
+      printf ("\n");
+    }
+  return EXIT_SUCCESS;
+}
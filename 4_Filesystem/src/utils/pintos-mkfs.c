@@ -0,0 +1,458 @@
+/* pintos-mkfs: builds a formatted Pintos file system partition
+   from a host directory, without booting Pintos.
+
+   The image has the layout that filesys_init() expects after
+   do_format(), with the host directory's tree already in it:
+
+     0       superblock
+     1       free map inode
+     2       root directory inode
+     3       refcount file inode
+     4       orphan list head
+     5       buffer cache warm-up list
+     6...    free map data, refcount data, journal, then the
+             directories and files in depth-first order
+
+   Each file's inode is followed by its data sectors, all in one
+   run, and then by its index blocks, if it needs any.  Everything
+   after the last file is free.  The superblock is marked clean,
+   so the first boot does not need to recount anything.
+
+   The structures below must match filesys/superblock.h,
+   filesys/inode.c, filesys/directory.c, filesys/journal.c and
+   filesys/warmup.c. */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define SECTOR_SIZE 512
+
+/* Fixed sectors, from filesys/filesys.h and superblock.h. */
+#define SUPERBLOCK_SECTOR 0
+#define FREE_MAP_SECTOR 1
+#define ROOT_DIR_SECTOR 2
+#define REFCOUNT_SECTOR 3
+#define ORPHAN_SECTOR 4
+#define WARMUP_SECTOR 5
+#define FIRST_FREE_SECTOR 6
+
+#define SUPERBLOCK_MAGIC 0x53465350
+#define SB_FEATURE_REFCOUNT 0x1
+#define SB_FEATURE_JOURNAL 0x2
+#define SB_FEATURE_ORPHAN 0x4
+
+#define INODE_MAGIC 0x494e4f44
+#define DIRECT_BLOCK_ENTRIES 121
+#define INDIRECT_BLOCK_ENTRIES (SECTOR_SIZE / sizeof (uint32_t))
+
+#define JOURNAL_SECTORS 256
+#define JOURNAL_MAGIC 0x4a524e4c
+#define WARMUP_MAGIC 0x4d524157
+
+#define PINTOS_NAME_MAX 14
+#define ROOT_DIR_ENTRIES 16
+
+struct superblock
+  {
+    uint32_t magic;
+    uint32_t sector_cnt;
+    uint32_t sector_size;
+    uint32_t free_map_sector;
+    uint32_t root_dir_sector;
+    uint32_t refcount_sector;
+    uint32_t features;
+    uint32_t free_cnt;
+    uint32_t inode_cnt;
+    uint32_t clean;
+    uint32_t journal_sector;
+    uint32_t journal_cnt;
+    uint32_t orphan_sector;
+    uint32_t warmup_sector;
+    uint32_t unused[114];
+  };
+
+struct inode_disk
+  {
+    int32_t length;
+    uint32_t magic;
+    uint32_t is_dir;
+    uint32_t flags;
+    uint32_t next_orphan;
+    uint32_t direct_map_table[DIRECT_BLOCK_ENTRIES];
+    uint32_t indirect_block_sec;
+    uint32_t double_indirect_block_sec;
+  };
+
+struct dir_entry
+  {
+    uint32_t inode_sector;
+    char name[PINTOS_NAME_MAX + 1];
+    uint8_t in_use;
+  };
+
+struct journal_header
+  {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t unused[126];
+  };
+
+struct warmup_block
+  {
+    uint32_t magic;
+    uint32_t cnt;
+    uint32_t sectors[126];
+  };
+
+static const char *program_name;
+static uint8_t *image;                  /* The whole partition. */
+static uint32_t sector_cnt;             /* Sectors in the partition. */
+static uint32_t next_sector;            /* First sector not yet used. */
+static uint32_t inode_cnt;              /* Files and directories. */
+
+/* Prints a formatted message and exits. */
+static void
+die (const char *format, const char *arg)
+{
+  fprintf (stderr, "%s: ", program_name);
+  fprintf (stderr, format, arg);
+  fputc ('\n', stderr);
+  exit (EXIT_FAILURE);
+}
+
+/* Returns a pointer to SECTOR in the image. */
+static void *
+sector_ptr (uint32_t sector)
+{
+  return image + (size_t) sector * SECTOR_SIZE;
+}
+
+/* Returns the number of sectors needed for SIZE bytes. */
+static uint32_t
+bytes_to_sectors (uint64_t size)
+{
+  return (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+}
+
+/* Allocates CNT consecutive sectors and returns the first. */
+static uint32_t
+alloc_sectors (uint32_t cnt, const char *what)
+{
+  uint32_t first = next_sector;
+
+  if (cnt > sector_cnt - next_sector)
+    die ("file system full while adding %s", what);
+  next_sector += cnt;
+  return first;
+}
+
+/* Writes at SECTOR an inode for LENGTH bytes of data that start
+   at sector DATA and run on contiguously, allocating the index
+   blocks it needs right after that run. */
+static void
+write_inode (uint32_t sector, uint64_t length, bool is_dir, uint32_t data,
+             const char *what)
+{
+  struct inode_disk *disk_inode = sector_ptr (sector);
+  uint32_t cnt = bytes_to_sectors (length);
+  uint32_t i;
+
+  if (cnt > DIRECT_BLOCK_ENTRIES
+      + INDIRECT_BLOCK_ENTRIES * (INDIRECT_BLOCK_ENTRIES + 1))
+    die ("%s: too large for a Pintos file", what);
+
+  disk_inode->length = length;
+  disk_inode->magic = INODE_MAGIC;
+  disk_inode->is_dir = is_dir;
+  for (i = 0; i < cnt && i < DIRECT_BLOCK_ENTRIES; i++)
+    disk_inode->direct_map_table[i] = data + i;
+  if (cnt <= DIRECT_BLOCK_ENTRIES)
+    return;
+
+  /* Indirect block. */
+  cnt -= DIRECT_BLOCK_ENTRIES;
+  data += DIRECT_BLOCK_ENTRIES;
+  {
+    uint32_t *table;
+
+    disk_inode->indirect_block_sec = alloc_sectors (1, what);
+    table = sector_ptr (disk_inode->indirect_block_sec);
+    for (i = 0; i < cnt && i < INDIRECT_BLOCK_ENTRIES; i++)
+      table[i] = data + i;
+  }
+  if (cnt <= INDIRECT_BLOCK_ENTRIES)
+    return;
+
+  /* Double indirect block, then one indirect block per 128. */
+  cnt -= INDIRECT_BLOCK_ENTRIES;
+  data += INDIRECT_BLOCK_ENTRIES;
+  {
+    uint32_t *outer;
+
+    disk_inode->double_indirect_block_sec = alloc_sectors (1, what);
+    outer = sector_ptr (disk_inode->double_indirect_block_sec);
+    for (i = 0; i < cnt; i += INDIRECT_BLOCK_ENTRIES)
+      {
+        uint32_t *table;
+        uint32_t j;
+
+        outer[i / INDIRECT_BLOCK_ENTRIES] = alloc_sectors (1, what);
+        table = sector_ptr (outer[i / INDIRECT_BLOCK_ENTRIES]);
+        for (j = 0; j < INDIRECT_BLOCK_ENTRIES && i + j < cnt; j++)
+          table[j] = data + i + j;
+      }
+  }
+}
+
+/* Creates a file of LENGTH zero bytes whose inode is at SECTOR. */
+static void
+add_empty_file (uint32_t sector, uint64_t length, const char *what)
+{
+  uint32_t data = alloc_sectors (bytes_to_sectors (length), what);
+  write_inode (sector, length, false, data, what);
+}
+
+/* Copies the host file PATH into the image.
+   Returns its inode sector. */
+static uint32_t
+add_file (const char *path)
+{
+  uint32_t sector = alloc_sectors (1, path);
+  uint32_t data;
+  struct stat st;
+  FILE *file;
+
+  file = fopen (path, "rb");
+  if (file == NULL || fstat (fileno (file), &st) < 0)
+    die ("%s: open failed", path);
+  if ((uint64_t) st.st_size > INT32_MAX)
+    die ("%s: too large for a Pintos file", path);
+
+  data = alloc_sectors (bytes_to_sectors (st.st_size), path);
+  if (fread (sector_ptr (data), 1, st.st_size, file) != (size_t) st.st_size)
+    die ("%s: read failed", path);
+  fclose (file);
+
+  write_inode (sector, st.st_size, false, data, path);
+  inode_cnt++;
+  return sector;
+}
+
+/* Compares directory entry names for qsort(). */
+static int
+compare_names (const void *a_, const void *b_)
+{
+  const char *const *a = a_;
+  const char *const *b = b_;
+  return strcmp (*a, *b);
+}
+
+/* Sets entry IDX of the directory whose entries start at sector
+   DATA to NAME, with its inode at SECTOR. */
+static void
+set_entry (uint32_t data, size_t idx, const char *name, uint32_t sector)
+{
+  struct dir_entry *e = (struct dir_entry *) sector_ptr (data) + idx;
+
+  e->inode_sector = sector;
+  strncpy (e->name, name, PINTOS_NAME_MAX);
+  e->in_use = 1;
+}
+
+/* Copies the host directory PATH and everything below it into the
+   image, as a directory with its inode at SECTOR whose parent's
+   inode is at PARENT.  Entries are added in name order, so the
+   same tree always gives the same image. */
+static void
+add_dir (const char *path, uint32_t sector, uint32_t parent)
+{
+  char **names = NULL;
+  size_t name_cnt = 0, entry_cnt, i;
+  struct dirent *de;
+  uint32_t data;
+  DIR *dir;
+
+  dir = opendir (path);
+  if (dir == NULL)
+    die ("%s: opendir failed", path);
+  while ((de = readdir (dir)) != NULL)
+    {
+      if (!strcmp (de->d_name, ".") || !strcmp (de->d_name, ".."))
+        continue;
+      if (strlen (de->d_name) > PINTOS_NAME_MAX)
+        {
+          fprintf (stderr, "%s: %s/%s: name too long, skipped\n",
+                   program_name, path, de->d_name);
+          continue;
+        }
+      names = realloc (names, (name_cnt + 1) * sizeof *names);
+      if (names == NULL || (names[name_cnt] = strdup (de->d_name)) == NULL)
+        die ("%s: out of memory", path);
+      name_cnt++;
+    }
+  closedir (dir);
+  qsort (names, name_cnt, sizeof *names, compare_names);
+
+  /* "." and ".." take the first two entries. */
+  entry_cnt = name_cnt + 2;
+  if (entry_cnt < ROOT_DIR_ENTRIES)
+    entry_cnt = ROOT_DIR_ENTRIES;
+  data = alloc_sectors (bytes_to_sectors (entry_cnt
+                                          * sizeof (struct dir_entry)),
+                        path);
+  write_inode (sector, entry_cnt * sizeof (struct dir_entry), true, data,
+               path);
+  set_entry (data, 0, ".", sector);
+  set_entry (data, 1, "..", parent);
+
+  for (i = 0; i < name_cnt; i++)
+    {
+      size_t len = strlen (path) + strlen (names[i]) + 2;
+      char *child = malloc (len);
+      struct stat st;
+
+      if (child == NULL)
+        die ("%s: out of memory", path);
+      snprintf (child, len, "%s/%s", path, names[i]);
+      if (stat (child, &st) < 0)
+        die ("%s: stat failed", child);
+
+      if (S_ISDIR (st.st_mode))
+        {
+          uint32_t child_sector = alloc_sectors (1, child);
+          set_entry (data, i + 2, names[i], child_sector);
+          inode_cnt++;
+          add_dir (child, child_sector, sector);
+        }
+      else if (S_ISREG (st.st_mode))
+        set_entry (data, i + 2, names[i], add_file (child));
+      else
+        fprintf (stderr, "%s: %s: not a regular file, skipped\n",
+                 program_name, child);
+      free (child);
+      free (names[i]);
+    }
+  free (names);
+}
+
+/* Writes the free map: every sector before NEXT_SECTOR is in use.
+   The map is an array of 32-bit words, as in lib/kernel/bitmap.c. */
+static void
+write_free_map (uint32_t data)
+{
+  uint32_t *words = sector_ptr (data);
+  uint32_t i;
+
+  for (i = 0; i < next_sector; i++)
+    words[i / 32] |= (uint32_t) 1 << (i % 32);
+}
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "pintos-mkfs: builds a Pintos file system partition from a "
+           "directory\n"
+           "usage: %s [-s SIZE] IMAGE DIRECTORY\n"
+           "  where SIZE is the partition size in MB (default: 2),\n"
+           "    IMAGE is the partition image to create, for use with\n"
+           "    `pintos-mkdisk --filesys=IMAGE',\n"
+           "    and DIRECTORY is copied into its root directory.\n",
+           program_name);
+  exit (EXIT_FAILURE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *image_fn, *dir_fn;
+  double size_mb = 2.0;
+  uint32_t free_map_data, journal = 0, journal_cnt = 0;
+  uint32_t map_bytes;
+  struct superblock *sb;
+  FILE *out;
+
+  program_name = argv[0];
+  if (argc == 5 && !strcmp (argv[1], "-s"))
+    {
+      size_mb = strtod (argv[2], NULL);
+      argv += 2;
+      argc -= 2;
+    }
+  if (argc != 3)
+    usage ();
+  image_fn = argv[1];
+  dir_fn = argv[2];
+
+  if (sizeof (struct superblock) != SECTOR_SIZE
+      || sizeof (struct inode_disk) != SECTOR_SIZE
+      || sizeof (struct dir_entry) != 20)
+    die ("%s", "on-disk structures have the wrong size");
+
+  if (size_mb <= 0 || size_mb > 2048)
+    die ("%s: bad partition size", argv[0]);
+  sector_cnt = size_mb * 1024 * 1024 / SECTOR_SIZE;
+  if (sector_cnt < FIRST_FREE_SECTOR + 64)
+    die ("%s: partition too small", argv[0]);
+  image = calloc (sector_cnt, SECTOR_SIZE);
+  if (image == NULL)
+    die ("%s: out of memory", image_fn);
+
+  /* Same order as do_format(). */
+  next_sector = FIRST_FREE_SECTOR;
+  map_bytes = (sector_cnt + 31) / 32 * 4;
+  free_map_data = alloc_sectors (bytes_to_sectors (map_bytes), "free map");
+  write_inode (FREE_MAP_SECTOR, map_bytes, false, free_map_data, "free map");
+  add_empty_file (REFCOUNT_SECTOR, sector_cnt, "refcount file");
+  if (sector_cnt - next_sector >= JOURNAL_SECTORS)
+    {
+      struct journal_header *header;
+
+      journal = alloc_sectors (JOURNAL_SECTORS, "journal");
+      journal_cnt = JOURNAL_SECTORS;
+      header = sector_ptr (journal);
+      header->magic = JOURNAL_MAGIC;
+      header->seq = 1;
+    }
+  ((struct warmup_block *) sector_ptr (WARMUP_SECTOR))->magic = WARMUP_MAGIC;
+
+  inode_cnt = 1;
+  add_dir (dir_fn, ROOT_DIR_SECTOR, ROOT_DIR_SECTOR);
+  write_free_map (free_map_data);
+
+  sb = sector_ptr (SUPERBLOCK_SECTOR);
+  sb->magic = SUPERBLOCK_MAGIC;
+  sb->sector_cnt = sector_cnt;
+  sb->sector_size = SECTOR_SIZE;
+  sb->free_map_sector = FREE_MAP_SECTOR;
+  sb->root_dir_sector = ROOT_DIR_SECTOR;
+  sb->refcount_sector = REFCOUNT_SECTOR;
+  sb->orphan_sector = ORPHAN_SECTOR;
+  sb->warmup_sector = WARMUP_SECTOR;
+  sb->features = SB_FEATURE_REFCOUNT | SB_FEATURE_ORPHAN;
+  if (journal_cnt > 0)
+    {
+      sb->features |= SB_FEATURE_JOURNAL;
+      sb->journal_sector = journal;
+      sb->journal_cnt = journal_cnt;
+    }
+  sb->free_cnt = sector_cnt - next_sector;
+  sb->inode_cnt = inode_cnt;
+  sb->clean = 1;
+
+  out = fopen (image_fn, "wb");
+  if (out == NULL)
+    die ("%s: create failed", image_fn);
+  if (fwrite (image, SECTOR_SIZE, sector_cnt, out) != sector_cnt
+      || fclose (out) != 0)
+    die ("%s: write failed", image_fn);
+
+  printf ("%s: %u files and directories, %u of %u sectors used\n",
+          image_fn, inode_cnt, next_sector, sector_cnt);
+  return EXIT_SUCCESS;
+}
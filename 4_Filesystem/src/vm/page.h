@@ -29,6 +29,10 @@ struct vm_entry{
     /* Swapping 과제에서다룰예정*/
     size_t swap_slot; /* 스왑슬롯*/
 
+    /* 진행 중인 비동기 I/O가 고정한 횟수, 0이 될 때까지
+       unmap 불가 (aio_wait_unpinned() 참고) */
+    int pinned;
+
     /* ‘vm_entry들을위한자료구조’ 부분에서다룰예정*/
     struct hash_elem elem; /*해시테이블Element */
 };
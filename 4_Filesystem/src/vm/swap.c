@@ -26,8 +26,6 @@ size_t swap_out(void *kaddr) {
 //스왑파티션에 접근할수 있어야하고 어느번째위치에 저장해야하는지 알 수 있어야함
 //swap_bitmap에서 값이 0인 자리를 찾아야함
 
-    size_t i;
-
     if (!(swap_block && swap_bitmap)) {
         printf("\nin swap_out no swap block or swap map\n");
         return;
@@ -37,10 +35,9 @@ size_t swap_out(void *kaddr) {
 
 	size_t index = bitmap_scan_and_flip(swap_bitmap, 0, 1, SWAP_FREE);
 
-    for (i=0; i<PGSIZE/BLOCK_SECTOR_SIZE; i++) {
-	    block_write(swap_block, index * PGSIZE/BLOCK_SECTOR_SIZE, 
-                    kaddr + i * BLOCK_SECTOR_SIZE);
-    }
+    /* page 하나(8 sector)를 한 번에 기록 */
+    block_write_multi (swap_block, index * (PGSIZE/BLOCK_SECTOR_SIZE),
+                       PGSIZE/BLOCK_SECTOR_SIZE, kaddr);
     lock_release (&swap_lock);
     return index;
 }
@@ -50,18 +47,14 @@ size_t swap_out(void *kaddr) {
 //page_fault함수 발생시 vme는 있는데 present bit 가 0일때 쓰임
 void swap_in (size_t used_index, void *kaddr) {
 	
-    size_t i;
     if (!(swap_block && swap_bitmap)) {
         printf("\nin swap_in no swap block or swap map\n");
         return;
 
     lock_acquire (&swap_lock);
 
-    for (i=0; i<PGSIZE/BLOCK_SECTOR_SIZE; i++) {
-	    block_read (swap_block, 
-                    used_index * (PGSIZE/BLOCK_SECTOR_SIZE) + i, 
-                    kaddr + i * BLOCK_SECTOR_SIZE);
-    }
+    block_read_multi (swap_block, used_index * (PGSIZE/BLOCK_SECTOR_SIZE),
+                      PGSIZE/BLOCK_SECTOR_SIZE, kaddr);
     lock_release (&swap_lock);
 
     /*if (BITMAP_ERROR == bitmap_scan(swap_bitmap, used_index, 1, 1))